@@ -0,0 +1,12 @@
+// Sums a global int array many times
+int array[4096];
+
+long main() {
+    int i, round;
+    long sum = 0;
+    for (i = 0; i < 4096; i += 1) array[i] = i;
+    for (round = 0; round < 20000; round += 1) {
+        for (i = 0; i < 4096; i += 1) sum += array[i];
+    }
+    return sum & 255;
+}
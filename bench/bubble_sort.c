@@ -0,0 +1,21 @@
+// Bubble sort of a pseudo random int array
+int array[5000];
+
+int main() {
+    int i, j, swap;
+    long seed = 12345;
+    for (i = 0; i < 5000; i += 1) {
+        seed = (seed * 1103515245 + 12345) & 2147483647;
+        array[i] = seed % 100000;
+    }
+    for (i = 0; i < 4999; i += 1) {
+        for (j = 0; j < 4999 - i; j += 1) {
+            if (array[j] > array[j + 1]) {
+                swap = array[j];
+                array[j] = array[j + 1];
+                array[j + 1] = swap;
+            }
+        }
+    }
+    return (array[0] + array[2500] + array[4999]) & 255;
+}
@@ -0,0 +1,7 @@
+// Naive recursive fibonacci, mostly calls and small frames
+int fib(int n) {
+    if (n < 2) return n;
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main() { return fib(34) & 255; }
@@ -0,0 +1,21 @@
+// FNV-1a hashes of a string literal with 32 bit unsigned arithmetic
+unsigned int hash(char *text, int length) {
+    unsigned int h = 2166136261;
+    int i;
+    for (i = 0; i < length; i += 1) {
+        h ^= text[i];
+        h *= 16777619;
+    }
+    return h;
+}
+
+int main() {
+    char *text = "The quick brown fox jumps over the lazy dog, then the lazy dog sleeps";
+    int length = 0, round;
+    unsigned int sum = 0;
+    int result;
+    while (text[length]) length += 1;
+    for (round = 0; round < 1000000; round += 1) sum += hash(text + (round & 7), length - 8);
+    result = sum & 255;
+    return result;
+}
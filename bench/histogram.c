@@ -0,0 +1,17 @@
+// Byte histogram of a pseudo random buffer
+char data[65536];
+int counts[256];
+
+int main() {
+    int i, round;
+    long seed = 1;
+    for (i = 0; i < 65536; i += 1) {
+        seed = (seed * 1103515245 + 12345) & 2147483647;
+        data[i] = seed >> 16;
+    }
+    for (round = 0; round < 500; round += 1) {
+        for (i = 0; i < 256; i += 1) counts[i] = 0;
+        for (i = 0; i < 65536; i += 1) counts[data[i] & 255] += 1;
+    }
+    return (counts[0] + counts[100] * 3) & 255;
+}
@@ -0,0 +1,23 @@
+// Multiplies two square int matrices
+int a[96][96];
+int b[96][96];
+int c[96][96];
+
+int main() {
+    int i, j, k, round;
+    for (i = 0; i < 96; i += 1) {
+        for (j = 0; j < 96; j += 1) {
+            a[i][j] = i + j;
+            b[i][j] = i - j;
+        }
+    }
+    for (round = 0; round < 10; round += 1) {
+        for (i = 0; i < 96; i += 1) {
+            for (j = 0; j < 96; j += 1) {
+                c[i][j] = 0;
+                for (k = 0; k < 96; k += 1) c[i][j] += a[i][k] * b[k][j];
+            }
+        }
+    }
+    return c[12][34] & 255;
+}
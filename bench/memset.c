@@ -0,0 +1,10 @@
+// Fills a global byte buffer many times
+char buffer[65536];
+
+char main() {
+    int i, round;
+    for (round = 0; round < 2000; round += 1) {
+        for (i = 0; i < 65536; i += 1) buffer[i] = round;
+    }
+    return buffer[1234];
+}
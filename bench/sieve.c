@@ -0,0 +1,17 @@
+// Sieve of Eratosthenes over a global byte array
+char composite[1000000];
+
+int main() {
+    int i, j, round, count;
+    for (round = 0; round < 10; round += 1) {
+        for (i = 0; i < 1000000; i += 1) composite[i] = 0;
+        count = 0;
+        for (i = 2; i < 1000000; i += 1) {
+            if (!composite[i]) {
+                count += 1;
+                for (j = i + i; j < 1000000; j += i) composite[j] = 1;
+            }
+        }
+    }
+    return count & 255;
+}
@@ -0,0 +1,11 @@
+// Deep self recursion and sibling calls, only runs in constant stack with tail calls
+long step(long n, long sum) { return sum + n % 7; }
+
+long walk(long n, long sum) {
+    if (n == 0) return sum;
+    return walk(n - 1, step(n, sum));
+}
+
+long sum_to(long n) { return walk(n, 0); }
+
+long main() { return sum_to(100000000) & 255; }
@@ -0,0 +1,20 @@
+// Adds two global int arrays and checksums a byte buffer many times
+int a[4096];
+int b[4096];
+int c[4096];
+char bytes[4096];
+
+long main() {
+    int i, round;
+    long sum = 0;
+    for (i = 0; i < 4096; i += 1) {
+        a[i] = i;
+        b[i] = 4096 - i;
+        bytes[i] = i;
+    }
+    for (round = 0; round < 10000; round += 1) {
+        for (i = 0; i < 4096; i += 1) c[i] = a[i] + b[i];
+        for (i = 0; i < 4096; i += 1) sum += bytes[i];
+    }
+    return ((sum >> 8) + c[100] - 4096) & 255;
+}
@@ -1,6 +1,9 @@
 #!/bin/sh
 # ./build.sh      | Build bcc
 # ./build.sh test | Build and run tests
+# ./build.sh bench | Build and run benchmarks
+# ./build.sh bench baseline | Build, run benchmarks and store the results in bench/baseline.txt
+# ./build.sh throughput | Build and measure compile time and memory of generated programs of growing size
 
 if [ "$(uname -s)" = Darwin ]; then
     clang --target=x86_64-macos -Wall -Wextra -Wpedantic --std=c11 -Icompiler/include $(find compiler -name "*.c") -o bcc-x86_64 || exit
@@ -9,52 +12,121 @@ if [ "$(uname -s)" = Darwin ]; then
     fi
 fi
 if [ "$(uname -s)" = Linux ]; then
-    gcc -Wall -Wextra -Wpedantic --std=gnu11 -Icompiler/include $(find compiler -name "*.c") -ldl -o bcc-x86_64 || exit
+    gcc -Wall -Wextra -Wpedantic --std=gnu11 -Icompiler/include $(find compiler -name "*.c") -ldl -pthread -o bcc-x86_64 || exit
+    gcc -Wall -Wextra -Wpedantic --std=gnu11 -fPIC -shared -fvisibility=hidden -Icompiler/include $(find compiler -name "*.c" ! -name main.c) -ldl -pthread -o libbcc.so || exit
 fi
 if [ "$(uname -o)" = Msys ]; then
-    gcc -Wall -Wextra -Wpedantic --std=c11 -Icompiler/include $(find compiler -name "*.c") -o bcc-x86_64 || exit
+    gcc -Wall -Wextra -Wpedantic --std=c11 -Icompiler/include $(find compiler -name "*.c") -pthread -o bcc-x86_64 || exit
 fi
 
-# Function that runs a test
+# Function that adds a test to the test batch, the batch needs fork so on Msys every test runs in its own compiler process
 assert() {
     expected=$1
     input="$2"
 
-    # Compile and run for x86_64
-    if [ -e "./bcc-x86_64" ]; then
-        if [ "$(uname -o)" = Msys ]; then
-            echo -e "$input" | ./bcc-x86_64 $(find stdlib -name "*.h") -
-        else
-            echo "$input" | ./bcc-x86_64 $(find stdlib -name "*.h") -
-        fi
-        actual=$?
-        if [ $actual != "$expected" ]; then
-            echo "[FAIL] Program:"
-            echo "$input"
-            echo "Dump:"
-            echo "$input" | ./bcc-x86_64 -d $(find stdlib -name "*.h") -
-            echo "Arch: x86_64 | Return: $actual | Correct: $expected"
-            exit 1
-        fi
+    if [ "$(uname -o)" = Msys ]; then
+        for flags in "" "-O" "-l" "-l -O" "-t"; do
+            echo -e "$input" | ./bcc-x86_64 $flags $(find stdlib -name "*.h") -
+            actual=$?
+            if [ $actual != "$expected" ]; then
+                echo "[FAIL] Program:"
+                echo "$input"
+                echo "Dump:"
+                echo -e "$input" | ./bcc-x86_64 -d $flags $(find stdlib -name "*.h") -
+                echo "Arch: x86_64 | Flags: $flags | Return: $actual | Correct: $expected"
+                exit 1
+            fi
+        done
+        return
     fi
+    echo "// expect $expected" >> /tmp/bcc-test-batch.c
+    echo "$input" >> /tmp/bcc-test-batch.c
+}
 
-    # Compile and run for arm64
-    if [ -e "./bcc-arm64" ]; then
-        echo "$input" | ./bcc-arm64 $(find stdlib -name "*.h") -
-        actual=$?
-        if [ $actual != "$expected" ]; then
-            echo "[FAIL] Program:"
-            echo "$input"
-            echo "Dump:"
-            echo "$input" | ./bcc-arm64 -d $(find stdlib -name "*.h") -
-            echo "Arch: arm64 | Return: $actual | Correct: $expected"
-            exit 1
-        fi
+# Function that runs the test batch for every flags and arch, each run compiles and runs all tests in parallel children of
+# one compiler process that parsed the stdlib headers once
+assert_batch() {
+    if [ ! -e /tmp/bcc-test-batch.c ]; then return; fi
+    for flags in "" "-O" "-l" "-l -O" "-t"; do
+        for arch in x86_64 arm64; do
+            if [ -e "./bcc-$arch" ] && ! ./bcc-$arch $flags --test-batch /tmp/bcc-test-batch.c $(find stdlib -name "*.h"); then
+                echo "Arch: $arch | Flags: $flags"
+                rm -f /tmp/bcc-test-batch.c
+                exit 1
+            fi
+        done
+    done
+    rm -f /tmp/bcc-test-batch.c
+}
+
+# Function that compiles a test to an object file linked by the system linker and to an executable
+assert_file() {
+    expected=$1
+    input="$2"
+
+    if [ "$(uname -s)" = Linux ] && [ -e "./bcc-x86_64" ]; then
+        for flags in "" "-O"; do
+            for output in object executable; do
+                if [ $output = object ]; then
+                    echo "$input" | ./bcc-x86_64 -c $flags -o /tmp/bcc-test.o $(find stdlib -name "*.h") - && cc /tmp/bcc-test.o -o /tmp/bcc-test
+                else
+                    echo "$input" | ./bcc-x86_64 $flags -o /tmp/bcc-test $(find stdlib -name "*.h") -
+                fi
+                /tmp/bcc-test
+                actual=$?
+                rm -f /tmp/bcc-test.o /tmp/bcc-test
+                if [ $actual != "$expected" ]; then
+                    echo "[FAIL] Program:"
+                    echo "$input"
+                    echo "Arch: x86_64 | Output: $output | Flags: $flags | Return: $actual | Correct: $expected"
+                    exit 1
+                fi
+            done
+        done
+    fi
+}
+
+# Function that runs a test twice with the code cache, the first run stores the program and the second loads it
+assert_cache() {
+    expected=$1
+    input="$2"
+
+    if [ "$(uname -s)" = Linux ] && [ -e "./bcc-x86_64" ]; then
+        rm -rf /tmp/bcc-test-cache
+        for run in store load; do
+            echo "$input" | XDG_CACHE_HOME=/tmp/bcc-test-cache ./bcc-x86_64 --cache $(find stdlib -name "*.h") -
+            actual=$?
+            if [ $actual != "$expected" ]; then
+                echo "[FAIL] Program:"
+                echo "$input"
+                echo "Arch: x86_64 | Cache: $run | Return: $actual | Correct: $expected"
+                exit 1
+            fi
+        done
+        rm -rf /tmp/bcc-test-cache
+    fi
+}
+
+# Function that runs a test through the compile server, the server has already parsed the stdlib headers
+assert_server() {
+    expected=$1
+    input="$2"
+    headers="$3"
+
+    echo "$input" | ./bcc-x86_64 --connect --socket /tmp/bcc-test.sock $headers -
+    actual=$?
+    if [ $actual != "$expected" ]; then
+        echo "[FAIL] Program:"
+        echo "$input"
+        echo "Arch: x86_64 | Server | Headers: ${headers:-none} | Return: $actual | Correct: $expected"
+        kill $server
+        exit 1
     fi
 }
 
 # Tests
 if [ "$1" = "test" ]; then
+    rm -f /tmp/bcc-test-batch.c
     assert 0 "int main() { return 0; }"
     assert 42 "int main() { return 42; }"
     assert 7 "int main() { return 4 + 3; }"
@@ -139,6 +211,7 @@ if [ "$1" = "test" ]; then
     assert 3 "int main() { int x=3; int y=5; return *(&y-1); }"
     assert 5 "int main() { int x=3; int y=5; return *(&x-(-1)); }"
     assert 5 "int main() { int x=3; int *y=&x; *y=5; return x; }"
+    assert 8 "int main() { int x = 1; int *p = &x; int y = *p + 1; x = 5; int z = *p + 1; return y + z; }"
     assert 7 "int main() { int x=3; int y=5; *(&x+1)=7; return y; }"
     assert 7 "int main() { int x=3; int y=5; *(&y-2+1)=7; return x; }"
     assert 5 "unsigned long main() { int x=3; return (&x+2)-&x+3; }"
@@ -236,10 +309,358 @@ if [ "$1" = "test" ]; then
     assert 7 "int add2(int x, int y); int main() { return add2(3,4); } int add2(int x, int y) { return x+y; }"
     assert 1 "int sub2(int x, int y); int main() { return sub2(4,3); } int sub2(int x, int y) { return x-y; }"
 
+    assert 64 "long sum(long n, long s) { if (n == 0) return s; return sum(n - 1, s + 1); } long main() { return sum(1000000, 0) & 127; }"
+    assert 41 "int inc(int x) { return x + 1; } int twice(int x) { return inc(x * 2); } int main() { return twice(20); }"
+    assert 11 "int mix(int a, int b, int c, int d) { return a * 8 + b * 4 + c * 2 + d; } int main() { int x = 1, y = 0; return mix(x, y, x, x); }"
+    assert 24 "long fact(long n, long acc) { if (n <= 1) return acc; return fact(n - 1, acc * n); } long main() { return fact(4, 1); }"
+    assert 3 "int odd(int n); int even(int n) { if (n == 0) return 1; return odd(n - 1) + 0; } int odd(int n) { if (n == 0) return 0; return even(n - 1) + 0; } int main() { return even(10) + 2 * odd(7); }"
+    assert 42 "int get(int *p, int k) { int a[8]; int i; for (i = 0; i < 8; i += 1) a[i] = k; return p[0] + p[1]; } int run() { int x[2]; x[0] = 40; x[1] = 2; return get(x, 7); } int main() { return run(); }"
+    assert 1 "int f(int *p, int n) { int x; x = n; if (n == 0) return *p; return f(&x, n - 1); } int main() { int y = 9; return f(&y, 3); }"
+
+    assert 204 "int square(int x) { return x * x; } long main() { int i, n = 5000; long s = 0; for (i = 0; i < n; i += 1) s += square(i & 15); return s & 255; }"
+    assert 68 "int a[3000]; long main() { int i, n = 3000; long s = 0; for (i = 0; i < n; i += 1) a[i] = i; for (i = 0; i < n; i += 1) s += a[i]; return s & 255; }"
+    assert 228 "long sum(long n, long s) { if (n == 0) return s; return sum(n - 1, s + n); } long main() { return sum(5000, 0) & 255; }"
+
+    assert 92 "int g; int work(int k, int n) { char c = 3; short h = 1000; long l = 5; int a[4]; int i, s = 0; a[0] = 7; a[3] = k; for (i = 0; i < n; i += 1) { s += i & 3; l += 2; h -= 1; } g = a[0] + a[3] + c; return (s + h + l + i) & 255; } int main() { int r; r = work(9, 5000); return r + g; }"
+    assert 154 "long main() { int i, j = 0, n = 4000, t = 0; long s = 0; for (i = 0; i < n; i += 1) { s += i; j += 3; } for (i = 0; i < 10; i += 1) t += j; return (s + t + i + n) & 255; }"
+    assert 136 "int main() { int i = 0; int s = 0; int *p; p = &i; while (i < 5000) { s = s + 1; *p = *p + 1; } return s & 255; }"
+
     assert 3 'unsigned long main() { return strlen("Hoi"); }'
     assert 1 'char main() { return !strcmp("Hoi", "Hoi"); }'
     assert 0 'char main() { return !strcmp("Hoi", "Hoi2"); }'
     # assert 0 'int main() { puts("Hello Bassie C Compiler!"); return 0; }'
 
+    assert 45 "int main() { int x[10]; int i, s = 0; for (i = 0; i < 10; i += 1) x[i] = i; for (i = 0; i < 10; i += 1) s += x[i]; return s; }"
+    assert 18 "int a[4][4]; int main() { int i, j, s = 0; for (i = 0; i < 4; i += 1) for (j = 0; j < 4; j += 1) a[i][j] = i + j; for (i = 0; i < 4; i += 1) for (j = 0; j < 4; j += 1) s += a[i][j] * (i == 3); return s; }"
+    assert 20 "int main() { char x[8]; int i, n = 4, s = 0; for (i = 0; i < 8; i += 2) x[i] = n + 1; for (i = 0; i < 8; i += 2) s += x[i]; return s; }"
+    assert 10 "int main() { int x[5]; int i = 5; while (i > 0) { i -= 1; x[i] = i; } return x[0] + x[1] + x[2] + x[3] + x[4]; }"
+    assert 16 "int a[10]; int main() { int i = 3, x = 4, y, z; a[i] = 5; a[i + 1] += x; a[i + 1] *= 2; y = a[i] * 3; z = a[i] + 1; return a[i + 1] + y + z - 13; }"
+    assert 14 "int main() { int x[4], i = 1, y; x[i] = 3; y = x[i] + x[i]; i = 2; x[i] = 4; return y + x[i] + x[i]; }"
+    assert 9 "int g; int set() { g = 7; return 0; } int main() { int y; g = 1; y = g + 1; set(); return y + g; }"
+    assert 12 "int main() { int x = 2, y = 3, z; z = x * y + 1; if (z > 5) z = x * y + z - 1; else z = 0; return z; }"
+    assert 77 "int main() { int x[13], i, n = 13, s = 0; for (i = 0; i < n; i += 1) x[i] = i; for (i = 0; i < n; i += 2) s += x[i]; for (i = 0; i < 5; i += 1) s += 1; i = 12; while (i >= 1) { s += x[i]; i -= 3; } return s; }"
+    assert 7 "int main() { int i, n = 7, s = 0; for (i = 0; i < n; i += 1) s += 1; return s; }"
+    assert 11 "int main() { int i, s = 0; for (i = 0; i <= 10; i += 1) s += 1; return s; }"
+    assert 100 "int main() { int i, j, s = 0; for (i = 0; i < 10; i += 1) for (j = 0; j < 10; j += 1) s += 1; return s; }"
+    assert 90 "int a[37], b[37], c[37]; int main() { int i, n = 37; for (i = 0; i < n; i += 1) { a[i] = i; b[i] = 2 * i; } for (i = 0; i < n; i += 1) c[i] = a[i] + b[i]; return c[30]; }"
+    assert 196 "char x[77]; int main() { int i, n = 77, s = 0; for (i = 0; i < n; i += 1) x[i] = 255; for (i = 0; i < n; i += 1) s += x[i]; return s / 100; }"
+    assert 51 "long q[21]; long main() { int i, n = 21; for (i = 0; i < n; i += 1) q[i] = i; for (i = 0; i < n; i += 1) q[i] = q[i] ^ 48; return q[3]; }"
+    assert 66 "char x[40]; char main() { int i; for (i = 0; i < 40; i += 1) x[i] = i; for (i = 0; i < 39; i += 1) x[i] = x[i + 1]; for (i = 1; i < 40; i += 1) x[i] = x[i - 1]; return x[39] + x[20] + 64; }"
+    assert_batch
+
+    assert_file 42 "int main() { return 42; }"
+    assert_file 122 "int c; int t[4]; int add(int a, int b); int twice(int x) { return add(x, x); } int add(int a, int b) { return a + b; } int main() { c = 5; t[2] = 7; char *m = \"hi\"; return twice(c) + m[1] + t[2]; }"
+    assert_file 3 'unsigned long main() { puts("Hello object file!"); return strlen("Hoi"); }'
+    assert_file 210 "long f(long n, long s) { if (n == 0) return s; return f(n - 1, s + n); } long main() { return f(20, 0); }"
+
+    assert_cache 122 "int c; int t[4]; int add(int a, int b); int twice(int x) { return add(x, x); } int add(int a, int b) { return a + b; } int main() { c = 5; t[2] = 7; char *m = \"hi\"; return twice(c) + m[1] + t[2]; }"
+    assert_cache 3 'unsigned long main() { puts("Hello code cache!"); return strlen("Hoi"); }'
+
+    # Corrupted cache entries are misses, two bytes are overwritten at every eighth offset of a stored entry
+    if [ "$(uname -s)" = Linux ] && [ -e "./bcc-x86_64" ]; then
+        program="int c; int add(int a, int b) { return a + b; } int main() { c = 5; return add(c, 37); }"
+        rm -rf /tmp/bcc-test-cache
+        echo "$program" | XDG_CACHE_HOME=/tmp/bcc-test-cache ./bcc-x86_64 --cache -
+        entry=$(echo /tmp/bcc-test-cache/bcc/*.bin)
+        cp "$entry" /tmp/bcc-test-entry
+        size=$(wc -c < /tmp/bcc-test-entry)
+        for offset in $(seq 0 8 $((size - 2))); do
+            cp /tmp/bcc-test-entry "$entry"
+            printf '\377\377' | dd of="$entry" bs=1 seek=$offset conv=notrunc 2>/dev/null
+            echo "$program" | XDG_CACHE_HOME=/tmp/bcc-test-cache ./bcc-x86_64 --cache -
+            actual=$?
+            if [ $actual != 42 ]; then
+                echo "[FAIL] Corrupted cache | Offset: $offset | Return: $actual | Correct: 42"
+                exit 1
+            fi
+        done
+        rm -rf /tmp/bcc-test-cache /tmp/bcc-test-entry
+    fi
+
+    # Time report, the program still runs and the JSON report has every phase and the throughput
+    if [ -e "./bcc-x86_64" ]; then
+        report=$(echo "int main() { return 42; }" | ./bcc-x86_64 --time-report=json - 2>&1 >/dev/null)
+        actual=$?
+        for field in '"name": "lexer"' '"name": "parser"' '"name": "codegen"' '"name": "run"' '"name": "total"' '"instructions"' '"tokens_per_second"'; do
+            if [ $actual != 42 ] || ! echo "$report" | grep -q "$field"; then
+                echo "[FAIL] Time report | Return: $actual | Correct: 42 | Report: $report"
+                exit 1
+            fi
+        done
+    fi
+
+    # Disassembler, the dump has the function labels, source lines, named call targets and fixup counts for both backends
+    if [ -e "./bcc-x86_64" ]; then
+        program="int inc(int x) { if (x < 0) return 0; return x + 1; } int main() { int x = inc(41); return x; }"
+        for arch in x86_64 arm64; do
+            dump=$(echo "$program" | ./bcc-x86_64 -a $arch -c -o /tmp/bcc-test.o -d -)
+            if [ $arch = x86_64 ]; then call="call 0x[0-9a-f]* <inc>"; else call="bl 0x[0-9a-f]* <inc>"; fi
+            for line in "^inc:" "^main:" "^; ./stdin:1: " "$call" " ret$" "^Labels: 1 | Fixups: 1 | Relocations: 1$"; do
+                if ! echo "$dump" | grep -q "$line"; then
+                    echo "[FAIL] Disassembler | Arch: $arch | Missing: $line | Dump: $dump"
+                    exit 1
+                fi
+            done
+        done
+        rm -f /tmp/bcc-test.o
+    fi
+
+    # Vector target, object files keep to SSE2 so they also run on machines without AVX2
+    if [ -e "./bcc-x86_64" ]; then
+        program="int main() { int a[64]; int i = 0; while (i < 64) { a[i] = i; i = i + 1; } int s = 0; i = 0; while (i < 64) { s = s + a[i]; i = i + 1; } return s; }"
+        dump=$(echo "$program" | ./bcc-x86_64 -O -c -o /tmp/bcc-test.o -d -)
+        if ! echo "$dump" | grep -q "xmm" || echo "$dump" | grep -q "ymm"; then
+            echo "[FAIL] Vector target | Dump: $dump"
+            exit 1
+        fi
+        rm -f /tmp/bcc-test.o
+    fi
+
+    # Jobs, files are lexed and functions are emitted on more threads and the object file is the same for every number of threads
+    if [ -e "./bcc-x86_64" ]; then
+        echo "int odd(int n); int even(int n) { if (n == 0) return 1; return odd(n - 1); }" > /tmp/bcc-test-even.c
+        echo "int g[4]; int odd(int n) { if (n == 0) return 0; return even(n - 1); } int main() { g[1] = even(10); return g[1] + strlen(\"Hoi\"); }" > /tmp/bcc-test-odd.c
+        for arch in x86_64 arm64; do
+            for jobs in 1 2 4; do
+                ./bcc-x86_64 -a $arch -j $jobs -c -o /tmp/bcc-test-$jobs.o $(find stdlib -name "*.h") /tmp/bcc-test-even.c /tmp/bcc-test-odd.c
+            done
+            if ! cmp -s /tmp/bcc-test-1.o /tmp/bcc-test-2.o || ! cmp -s /tmp/bcc-test-1.o /tmp/bcc-test-4.o; then
+                echo "[FAIL] Jobs | Arch: $arch | Object files differ"
+                exit 1
+            fi
+        done
+        ./bcc-x86_64 -j 4 $(find stdlib -name "*.h") /tmp/bcc-test-even.c /tmp/bcc-test-odd.c
+        actual=$?
+        rm -f /tmp/bcc-test-even.c /tmp/bcc-test-odd.c /tmp/bcc-test-1.o /tmp/bcc-test-2.o /tmp/bcc-test-4.o
+        if [ $actual != 4 ]; then
+            echo "[FAIL] Jobs | Return: $actual | Correct: 4"
+            exit 1
+        fi
+    fi
+
+    # Profiler, perf finds every emitted function in the perf map and the jitdump file also has its code and lines
+    if [ "$(uname -s)" = Linux ] && [ -e "./bcc-x86_64" ]; then
+        program="int fib(int n) { if (n < 2) return n; return fib(n - 1) + fib(n - 2); } int main() { return fib(10); }"
+        for flags in "--perf-map" "--perf-map -t" "--jitdump" "--jitdump -l"; do
+            rm -rf /tmp/bcc-test-jitdump
+            mkdir /tmp/bcc-test-jitdump
+            echo "$program" | JITDUMPDIR=/tmp/bcc-test-jitdump ./bcc-x86_64 $flags - &
+            pid=$!
+            wait $pid
+            actual=$?
+            if [ "$flags" = "--perf-map" ] || [ "$flags" = "--perf-map -t" ]; then
+                grep -q " fib" /tmp/perf-$pid.map && grep -q " main" /tmp/perf-$pid.map
+            else
+                grep -q "fib" /tmp/bcc-test-jitdump/jit-$pid.dump && grep -q "main" /tmp/bcc-test-jitdump/jit-$pid.dump
+            fi
+            found=$?
+            rm -rf /tmp/perf-$pid.map /tmp/bcc-test-jitdump
+            if [ $actual != 55 ] || [ $found != 0 ]; then
+                echo "[FAIL] Profiler | Flags: $flags | Return: $actual | Correct: 55 | Functions found: $([ $found = 0 ] && echo yes || echo no)"
+                exit 1
+            fi
+        done
+    fi
+
+    if [ "$(uname -s)" = Linux ] && [ -e "./bcc-x86_64" ]; then
+        ./bcc-x86_64 --server --socket /tmp/bcc-test.sock $(find stdlib -name "*.h") &
+        server=$!
+        sleep 0.5
+        assert_server 42 "int f(int x) { return x * 2; } int main() { return f(21); }" ""
+        assert_server 42 "int f(int x) { return x * 2; } int main() { return f(21); }" "$(find stdlib -name "*.h")"
+        assert_server 3 "unsigned long main() { puts(\"Hello compile server!\"); return strlen(\"Hoi\"); }" "$(find stdlib -name "*.h")"
+        assert_server 139 "int main() { int *p = 0; return *p; }" ""
+        kill $server
+    fi
+
+    # Library, many modules are compiled and freed in one process without the heap growing, declared functions resolve
+    # to the registered host functions before clib and to functions the host process exports, modules with debug info
+    # register an ELF object for every function with debuggers until they are freed, the heap is measured without the
+    # malloc thread cache because it counts the freed blocks it keeps as used
+    if [ "$(uname -s)" = Linux ] && [ -e "./libbcc.so" ]; then
+        cat > /tmp/bcc-test-host.c <<'EOF'
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include "bcc.h"
+
+extern struct { unsigned int version, action; struct { void *next, *previous; char *object; unsigned long size; } *relevant, *first; } __jit_debug_descriptor;
+
+static long host_scale(long x) { return x * 3; }
+
+static unsigned long host_strlen(char *str) { return str[0]; }
+
+long host_twice(long x) { return x * 2; }
+
+int main(void) {
+    BccContext *context = bcc_context_new(&(BccOptions){.optimize = true, .unroll_factor = 4});
+    BccSymbol symbols[] = {{"scale", (void *)host_scale}, {"strlen", (void *)host_strlen}};
+    bcc_add_symbols(context, symbols, 2);
+    BccSource sources[] = {
+        {"./string.h", "extern unsigned long strlen(char *str);"},
+        {"./module.c", "long scale(long x); long host_twice(long x); long counter; long f(long x) { counter += 1; return scale(x) + strlen(\"0\") + host_twice(counter); }"},
+    };
+    size_t heap_size = 0;
+    for (int i = 0; i < 200; i++) {
+        BccModule *module = bcc_compile(context, sources, 2);
+        if (module == NULL) return 1;
+        long (*f)(long) = (long (*)(long))bcc_lookup(module, "f");
+        if (f == NULL || f(13) != 89 || f(13) != 91 || bcc_lookup(module, "scale") != NULL) return 2;
+        bcc_module_free(module);
+        if (i == 10) heap_size = mallinfo2().uordblks;
+    }
+    if (mallinfo2().uordblks != heap_size) return 3;
+
+    BccSource broken = {"./broken.c", "int main() { return x; }"};
+    if (bcc_compile(context, &broken, 1) != NULL || strstr(bcc_error(context), "Undefined variable: 'x'") == NULL) return 4;
+    BccSource unresolved = {"./unresolved.c", "int missing(); int main() { return missing(); }"};
+    if (bcc_compile(context, &unresolved, 1) != NULL || strstr(bcc_error(context), "Unresolved function: 'missing'") == NULL) return 5;
+    BccSource truncated = {"./truncated.c", "x"};
+    if (bcc_compile(context, &truncated, 1) != NULL || strstr(bcc_error(context), "Unexpected token: 'EOF'") == NULL) return 8;
+    BccSource initialized = {"./initialized.c", "int g; char *s = \"x\"; int main() { return 0; }"};
+    if (bcc_compile(context, &initialized, 1) != NULL || strstr(bcc_error(context), "Unexpected token") == NULL) return 9;
+    bcc_context_free(context);
+
+    BccContext *debug_context = bcc_context_new(&(BccOptions){.unroll_factor = 4, .debug_info = true});
+    BccSource debug_source = {"./debug.c", "int f(int x) { return x * 2; } int main() { return f(21); }"};
+    BccModule *debug_module = bcc_compile(debug_context, &debug_source, 1);
+    if (debug_module == NULL || __jit_debug_descriptor.first == NULL || memcmp(__jit_debug_descriptor.first->object, "\x7f" "ELF", 4) != 0) return 6;
+    bcc_module_free(debug_module);
+    if (__jit_debug_descriptor.first != NULL) return 7;
+    bcc_context_free(debug_context);
+    return 0;
+}
+EOF
+        cc -rdynamic -Icompiler/include /tmp/bcc-test-host.c -L. -lbcc -Wl,-rpath,"$PWD" -o /tmp/bcc-test-host && GLIBC_TUNABLES=glibc.malloc.tcache_count=0 /tmp/bcc-test-host
+        actual=$?
+        rm -f /tmp/bcc-test-host.c /tmp/bcc-test-host
+        if [ $actual != 0 ]; then
+            echo "[FAIL] Library host | Return: $actual | Correct: 0"
+            exit 1
+        fi
+    fi
+
     echo "[OK] All tests pass"
 fi
+
+# Benchmarks
+# Function that writes a program with $1 functions and globals, every function has a long string literal, a deeply
+# nested expression and calls an earlier function so the call depth stays logarithmic
+generate() {
+    awk -v size="$1" 'BEGIN {
+        for (i = 0; i < 200; i++) text = text sprintf("%c", 97 + i % 26)
+        split("+ * - ^ | &", operators, " ")
+        expression = "x"
+        for (depth = 1; depth <= 32; depth++) expression = sprintf("(%s %s %d)", expression, operators[depth % 6 + 1], depth)
+        for (i = 0; i < size; i++) {
+            printf "int g%d;\n", i
+            printf "int f%d(int x) {\n", i
+            printf "    char *s = \"%s %d\";\n", text, i
+            printf "    g%d = x + s[%d];\n", i, i % 200
+            printf "    return %s + g%d%s;\n", expression, i, (i > 0 ? sprintf(" + f%d(x & 7)", int((i - 1) / 2)) : "")
+            printf "}\n"
+        }
+        printf "int main() { return f%d(1) & 255; }\n", size - 1
+    }'
+}
+
+# Function that prints the median of the numbers on stdin
+median() {
+    sort -n | awk '{ values[NR] = $1 } END { if (NR == 0) print "-"; else print values[int((NR + 1) / 2)] }'
+}
+
+# Function that prints the change from a baseline value in percent
+change() {
+    if [ "$1" = - ] || [ "$2" = - ] || [ -z "$2" ]; then
+        echo "-"
+    else
+        awk -v value="$1" -v baseline="$2" 'BEGIN { if (baseline == 0) print "-"; else printf "%+.1f%%\n", (value - baseline) / baseline * 100 }'
+    fi
+}
+
+# Benchmarks, every kernel runs BENCH_RUNS times and the medians are compared with bench/baseline.txt and gcc
+if [ "$1" = "bench" ]; then
+    runs=${BENCH_RUNS:-5}
+    rm -f /tmp/bcc-bench-baseline.txt
+    for kernel in bench/*.c; do
+        name=$(basename "$kernel" .c)
+
+        # gcc reference, timed over the whole process, the tail call kernel overflows the stack without optimizations
+        for level in O0 O2; do
+            gcc -w -$level -x c "$kernel" -o /tmp/bcc-bench || exit
+            i=0
+            while [ $i -lt "$runs" ]; do
+                start=$(date +%s%N)
+                /tmp/bcc-bench
+                expected=$?
+                end=$(date +%s%N)
+                echo "$(((end - start) / 1000))" | awk '{ printf "%.3f\n", $1 / 1000 }'
+                i=$((i + 1))
+            done > /tmp/bcc-bench-times
+            eval "gcc_$level=\"\$(median < /tmp/bcc-bench-times) ms\""
+            eval "expected_$level=$expected"
+        done
+        if [ "$expected_O0" != "$expected_O2" ]; then gcc_O0="failed"; fi
+        rm -f /tmp/bcc-bench
+
+        # The run phase of the time report is the JIT code only, every run compiles the kernel again
+        for flags in "" "-O" "-t"; do
+            rm -f /tmp/bcc-bench-times /tmp/bcc-bench-instructions
+            i=0
+            while [ $i -lt "$runs" ]; do
+                report=$(./bcc-x86_64 --time-report=json $flags "$kernel" 2>&1 >/dev/null)
+                result=$?
+                echo "$report" | sed -n 's/.*"name": "run", "wall_ms": \([0-9.]*\).*/\1/p' >> /tmp/bcc-bench-times
+                echo "$report" | sed -n 's/.*"name": "run", [^}]*"instructions": \([0-9][0-9]*\).*/\1/p' >> /tmp/bcc-bench-instructions
+                i=$((i + 1))
+            done
+            time=$(median < /tmp/bcc-bench-times)
+            instructions=$(median < /tmp/bcc-bench-instructions)
+            echo "$name ${flags:-none} $time $instructions" >> /tmp/bcc-bench-baseline.txt
+
+            baseline=$(grep "^$name ${flags:-none} " bench/baseline.txt 2>/dev/null)
+            baseline_time=$(echo "$baseline" | cut -d " " -f 3)
+            baseline_instructions=$(echo "$baseline" | cut -d " " -f 4)
+            line="$name | Flags: ${flags:-none} | Time: $time ms ($(change "$time" "$baseline_time")) | Instructions: $instructions"
+            line="$line ($(change "$instructions" "$baseline_instructions")) | gcc -O0: $gcc_O0 | gcc -O2: $gcc_O2 | Return: $result"
+            if [ $result != $expected ]; then line="$line | [FAIL] gcc returns $expected"; fi
+            echo "$line"
+        done
+    done
+    rm -f /tmp/bcc-bench-times /tmp/bcc-bench-instructions
+    if [ "$2" = "baseline" ]; then mv /tmp/bcc-bench-baseline.txt bench/baseline.txt; fi
+    rm -f /tmp/bcc-bench-baseline.txt
+fi
+
+# Throughput, compiles generated programs ten times larger each step up to THROUGHPUT_MAX functions and flags phases
+# that grow more than twice as fast as the input
+if [ "$1" = "throughput" ]; then
+    size=1000
+    previous_size=""
+    while [ $size -le "${THROUGHPUT_MAX:-10000}" ]; do
+        generate $size > /tmp/bcc-throughput.c
+        report=$(./bcc-x86_64 --time-report=json $THROUGHPUT_FLAGS /tmp/bcc-throughput.c 2>&1 >/dev/null)
+        if ! echo "$report" | grep -q '"name": "total"'; then
+            echo "[FAIL] Throughput | Functions: $size | Output: $report"
+            exit 1
+        fi
+        line="Functions: $size | Source: $(($(wc -c < /tmp/bcc-throughput.c) / 1024)) KB"
+        warnings=""
+        for phase in read lexer parser optimizer codegen run total; do
+            time=$(echo "$report" | sed -n "s/.*\"name\": \"$phase\", \"wall_ms\": \([0-9.]*\).*/\1/p")
+            rss=$(echo "$report" | sed -n "s/.*\"name\": \"$phase\", [^}]*\"peak_rss_bytes\": \([0-9]*\).*/\1/p")
+            line="$line | $phase: $time ms, $((rss / 1048576)) MB"
+            eval "previous_time=\$time_$phase"
+            if [ -n "$previous_size" ] && awk -v time="$time" -v previous="$previous_time" 'BEGIN { exit !(time > 10 && time > previous * 20) }'; then
+                warnings="$warnings[SUPERLINEAR] $phase: $previous_time ms for $previous_size functions, $time ms for $size functions
+"
+            fi
+            eval "time_$phase=$time"
+        done
+        echo "$line"
+        printf "%s" "$warnings"
+        previous_size=$size
+        size=$((size * 10))
+    done
+    rm -f /tmp/bcc-throughput.c
+fi
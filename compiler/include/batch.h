@@ -0,0 +1,19 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Test batch, a file of cases that each start with a "// expect <status>" line followed by the program source,
+// every case runs in a child forked from the process that already parsed the headers and the children run in parallel
+#define BATCH_EXPECT "// expect "
+
+// Seconds a case may run before its child is killed and the case fails
+#define BATCH_TIMEOUT 30
+
+typedef int32_t (*BatchHandler)(void *context, char *source, bool is_debug);
+
+// Prints every failing case with a dump of its program and returns EXIT_FAILURE when there is one
+int32_t batch_run(char *path, BatchHandler handler, void *context);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef BCC_H
+#define BCC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Bassie C Compiler library, compiles sources to native code in the calling process
+
+#if defined(_WIN32)
+#define BCC_API __declspec(dllexport)
+#else
+#define BCC_API __attribute__((visibility("default")))
+#endif
+
+// Debug info registers the compiled functions with debuggers that set a breakpoint on __jit_debug_register_code
+typedef struct BccOptions {
+    bool optimize;
+    size_t unroll_factor;
+    bool debug_info;
+} BccOptions;
+
+typedef struct BccSymbol {
+    char *name;
+    void *address;
+} BccSymbol;
+
+typedef struct BccSource {
+    char *path;
+    char *text;
+} BccSource;
+
+typedef struct BccContext BccContext;
+
+typedef struct BccModule BccModule;
+
+// Options can be NULL for the defaults
+BCC_API BccContext *bcc_context_new(BccOptions *options);
+
+// Declared functions resolve to the registered host functions, then to the added libraries in order and then to
+// the process itself and clib, resolved addresses are cached by the context
+BCC_API void bcc_add_symbol(BccContext *context, char *name, void *address);
+
+BCC_API void bcc_add_symbols(BccContext *context, BccSymbol *symbols, size_t symbols_size);
+
+BCC_API bool bcc_add_library(BccContext *context, char *path);
+
+// Returns NULL when the sources have errors, the messages are kept until the next compile
+BCC_API BccModule *bcc_compile(BccContext *context, BccSource *sources, size_t sources_size);
+
+BCC_API char *bcc_error(BccContext *context);
+
+// Returns the address of a function or global of the module or NULL
+BCC_API void *bcc_lookup(BccModule *module, char *name);
+
+BCC_API void bcc_module_free(BccModule *module);
+
+BCC_API void bcc_context_free(BccContext *context);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "parser.h"
+
+// Code cache, eager programs are stored as relocatable code in $XDG_CACHE_HOME/bcc keyed by a hash of their
+// sources, the arch, the CPU features, the compiler flags and the compiler version, an entry also keeps a hash of its
+// contents so a corrupted entry is a miss
+#define CACHE_MAGIC "BCCCACHE"
+#define CACHE_COMPILER_VERSION __DATE__ " " __TIME__
+#define CACHE_HASH_OFFSET 0xcbf29ce484222325
+
+typedef struct CacheHeader {
+    char magic[8];
+    uint32_t arch;
+    uint32_t functions_size;
+    uint32_t globals_size;
+    uint32_t relocations_size;
+    uint64_t text_size;
+    uint64_t data_size;
+    uint64_t main_offset;
+    uint64_t hash;
+} CacheHeader;
+
+typedef struct CacheFunction {
+    uint64_t offset;
+    uint32_t is_extern;
+    uint32_t name_size;
+} CacheFunction;
+
+typedef struct CacheRelocation {
+    uint32_t kind;
+    uint32_t function;
+    uint32_t global;
+    uint32_t reserved;
+    uint64_t offset;
+    int64_t addend;
+} CacheRelocation;
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size);
+
+char *cache_path(uint64_t hash);
+
+bool cache_load(Program *program, char *path);
+
+bool cache_store(Program *program, char *path);
+
+#endif
@@ -4,31 +4,84 @@
 #include "parser.h"
 #include "utils/utils.h"
 
-// Dlopen win32 functions
-#ifdef _WIN32
-
-extern void *LoadLibraryA(char *lpLibFileName);
-extern void *GetProcAddress(void *hModule, char *lpProcName);
-
-#else
-
-#include <dlfcn.h>
-
-#endif
-
 // Codegen
+#define CODEGEN_TIER_UP_THRESHOLD 1000
+
+typedef enum CodegenMode {
+    CODEGEN_EAGER,
+    CODEGEN_LAZY,
+    CODEGEN_TIERED,
+} CodegenMode;
+
+// On-stack replacement, a hot loop in baseline code continues in an optimized copy of the rest of the function
+typedef struct CodegenOsr {
+    Function *function;
+    Node *loop;
+    List continuation;
+    uint8_t *address;
+} CodegenOsr;
+
 typedef struct Codegen {
     Program *program;
+    CodegenMode mode;
+    bool is_optimizing;
+    size_t unroll_factor;
+    uint8_t *code_start;
     uint8_t *code_byte_ptr;
     uint32_t *code_word_ptr;
     Function *current_function;
+    bool is_osr_entry;
+    // An argument can point into the frame of the current function, so a call in return position keeps the frame
+    bool has_escaped_locals;
+    List osr_loops;
+    uint8_t *body_byte_ptr;
+    uint32_t *body_word_ptr;
+    FunctionFrame body_frame;
+    bool has_avx2;
+    bool has_errors;
+    List relocations;
+    size_t labels_size;
+    size_t fixups_size;
 } Codegen;
 
-void codegen(Program *program);
+// The JIT runs on the machine it compiles for, so CPUID picks the vector extension, it is also part of the cache key
+bool codegen_has_avx2(void);
+
+// Returns false when a node can't be compiled, eager functions are emitted on up to jobs threads
+bool codegen(Program *program, CodegenMode mode, bool is_optimizing, size_t unroll_factor, size_t jobs);
+
+typedef void *(*CodegenRuntimeFunc)(Codegen *codegen, void *argument);
+
+void *codegen_compile_function(Codegen *codegen, void *argument);
+
+void *codegen_tier_up_function(Codegen *codegen, void *argument);
+
+void *codegen_osr_function(Codegen *codegen, void *argument);
+
+// Maps the code at address to the line of a statement token when the program keeps debug info
+void codegen_add_line(Codegen *codegen, Token *token, uint8_t *address);
+
+// Records the frame layout from address on when the program keeps debug info
+void codegen_add_frame(Codegen *codegen, uint8_t *address, FunctionFrame frame);
+
+bool codegen_is_baseline(Codegen *codegen);
+
+// An argument can point into the frame when the address of a local is taken or a local array is used as a pointer
+bool codegen_has_escaped_locals(Function *function);
+
+// Eager code leaves every call and global reference to the relocations because its buffer is placed later, address is
+// in the buffer that starts at code_start
+void codegen_add_relocation(Codegen *codegen, void *address, RelocationKind kind, Function *function, Global *global, int64_t addend);
+
+CodegenOsr *codegen_find_osr(Codegen *codegen, Node *loop);
 
 // x86_64
 void codegen_func_x86_64(Codegen *codegen, Function *function);
 
+void codegen_stub_x86_64(Codegen *codegen, Function *function);
+
+void codegen_patch_jump_x86_64(uint8_t *address, uint8_t *target);
+
 void codegen_stat_x86_64(Codegen *codegen, Node *node);
 
 void codegen_addr_x86_64(Codegen *codegen, Node *node);
@@ -38,6 +91,10 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node);
 // arm64
 void codegen_func_arm64(Codegen *codegen, Function *function);
 
+void codegen_stub_arm64(Codegen *codegen, Function *function);
+
+void codegen_patch_jump_arm64(uint8_t *address, uint8_t *target);
+
 void codegen_stat_arm64(Codegen *codegen, Node *node);
 
 void codegen_addr_arm64(Codegen *codegen, Node *node);
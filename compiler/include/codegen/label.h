@@ -0,0 +1,34 @@
+#ifndef LABEL_H
+#define LABEL_H
+
+#include "codegen/codegen.h"
+
+// Label, a branch to a placed label gets its displacement right away and a branch to a label that isn't placed yet
+// is a fixup that is patched when the label is placed, both backends branch through labels instead of patching by hand
+#define LABEL_FIXUPS_CAPACITY 4
+
+typedef enum LabelFixupKind {
+    LABEL_FIXUP_X86_64_REL8,   // jcc rel8, byte displacement from the end of the field
+    LABEL_FIXUP_X86_64_REL32,  // jmp and jcc rel32, displacement from the end of the field
+    LABEL_FIXUP_ARM64_IMM26,   // b, word displacement in bits 0 to 25
+    LABEL_FIXUP_ARM64_IMM19,   // b.cond, cbz and cbnz, word displacement in bits 5 to 23
+} LabelFixupKind;
+
+typedef struct LabelFixup {
+    LabelFixupKind kind;
+    uint8_t *address;
+} LabelFixup;
+
+typedef struct Label {
+    uint8_t *address;
+    LabelFixup fixups[LABEL_FIXUPS_CAPACITY];
+    size_t fixups_size;
+} Label;
+
+// Emits the branch field at the code pointer, an arm64 field is the instruction with its displacement left zero
+void label_branch(Codegen *codegen, Label *label, LabelFixupKind kind, uint32_t instruction);
+
+// Places the label at the code pointer and patches the branches that wait for it
+void label_place(Codegen *codegen, Label *label);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "parser.h"
+#include "utils/buffer.h"
+
+// GDB JIT interface, every emitted function is registered as an in-memory ELF object with its symbol, a DWARF line
+// table and the call frame information of its prologue and epilogues, so debuggers can show and unwind JIT frames
+typedef enum DebuggerAction {
+    DEBUGGER_NO_ACTION,
+    DEBUGGER_REGISTER,
+    DEBUGGER_UNREGISTER,
+} DebuggerAction;
+
+// The debugger only reads the first four fields
+typedef struct DebuggerEntry DebuggerEntry;
+struct DebuggerEntry {
+    DebuggerEntry *next;
+    DebuggerEntry *previous;
+    uint8_t *object;
+    uint64_t object_size;
+    uint8_t *address;
+};
+
+typedef struct DebuggerDescriptor {
+    uint32_t version;
+    uint32_t action;
+    DebuggerEntry *relevant_entry;
+    DebuggerEntry *first_entry;
+} DebuggerDescriptor;
+
+// DWARF
+#define DWARF_CFA_ADVANCE_LOC4 0x04
+#define DWARF_CFA_DEF_CFA 0x0c
+#define DWARF_CFA_OFFSET 0x80
+#define DWARF_CFA_RESTORE 0xc0
+#define DWARF_EH_PE_UDATA4 0x03
+#define DWARF_EH_PE_PCREL_SDATA4 0x1b
+#define DWARF_EH_PE_DATAREL_SDATA4 0x3b
+
+#define DWARF_TAG_COMPILE_UNIT 0x11
+#define DWARF_TAG_SUBPROGRAM 0x2e
+#define DWARF_AT_NAME 0x03
+#define DWARF_AT_STMT_LIST 0x10
+#define DWARF_AT_LOW_PC 0x11
+#define DWARF_AT_HIGH_PC 0x12
+#define DWARF_AT_LANGUAGE 0x13
+#define DWARF_FORM_ADDR 0x01
+#define DWARF_FORM_DATA4 0x06
+#define DWARF_FORM_STRING 0x08
+#define DWARF_FORM_DATA1 0x0b
+#define DWARF_LANG_C99 0x0c
+
+#define DWARF_LNS_COPY 0x01
+#define DWARF_LNS_ADVANCE_PC 0x02
+#define DWARF_LNS_ADVANCE_LINE 0x03
+#define DWARF_LNS_SET_FILE 0x04
+#define DWARF_LNS_SET_COLUMN 0x05
+#define DWARF_LNE_END_SEQUENCE 0x01
+#define DWARF_LNE_SET_ADDRESS 0x02
+
+// Writes the .eh_frame of a function placed after its code aligned to 8 bytes, perf also wants an .eh_frame_hdr
+// after it, returns the size of that header
+size_t debugger_write_eh_frame(Buffer *buffer, Arch arch, Function *function, bool has_header);
+
+void debugger_add_function(Arch arch, Function *function, char *name);
+
+// Unregisters the functions with code in a section that is freed
+void debugger_remove_functions(void *start, void *end);
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef DISASSEMBLER_H
+#define DISASSEMBLER_H
+
+#include <stdio.h>
+
+#include "parser.h"
+
+// Disassembler, decodes the instructions the backends emit, bytes it doesn't know are shown as data
+typedef struct DisassemblerInstruction {
+    size_t size;
+    char text[128];
+    bool has_target;
+    uint64_t target;
+} DisassemblerInstruction;
+
+// Decodes one instruction at address, the dump passes offsets in the text section so branch and memory targets are too
+void disassembler_x86_64(uint8_t *code, size_t size, uint64_t address, DisassemblerInstruction *instruction);
+
+void disassembler_arm64(uint8_t *code, size_t size, uint64_t address, DisassemblerInstruction *instruction);
+
+// Writes the text section with function labels and the source lines of the statements
+void disassembler_dump(FILE *f, Program *program);
+
+#endif
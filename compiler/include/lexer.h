@@ -114,6 +114,7 @@ typedef struct Keyword {
     TokenKind kind;
 } Keyword;
 
+// Returns NULL when the text has errors
 Token *lexer(char *path, char *text, size_t *tokens_size);
 
 #endif
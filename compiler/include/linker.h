@@ -0,0 +1,153 @@
+#ifndef LINKER_H
+#define LINKER_H
+
+#include "parser.h"
+#include "utils/buffer.h"
+
+// ELF64
+#define ELF_CLASS_64 2
+#define ELF_DATA_LSB 1
+#define ELF_VERSION_CURRENT 1
+#define ELF_TYPE_REL 1
+#define ELF_TYPE_EXEC 2
+#define ELF_MACHINE_X86_64 62
+#define ELF_MACHINE_AARCH64 183
+
+#define ELF_SECTION_PROGBITS 1
+#define ELF_SECTION_SYMTAB 2
+#define ELF_SECTION_STRTAB 3
+#define ELF_SECTION_RELA 4
+#define ELF_SECTION_NOBITS 8
+
+#define ELF_FLAG_WRITE 0x1
+#define ELF_FLAG_ALLOC 0x2
+#define ELF_FLAG_EXECINSTR 0x4
+#define ELF_FLAG_INFO_LINK 0x40
+
+#define ELF_SYMBOL_LOCAL 0
+#define ELF_SYMBOL_GLOBAL 1
+#define ELF_SYMBOL_NOTYPE 0
+#define ELF_SYMBOL_OBJECT 1
+#define ELF_SYMBOL_FUNC 2
+#define ELF_SYMBOL_SECTION 3
+
+#define ELF_SEGMENT_LOAD 1
+#define ELF_SEGMENT_DYNAMIC 2
+#define ELF_SEGMENT_INTERP 3
+#define ELF_SEGMENT_PHDR 6
+#define ELF_SEGMENT_GNU_STACK 0x6474e551
+
+#define ELF_SEGMENT_EXECUTE 0x1
+#define ELF_SEGMENT_WRITE 0x2
+#define ELF_SEGMENT_READ 0x4
+
+#define ELF_DYNAMIC_NULL 0
+#define ELF_DYNAMIC_NEEDED 1
+#define ELF_DYNAMIC_HASH 4
+#define ELF_DYNAMIC_STRTAB 5
+#define ELF_DYNAMIC_SYMTAB 6
+#define ELF_DYNAMIC_RELA 7
+#define ELF_DYNAMIC_RELASZ 8
+#define ELF_DYNAMIC_RELAENT 9
+#define ELF_DYNAMIC_STRSZ 10
+#define ELF_DYNAMIC_SYMENT 11
+#define ELF_DYNAMIC_DEBUG 21
+#define ELF_DYNAMIC_BIND_NOW 24
+
+#define ELF_R_X86_64_PC32 2
+#define ELF_R_X86_64_PLT32 4
+#define ELF_R_X86_64_GLOB_DAT 6
+#define ELF_R_AARCH64_ADR_PREL_LO21 274
+#define ELF_R_AARCH64_ADR_PREL_PG_HI21 275
+#define ELF_R_AARCH64_ADD_ABS_LO12_NC 277
+#define ELF_R_AARCH64_JUMP26 282
+#define ELF_R_AARCH64_CALL26 283
+#define ELF_R_AARCH64_GLOB_DAT 1025
+
+typedef struct ElfHeader {
+    uint8_t ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint64_t entry;
+    uint64_t phoff;
+    uint64_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+} ElfHeader;
+
+typedef struct ElfProgramHeader {
+    uint32_t type;
+    uint32_t flags;
+    uint64_t offset;
+    uint64_t vaddr;
+    uint64_t paddr;
+    uint64_t filesz;
+    uint64_t memsz;
+    uint64_t align;
+} ElfProgramHeader;
+
+typedef struct ElfSectionHeader {
+    uint32_t name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t addr;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t link;
+    uint32_t info;
+    uint64_t addralign;
+    uint64_t entsize;
+} ElfSectionHeader;
+
+typedef struct ElfSymbol {
+    uint32_t name;
+    uint8_t info;
+    uint8_t other;
+    uint16_t shndx;
+    uint64_t value;
+    uint64_t size;
+} ElfSymbol;
+
+typedef struct ElfRela {
+    uint64_t offset;
+    uint64_t info;
+    int64_t addend;
+} ElfRela;
+
+typedef struct ElfDynamic {
+    int64_t tag;
+    uint64_t value;
+} ElfDynamic;
+
+// Linker
+#define LINKER_BASE_ADDRESS 0x400000
+
+// Writes a relocatable object of sections with their headers, the names go in the last section which is the shstrtab
+// and a NOBITS section keeps the size of its header
+void linker_write_elf_object(Buffer *file, Arch arch, Buffer *sections, ElfSectionHeader *headers, char **names, size_t sections_size);
+
+bool linker_write_object(Program *program, char *path);
+
+bool linker_write_executable(Program *program, char *path);
+
+void *linker_find_host_symbol(char *name);
+
+void linker_relocate(uint8_t *code, RelocationKind kind, uint64_t place, uint64_t target);
+
+#define LINKER_VENEER_SIZE 16
+
+void linker_write_veneer(Arch arch, uint8_t *veneer, void *target);
+
+bool linker_is_near(Arch arch, Section *text_section, void *target);
+
+void *linker_text_hint(Program *program, size_t size);
+
+void linker_link(Program *program);
+
+#endif
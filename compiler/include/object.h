@@ -12,6 +12,7 @@
 #define MEM_RESERVE 0x00002000
 #define SECTION_READWRITE 0x04
 #define SECTION_EXECUTE_READ 0x20
+#define SECTION_EXECUTE_READWRITE 0x40
 #define MEM_RELEASE 0x00008000
 
 extern void *VirtualAlloc(void *lpAddress, size_t dwSize, uint32_t flAllocationType, uint32_t flProtect);
@@ -33,8 +34,14 @@ typedef struct Section {
 
 Section *section_new(size_t size);
 
+Section *section_new_near(size_t size, void *address);
+
 bool section_make_executable(Section *section);
 
+// Makes the pages that hold address up to address + size writable or executable again, code that is patched while it
+// runs only makes the pages it writes writable
+bool section_protect(Section *section, void *address, size_t size, bool is_writable);
+
 void section_dump(FILE *f, Section *section);
 
 void section_free(Section *section);
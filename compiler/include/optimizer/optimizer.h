@@ -0,0 +1,47 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "parser.h"
+
+// Optimizer
+typedef struct Optimizer {
+    Program *program;
+    Function *function;
+    size_t unroll_factor;
+    bool has_escaped_locals;
+} Optimizer;
+
+void optimizer(Program *program, size_t unroll_factor);
+
+// When the address of a local is taken every local can be written through a pointer
+bool optimizer_has_escaped_locals(List *nodes);
+
+// Code that is only a part of a function gets the escaped locals of the whole function
+void optimizer_function(Program *program, Function *function, size_t unroll_factor, bool has_escaped_locals);
+
+// Helpers
+Local *optimizer_new_local(Optimizer *optimizer, Type *type);
+
+Node *optimizer_local_node(Token *token, Local *local);
+
+Node *optimizer_clone(Node *node);
+
+bool optimizer_equals(Node *lhs, Node *rhs);
+
+bool optimizer_is_trivial(Node *node);
+
+bool optimizer_is_assigned(Node *node, Local *local);
+
+// Loops
+void optimizer_loops(Optimizer *optimizer, Node **node);
+
+// Vectorizer
+void optimizer_vectorize(Optimizer *optimizer, Node **node);
+
+// Unrolling
+void optimizer_unroll(Optimizer *optimizer, List *nodes);
+
+// Common subexpressions
+void optimizer_cse(Optimizer *optimizer, List *nodes);
+
+#endif
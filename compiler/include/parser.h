@@ -58,6 +58,15 @@ typedef struct Program {
     Section *text_section;
     Section *data_section;
     void *main_func;
+    bool is_relocatable;
+    // Object files and executables run on other machines so they only use the base instruction set
+    bool is_portable;
+    List relocations;
+    bool has_debug_info;
+    // Counted by codegen for the debug dump
+    size_t labels_size;
+    size_t fixups_size;
+    size_t relocations_size;
 } Program;
 
 Global *program_find_global(Program *program, char *name);
@@ -71,10 +80,45 @@ struct Global {
     char *name;
     Type *type;
     void *init_data;
+    bool is_readonly;
     void *address;
 };
 
+// Relocation, relocatable code leaves every call and global reference in the text section to the linker
+typedef enum RelocationKind {
+    RELOCATION_X86_64_PC32,
+    RELOCATION_X86_64_PLT32,
+    RELOCATION_ARM64_CALL26,
+    RELOCATION_ARM64_JUMP26,
+    RELOCATION_ARM64_ADR_PREL_PG_HI21,
+    RELOCATION_ARM64_ADD_ABS_LO12_NC,
+    RELOCATION_ARM64_ADR_PREL_LO21,
+} RelocationKind;
+
+typedef struct Relocation {
+    RelocationKind kind;
+    size_t offset;
+    Function *function;
+    Global *global;
+    int64_t addend;
+} Relocation;
+
 // Function
+typedef struct FunctionLine {
+    uint8_t *address;
+    Token *token;
+} FunctionLine;
+
+// Frame layout from address on, the canonical frame address is the stack pointer of the caller, it is found from the
+// stack or the frame pointer and the saved frame pointer and link register are at an offset from it or 0 when not saved
+typedef struct FunctionFrame {
+    uint8_t *address;
+    bool is_frame_based;
+    int32_t cfa_offset;
+    int32_t fp_offset;
+    int32_t lr_offset;
+} FunctionFrame;
+
 typedef struct Local {
     char *name;
     Type *type;
@@ -93,6 +137,12 @@ struct Function {
     List nodes;
 
     uint8_t *address;
+    size_t size;
+    uint8_t *stub_address;
+    int32_t *counter;
+    bool is_optimized;
+    List lines;
+    List frames;
 };
 
 Local *function_find_local(Function *function, char *name);
@@ -113,6 +163,7 @@ typedef enum NodeKind {
     NODE_WHILE,
     NODE_DOWHILE,
     NODE_RETURN,
+    NODE_VECTOR,
 
     NODE_UNARY_BEGIN,
     NODE_NEG,
@@ -151,6 +202,21 @@ typedef enum NodeKind {
 } NodeKind;
 
 typedef struct Node Node;
+
+// Vector loop made by the optimizer, runs destination[i] = lhs[i] operation rhs[i]
+// or accumulator += rhs[i] while a whole vector of elements fits before bound
+typedef struct Vector {
+    NodeKind operation;
+    size_t element_size;
+    Local *induction;
+    Node *bound;
+    Node *destination;
+    Node *lhs;
+    Node *rhs;
+    bool is_rhs_scalar;
+    Local *accumulator;
+} Vector;
+
 struct Node {
     NodeKind kind;
     Token *token;
@@ -178,6 +244,9 @@ struct Node {
             Node *rhs;
         };
 
+        // Vector
+        Vector *vector;
+
         // Global
         Global *global;
 
@@ -191,6 +260,9 @@ struct Node {
 
 Node *node_new(NodeKind kind, Token *token);
 
+// Nodes made by the current thread
+size_t nodes_size(void);
+
 Node *node_new_integer(Token *token, int32_t size, bool is_signed, int64_t integer);
 
 Node *node_new_unary(NodeKind kind, Token *token, Node *unary);
@@ -211,7 +283,8 @@ typedef struct Parser {
     bool has_errors;
 } Parser;
 
-void parser(Program *program, Token *tokens, size_t tokens_size);
+// Returns false when the tokens have errors
+bool parser(Program *program, Token *tokens, size_t tokens_size);
 
 void parser_eat(Parser *parser, TokenKind token_kind);
 
@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "parser.h"
+
+// Profiler, perf finds the names of JIT functions in /tmp/perf-<pid>.map, a jitdump file also carries their code
+// and lines and is merged into a recording with perf inject --jit
+typedef enum ProfilerMode {
+    PROFILER_NONE,
+    PROFILER_PERF_MAP,
+    PROFILER_JITDUMP,
+} ProfilerMode;
+
+#define PROFILER_JITDUMP_MAGIC 0x4A695444
+#define PROFILER_JITDUMP_VERSION 1
+#define PROFILER_JITDUMP_CODE_LOAD 0
+#define PROFILER_JITDUMP_CODE_DEBUG_INFO 2
+#define PROFILER_JITDUMP_CODE_UNWINDING_INFO 4
+
+typedef struct ProfilerJitdumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} ProfilerJitdumpHeader;
+
+typedef struct ProfilerJitdumpRecord {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+} ProfilerJitdumpRecord;
+
+typedef struct ProfilerJitdumpCodeLoad {
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_address;
+    uint64_t code_size;
+    uint64_t code_index;
+} ProfilerJitdumpCodeLoad;
+
+typedef struct ProfilerJitdumpDebugEntry {
+    uint64_t code_address;
+    uint32_t line;
+    uint32_t discriminator;
+} ProfilerJitdumpDebugEntry;
+
+// Followed by an .eh_frame and its .eh_frame_hdr
+typedef struct ProfilerJitdumpUnwindingInfo {
+    uint64_t unwinding_size;
+    uint64_t eh_frame_hdr_size;
+    uint64_t mapped_size;
+} ProfilerJitdumpUnwindingInfo;
+
+bool profiler_start(ProfilerMode mode, Arch arch);
+
+ProfilerMode profiler_mode(void);
+
+void profiler_add_function(Function *function, char *name);
+
+#endif
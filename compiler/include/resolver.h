@@ -0,0 +1,53 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "utils/arena.h"
+#include "utils/list.h"
+#include "utils/map.h"
+
+// Dlopen win32 functions
+#ifdef _WIN32
+
+extern void *LoadLibraryA(char *lpLibFileName);
+extern void *GetProcAddress(void *hModule, char *lpProcName);
+extern bool FreeLibrary(void *hLibModule);
+
+#else
+
+#include <dlfcn.h>
+
+#endif
+
+// Resolver, finds extern functions in the registered host functions, then in the search libraries in order and
+// then in the parent resolver, every found address is cached so a name is only looked up once
+typedef struct ResolverSymbol {
+    char *name;
+    void *address;
+} ResolverSymbol;
+
+typedef struct Resolver Resolver;
+struct Resolver {
+    Arena *arena;
+    Resolver *parent;
+    Map symbols;
+    List libraries;
+    bool lock;
+};
+
+void resolver_init(Resolver *resolver, Arena *arena, Resolver *parent);
+
+void resolver_add_symbols(Resolver *resolver, ResolverSymbol *symbols, size_t symbols_size);
+
+bool resolver_add_library(Resolver *resolver, char *path);
+
+void *resolver_find(Resolver *resolver, char *name);
+
+void resolver_free(Resolver *resolver);
+
+// The host resolver searches the process itself and then clib
+Resolver *resolver_host(void);
+
+#endif
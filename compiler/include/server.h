@@ -0,0 +1,17 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Compile server, a client sends its working directory, arguments and standard streams over a Unix socket
+// and every request runs in a child forked from the warm server
+typedef int32_t (*ServerHandler)(void *context, int32_t argc, char **argv);
+
+char *server_default_path(void);
+
+int32_t server_listen(char *path, ServerHandler handler, void *context);
+
+int32_t server_connect(char *path, int32_t argc, char **argv);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Timer, measures the wall time, CPU time, instructions and allocations of every compiler phase and of the program run
+// for the time report and the peak memory of the process at its end, a NULL timer measures nothing
+typedef enum TimerPhase {
+    TIMER_PHASE_READ,
+    TIMER_PHASE_LEXER,
+    TIMER_PHASE_PARSER,
+    TIMER_PHASE_OPTIMIZER,
+    TIMER_PHASE_CODEGEN,
+    TIMER_PHASE_LINKER,
+    TIMER_PHASE_RUN,
+    TIMER_PHASES_SIZE,
+} TimerPhase;
+
+typedef struct TimerSample {
+    double wall_time;
+    double cpu_time;
+    uint64_t instructions;
+    size_t allocations;
+    size_t allocated_bytes;
+    size_t peak_rss;
+} TimerSample;
+
+// Instructions retired are counted with perf_event_open, the counter is -1 on machines without one
+typedef struct Timer {
+    int32_t counter;
+    TimerSample phases[TIMER_PHASES_SIZE];
+    TimerSample start;
+    size_t tokens_size;
+    size_t nodes_size;
+    size_t code_size;
+} Timer;
+
+Timer *timer_new(void);
+
+void timer_start(Timer *timer);
+
+// Adds the time and allocations since the start to a phase
+void timer_stop(Timer *timer, TimerPhase phase);
+
+void timer_print(Timer *timer, FILE *file, bool is_json);
+
+#endif
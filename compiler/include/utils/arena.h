@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Arena, every compiler allocation is linked into the arena of the current thread so a library module
+// can release everything it allocated at once, without an arena allocations are plain heap blocks
+typedef struct ArenaBlock ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock *blocks;
+} Arena;
+
+// Allocations and reallocations made by the current thread
+typedef struct ArenaStats {
+    size_t allocations;
+    size_t allocated_bytes;
+} ArenaStats;
+
+Arena *arena_swap(Arena *arena);
+
+ArenaStats arena_stats(void);
+
+void *arena_malloc(size_t size);
+
+void *arena_calloc(size_t count, size_t size);
+
+void *arena_realloc(void *ptr, size_t size);
+
+void arena_release(void *ptr);
+
+void arena_free(Arena *arena);
+
+// Moves the blocks and counts of an arena another thread allocated in to the current thread
+void arena_join(Arena *arena, ArenaStats stats);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct Buffer {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+size_t buffer_write(Buffer *buffer, const void *data, size_t size);
+
+void buffer_align(Buffer *buffer, size_t alignment);
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+// Pool, runs the tasks 0 up to tasks on threads, every thread starts with an equal range of the tasks and a thread
+// that is done with its range steals the back half of the largest range that is left, the calling thread is worker 0
+typedef void (*PoolFunc)(void *context, size_t worker, size_t task);
+
+void pool_run(size_t threads, size_t tasks, PoolFunc func, void *context);
+
+#endif
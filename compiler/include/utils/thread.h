@@ -0,0 +1,32 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "utils/arena.h"
+#include "utils/buffer.h"
+
+// Thread, a worker allocates in its own arena and collects its errors, joining it moves both to the current thread
+// so a library module still frees everything and errors come out in the order the workers are joined
+typedef void (*ThreadFunc)(void *argument);
+
+typedef struct Thread {
+    pthread_t thread;
+    ThreadFunc func;
+    void *argument;
+    Arena arena;
+    ArenaStats stats;
+    Buffer errors;
+} Thread;
+
+void thread_start(Thread *thread, ThreadFunc func, void *argument);
+
+// The errors of the thread are dropped when they aren't reported
+void thread_join(Thread *thread, bool is_reporting);
+
+// Number of online processors, the default for the number of compiler threads
+size_t thread_cpus(void);
+
+#endif
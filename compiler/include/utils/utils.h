@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "lexer.h"
+#include "utils/buffer.h"
 
 // Arch
 typedef enum Arch {
@@ -20,16 +21,21 @@ bool is_power_of_two(int64_t x);
 
 uint64_t log_two(uint64_t x);
 
-// Strdup pollyfill
-char *strdup(const char *str);
+// Strings, copies are allocated in the current arena
+char *string_dup(const char *str);
 
-char *strndup(const char *str, size_t size);
+char *string_ndup(const char *str, size_t size);
 
 // I/O helpers
 char *file_read(FILE *file);
 
 char *string_format(char *fmt, ...);
 
+Buffer *print_error_redirect(Buffer *buffer);
+
 void print_error(Token *token, char *fmt, ...);
 
+// Writes errors that were collected in a buffer to where the errors of the current thread go
+void print_error_buffer(Buffer *errors);
+
 #endif
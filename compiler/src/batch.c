@@ -0,0 +1,128 @@
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/arena.h"
+#include "utils/list.h"
+#include "utils/thread.h"
+#include "utils/utils.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef struct BatchCase {
+    char *source;
+    size_t line;
+    int32_t expected;
+    int32_t actual;
+    int32_t pid;
+} BatchCase;
+
+// Splits the text in place, the header line of the next case ends the source of the previous one
+static void batch_parse(char *text, List *cases) {
+    BatchCase *batch_case = NULL;
+    size_t line = 1;
+    for (char *c = text; *c != '\0'; line++) {
+        char *end = strchr(c, '\n');
+        char *next = end != NULL ? end + 1 : c + strlen(c);
+        if (!strncmp(c, BATCH_EXPECT, strlen(BATCH_EXPECT))) {
+            *c = '\0';
+            batch_case = arena_calloc(1, sizeof(BatchCase));
+            batch_case->expected = strtol(c + strlen(BATCH_EXPECT), NULL, 10);
+            batch_case->source = next;
+            batch_case->line = line + 1;
+            list_add(cases, batch_case);
+        }
+        c = next;
+    }
+}
+
+// The status the shell reports for the program, a crash is 128 plus its signal
+static int32_t batch_status(int wait_status) {
+    return WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : 128 + WTERMSIG(wait_status);
+}
+
+// A case that runs longer than the timeout is killed by its alarm and fails
+static pid_t batch_fork(BatchHandler handler, void *context, char *source, bool is_debug) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        alarm(BATCH_TIMEOUT);
+        exit(handler(context, source, is_debug));
+    }
+    return pid;
+}
+
+int32_t batch_run(char *path, BatchHandler handler, void *context) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Can't read test batch: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    char *text = file_read(file);
+    fclose(file);
+    List cases = {0};
+    list_init(&cases);
+    batch_parse(text, &cases);
+
+    // Keep a child running on every core, a case that crashes or hangs the compiler only takes its own child down
+    size_t jobs = thread_cpus();
+    size_t started = 0;
+    size_t running = 0;
+    fflush(NULL);
+    while (started < cases.size || running > 0) {
+        while (running < jobs && started < cases.size) {
+            BatchCase *batch_case = cases.items[started];
+            pid_t pid = batch_fork(handler, context, batch_case->source, false);
+            batch_case->pid = pid;
+            batch_case->actual = pid == -1 ? EXIT_FAILURE : -1;
+            if (pid != -1) running++;
+            started++;
+        }
+        int wait_status;
+        pid_t pid = wait(&wait_status);
+        if (pid == -1) break;
+        for (size_t i = started; i-- > 0;) {
+            BatchCase *batch_case = cases.items[i];
+            if (batch_case->pid == pid && batch_case->actual == -1) {
+                batch_case->actual = batch_status(wait_status);
+                running--;
+                break;
+            }
+        }
+    }
+
+    // Failing cases are compiled once more with the dump, one at a time so their output stays together
+    size_t failures = 0;
+    for (size_t i = 0; i < cases.size; i++) {
+        BatchCase *batch_case = cases.items[i];
+        if (batch_case->actual == batch_case->expected) continue;
+        failures++;
+        printf("[FAIL] Program:\n%s", batch_case->source);
+        printf("Dump:\n");
+        fflush(NULL);
+        pid_t pid = batch_fork(handler, context, batch_case->source, true);
+        if (pid > 0) waitpid(pid, NULL, 0);
+        if (batch_case->actual == 128 + SIGALRM) {
+            printf("Batch: %s:%zu | Timeout: %d s | Correct: %d\n", path, batch_case->line, BATCH_TIMEOUT, batch_case->expected);
+        } else {
+            printf("Batch: %s:%zu | Return: %d | Correct: %d\n", path, batch_case->line, batch_case->actual, batch_case->expected);
+        }
+    }
+    return failures > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#else
+
+int32_t batch_run(char *path, BatchHandler handler, void *context) {
+    (void)path;
+    (void)handler;
+    (void)context;
+    fprintf(stderr, "The test batch needs fork\n");
+    return EXIT_FAILURE;
+}
+
+#endif
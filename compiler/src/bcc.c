@@ -0,0 +1,128 @@
+#include "bcc.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "codegen/codegen.h"
+#include "debugger.h"
+#include "lexer.h"
+#include "linker.h"
+#include "optimizer/optimizer.h"
+#include "parser.h"
+#include "resolver.h"
+#include "utils/arena.h"
+#include "utils/utils.h"
+
+// Everything a context or module allocates lives in its own arena, so freeing it leaves nothing behind
+struct BccContext {
+    Arena arena;
+    BccOptions options;
+    Resolver resolver;
+    char *error;
+};
+
+struct BccModule {
+    Arena arena;
+    Program program;
+};
+
+BccContext *bcc_context_new(BccOptions *options) {
+    BccContext *context = calloc(1, sizeof(BccContext));
+    context->options = options != NULL ? *options : (BccOptions){.optimize = false, .unroll_factor = 4};
+    resolver_init(&context->resolver, &context->arena, resolver_host());
+    return context;
+}
+
+void bcc_add_symbol(BccContext *context, char *name, void *address) {
+    resolver_add_symbols(&context->resolver, &(ResolverSymbol){.name = name, .address = address}, 1);
+}
+
+void bcc_add_symbols(BccContext *context, BccSymbol *symbols, size_t symbols_size) {
+    for (size_t i = 0; i < symbols_size; i++) bcc_add_symbol(context, symbols[i].name, symbols[i].address);
+}
+
+bool bcc_add_library(BccContext *context, char *path) { return resolver_add_library(&context->resolver, path); }
+
+static bool bcc_module_compile(BccContext *context, BccModule *module, BccSource *sources, size_t sources_size, Buffer *errors) {
+    Program *program = &module->program;
+    *program = (Program){.arch = ARCH_X86_64};
+#ifdef __aarch64__
+    program->arch = ARCH_ARM64;
+#endif
+    list_init(&program->globals);
+    list_init(&program->functions);
+    list_init(&program->relocations);
+
+    for (size_t i = 0; i < sources_size; i++) {
+        size_t tokens_size;
+        Token *tokens = lexer(sources[i].path, sources[i].text, &tokens_size);
+        if (tokens == NULL || !parser(program, tokens, tokens_size)) return false;
+    }
+
+    // Declared functions resolve to the host symbols and libraries of the context and then to the process and clib
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (function->is_implemented && !function->is_extern) continue;
+        function->address = resolver_find(&context->resolver, function->name);
+        if (function->address == NULL) {
+            char *message = string_format("ERROR: Unresolved function: '%s'\n", function->name);
+            buffer_write(errors, message, strlen(message));
+            return false;
+        }
+        function->is_extern = true;
+    }
+
+    if (context->options.optimize) optimizer(program, context->options.unroll_factor);
+    program->has_debug_info = context->options.debug_info;
+    program->text_section = section_new_near(16 * 1024 * 1024, linker_text_hint(program, 16 * 1024 * 1024));
+    size_t data_size = align(program->globals_size, 4 * 1024) + 4 * 1024;
+    program->data_section = section_new_near(data_size, (uint8_t *)program->text_section->data - data_size);
+    if (!codegen(program, CODEGEN_EAGER, context->options.optimize, context->options.unroll_factor, 1)) return false;
+    return section_make_executable(program->text_section);
+}
+
+BccModule *bcc_compile(BccContext *context, BccSource *sources, size_t sources_size) {
+    BccModule *module = calloc(1, sizeof(BccModule));
+    Arena *previous_arena = arena_swap(&module->arena);
+    Buffer errors = {0};
+    Buffer *previous_errors = print_error_redirect(&errors);
+    bool is_compiled = bcc_module_compile(context, module, sources, sources_size, &errors);
+    print_error_redirect(previous_errors);
+
+    arena_swap(&context->arena);
+    arena_release(context->error);
+    context->error = errors.size > 0 ? string_ndup((char *)errors.data, errors.size) : NULL;
+    arena_swap(previous_arena);
+    if (!is_compiled) {
+        bcc_module_free(module);
+        return NULL;
+    }
+    return module;
+}
+
+char *bcc_error(BccContext *context) { return context->error != NULL ? context->error : ""; }
+
+void *bcc_lookup(BccModule *module, char *name) {
+    Function *function = program_find_function(&module->program, name);
+    if (function != NULL && function->is_implemented && !function->is_extern) return function->address;
+    Global *global = program_find_global(&module->program, name);
+    if (global != NULL) return global->address;
+    return NULL;
+}
+
+void bcc_module_free(BccModule *module) {
+    Section *text_section = module->program.text_section;
+    if (module->program.has_debug_info && text_section != NULL) {
+        debugger_remove_functions(text_section->data, (uint8_t *)text_section->data + text_section->size);
+    }
+    if (module->program.text_section != NULL) section_free(module->program.text_section);
+    if (module->program.data_section != NULL) section_free(module->program.data_section);
+    arena_free(&module->arena);
+    free(module);
+}
+
+void bcc_context_free(BccContext *context) {
+    resolver_free(&context->resolver);
+    arena_free(&context->arena);
+    free(context);
+}
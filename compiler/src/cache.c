@@ -0,0 +1,243 @@
+#include "cache.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "linker.h"
+#include "utils/arena.h"
+#include "utils/buffer.h"
+#include "utils/map.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// FNV-1a
+uint64_t cache_hash(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+char *cache_path(uint64_t hash) {
+#ifdef _WIN32
+    (void)hash;
+    return NULL;
+#else
+    char *directory;
+    if (getenv("XDG_CACHE_HOME") != NULL && getenv("XDG_CACHE_HOME")[0] != '\0') {
+        mkdir(getenv("XDG_CACHE_HOME"), 0755);
+        directory = string_format("%s/bcc", getenv("XDG_CACHE_HOME"));
+    } else if (getenv("HOME") != NULL) {
+        mkdir(string_format("%s/.cache", getenv("HOME")), 0755);
+        directory = string_format("%s/.cache/bcc", getenv("HOME"));
+    } else {
+        return NULL;
+    }
+    mkdir(directory, 0755);
+    char *path = string_format("%s/%016llx.bin", directory, (unsigned long long)hash);
+    arena_release(directory);
+    return path;
+#endif
+}
+
+#ifndef _WIN32
+// Every index and offset of the tables is checked before the program is rebuilt, an extern function must still resolve
+static bool cache_check_tables(CacheHeader *header, uint8_t *tables, List *functions) {
+    for (size_t i = 0; i < functions->size; i++) {
+        Function *function = functions->items[i];
+        if (function->is_extern ? linker_find_host_symbol(function->name) == NULL : (uintptr_t)function->address >= header->text_size) return false;
+    }
+    for (uint32_t i = 0; i < header->globals_size; i++) {
+        uint64_t offset;
+        memcpy(&offset, tables, sizeof(uint64_t));
+        tables += sizeof(uint64_t);
+        if (offset > header->data_size) return false;
+    }
+    for (uint32_t i = 0; i < header->relocations_size; i++) {
+        CacheRelocation record;
+        memcpy(&record, tables, sizeof(CacheRelocation));
+        tables += sizeof(CacheRelocation);
+        if (record.kind > RELOCATION_ARM64_ADR_PREL_LO21 || header->text_size < sizeof(uint32_t) || record.offset > header->text_size - sizeof(uint32_t)) {
+            return false;
+        }
+        if ((record.function == 0) == (record.global == 0) || record.function > header->functions_size || record.global > header->globals_size) return false;
+    }
+    return true;
+}
+#endif
+
+// A cache hit maps the file and rebuilds just enough of the program for the linker
+bool cache_load(Program *program, char *path) {
+#ifdef _WIN32
+    (void)program;
+    (void)path;
+    return false;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) return false;
+    struct stat info;
+    if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = info.st_size;
+    uint8_t *file = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) return false;
+
+    CacheHeader header;
+    memcpy(&header, file, sizeof(CacheHeader));
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) || header.arch != program->arch || header.text_size > size ||
+        header.data_size > size - header.text_size || header.main_offset >= header.text_size ||
+        header.hash != cache_hash(CACHE_HASH_OFFSET, file + sizeof(CacheHeader), size - sizeof(CacheHeader))) {
+        munmap(file, size);
+        return false;
+    }
+
+    // Read symbols and relocations, the text and data sections come last
+    size_t position = sizeof(CacheHeader);
+    size_t end = size - header.text_size - header.data_size;
+    List functions = {0};
+    list_init(&functions);
+    for (uint32_t i = 0; i < header.functions_size && position + sizeof(CacheFunction) <= end; i++) {
+        CacheFunction record;
+        memcpy(&record, file + position, sizeof(CacheFunction));
+        position += sizeof(CacheFunction);
+        if (position + record.name_size > end) break;
+        Function *function = arena_calloc(1, sizeof(Function));
+        function->name = string_ndup((char *)file + position, record.name_size);
+        function->is_extern = record.is_extern;
+        function->address = (uint8_t *)(uintptr_t)record.offset;
+        list_add(&functions, function);
+        position += align(record.name_size, 8);
+    }
+    size_t tables_size = header.globals_size * sizeof(uint64_t) + header.relocations_size * sizeof(CacheRelocation);
+    if (functions.size != header.functions_size || position + tables_size != end || !cache_check_tables(&header, file + position, &functions)) {
+        list_free(&functions, arena_release);
+        munmap(file, size);
+        return false;
+    }
+
+    program->text_section = section_new(align(header.text_size + header.functions_size * 16, 4 * 1024) + 4 * 1024);
+    program->data_section = section_new(align(header.data_size, 4 * 1024) + 4 * 1024);
+    uint8_t *text = program->text_section->data;
+    uint8_t *data = program->data_section->data;
+    memcpy(text, file + end, header.text_size);
+    memcpy(data, file + end + header.text_size, header.data_size);
+    program->text_section->filled = header.text_size;
+    program->data_section->filled = header.data_size;
+    program->main_func = text + header.main_offset;
+
+    for (size_t i = 0; i < functions.size; i++) {
+        Function *function = functions.items[i];
+        if (!function->is_extern) function->address = text + (uintptr_t)function->address;
+        list_add(&program->functions, function);
+    }
+    List globals = {0};
+    list_init(&globals);
+    for (uint32_t i = 0; i < header.globals_size; i++) {
+        uint64_t offset;
+        memcpy(&offset, file + position, sizeof(uint64_t));
+        position += sizeof(uint64_t);
+        Global *global = arena_calloc(1, sizeof(Global));
+        global->address = data + offset;
+        list_add(&globals, global);
+        list_add(&program->globals, global);
+    }
+    for (uint32_t i = 0; i < header.relocations_size; i++) {
+        CacheRelocation record;
+        memcpy(&record, file + position, sizeof(CacheRelocation));
+        position += sizeof(CacheRelocation);
+        Relocation *relocation = arena_calloc(1, sizeof(Relocation));
+        relocation->kind = record.kind;
+        relocation->offset = record.offset;
+        relocation->function = record.function > 0 ? functions.items[record.function - 1] : NULL;
+        relocation->global = record.global > 0 ? globals.items[record.global - 1] : NULL;
+        relocation->addend = record.addend;
+        list_add(&program->relocations, relocation);
+    }
+    list_free(&functions, NULL);
+    list_free(&globals, NULL);
+    munmap(file, size);
+    return true;
+#endif
+}
+
+// Writes the relocatable code before it is linked, the file is renamed into place so concurrent compilers
+// never see half a file
+bool cache_store(Program *program, char *path) {
+#ifdef _WIN32
+    (void)program;
+    (void)path;
+    return false;
+#else
+    if (program->main_func == NULL) return false;
+    uint8_t *text = program->text_section->data;
+    uint8_t *data = program->data_section->data;
+    CacheHeader header = {
+        .magic = CACHE_MAGIC,
+        .arch = program->arch,
+        .functions_size = program->functions.size,
+        .globals_size = program->globals.size,
+        .relocations_size = program->relocations.size,
+        .text_size = program->text_section->filled,
+        .data_size = program->data_section->filled,
+        .main_offset = (uint8_t *)program->main_func - text,
+    };
+    Buffer file = {0};
+    buffer_write(&file, &header, sizeof(CacheHeader));
+
+    Map functions = {0};
+    map_init(&functions);
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        CacheFunction record = {.offset = function->is_extern ? 0 : function->address - text,
+                                .is_extern = function->is_extern,
+                                .name_size = strlen(function->name)};
+        buffer_write(&file, &record, sizeof(CacheFunction));
+        buffer_write(&file, function->name, record.name_size);
+        buffer_align(&file, 8);
+        map_set(&functions, function->name, (void *)(i + 1));
+    }
+    Map globals = {0};
+    map_init(&globals);
+    for (size_t i = 0; i < program->globals.size; i++) {
+        Global *global = program->globals.items[i];
+        buffer_write(&file, &(uint64_t){(uint8_t *)global->address - data}, sizeof(uint64_t));
+        map_set(&globals, global->name, (void *)(i + 1));
+    }
+    for (size_t i = 0; i < program->relocations.size; i++) {
+        Relocation *relocation = program->relocations.items[i];
+        CacheRelocation record = {
+            .kind = relocation->kind,
+            .function = relocation->function != NULL ? (uintptr_t)map_get(&functions, relocation->function->name) : 0,
+            .global = relocation->global != NULL ? (uintptr_t)map_get(&globals, relocation->global->name) : 0,
+            .offset = relocation->offset,
+            .addend = relocation->addend,
+        };
+        buffer_write(&file, &record, sizeof(CacheRelocation));
+    }
+    map_free(&functions, NULL);
+    map_free(&globals, NULL);
+    buffer_write(&file, text, header.text_size);
+    buffer_write(&file, data, header.data_size);
+    header.hash = cache_hash(CACHE_HASH_OFFSET, (uint8_t *)file.data + sizeof(CacheHeader), file.size - sizeof(CacheHeader));
+    memcpy(file.data, &header, sizeof(CacheHeader));
+
+    char *temporary_path = string_format("%s.%d.tmp", path, (int)getpid());
+    FILE *f = fopen(temporary_path, "wb");
+    bool is_written = f != NULL && fwrite(file.data, 1, file.size, f) == file.size;
+    if (f != NULL) is_written = fclose(f) == 0 && is_written;
+    if (is_written) is_written = rename(temporary_path, path) == 0;
+    if (!is_written) remove(temporary_path);
+    arena_release(temporary_path);
+    arena_release(file.data);
+    return is_written;
+#endif
+}
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "codegen/codegen.h"
+#include "codegen/label.h"
 
 #define x0 0
 #define x1 1
@@ -10,6 +11,9 @@
 #define x4 4
 #define x5 5
 #define x6 6
+#define x7 7
+#define x9 9
+#define x10 10
 #define fp 29
 #define lr 30
 #define sp 31
@@ -21,17 +25,269 @@
     }
 
 static void codegen_arm64_imm64(Codegen *codegen, int32_t reg, int64_t imm) {
-    inst(0xD2800000 | ((imm & 0xffff) << 5) | (reg & 31));                                    // mov reg, imm
-    if (imm > 0xffff) inst(0xF2A00000 | (((imm >> 16) & 0xffff) << 5) | (reg & 31));          // movk reg, imm, lsl 16
-    if (imm > 0xffffffff) inst(0xF2C00000 | (((imm >> 32) & 0xffff) << 5) | (reg & 31));      // movk reg, imm, lsl 32
-    if (imm > 0xffffffffffff) inst(0xF2E00000 | (((imm >> 48) & 0xffff) << 5) | (reg & 31));  // movk reg, imm, lsl 48
+    inst(0xD2800000 | ((imm & 0xffff) << 5) | (reg & 31));                                              // mov reg, imm
+    if (imm < 0 || imm > 0xffff) inst(0xF2A00000 | (((imm >> 16) & 0xffff) << 5) | (reg & 31));          // movk reg, imm, lsl 16
+    if (imm < 0 || imm > 0xffffffff) inst(0xF2C00000 | (((imm >> 32) & 0xffff) << 5) | (reg & 31));      // movk reg, imm, lsl 32
+    if (imm < 0 || imm > 0xffffffffffff) inst(0xF2E00000 | (((imm >> 48) & 0xffff) << 5) | (reg & 31));  // movk reg, imm, lsl 48
+}
+
+// Leaf nodes can be loaded straight into x1 without going over the stack
+static bool codegen_is_leaf_arm64(Node *node) { return node->kind == NODE_INTEGER || (node->kind == NODE_LOCAL && node->type->kind != TYPE_ARRAY); }
+
+static void codegen_leaf_x1_arm64(Codegen *codegen, Node *node) {
+    if (node->kind == NODE_INTEGER) {
+        codegen_arm64_imm64(codegen, x1, node->integer);
+    }
+    if (node->kind == NODE_LOCAL) {
+        Type *type = node->local->type;
+        inst(0xD1000000 | ((node->local->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x1 & 31));  // sub x1, fp, imm
+        if (type->size == 1) inst(0x39400021);                                                     // ldrb w1, [x1]
+        if (type->size == 2) inst(0x79400021);                                                     // ldrh w1, [x1]
+        if (type->size == 4) inst(0xB9400021);                                                     // ldr w1, [x1]
+        if (type->size == 8) inst(0xF9400021);                                                     // ldr x1, [x1]
+    }
+}
+
+// Write call arguments to registers, the other arguments wait on the stack because evaluating an argument can clobber registers
+static void codegen_call_arguments_arm64(Codegen *codegen, Node *node) {
+    for (int32_t i = node->nodes.size - 1; i >= 0; i--) {
+        Node *argument = node->nodes.items[i];
+        codegen_expr_arm64(codegen, argument);
+        if (i > 0) inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
+    }
+
+    for (size_t i = 1; i < node->nodes.size; i++) {
+        inst(0xF84107E0 | (i & 31));  // ldr xi, [sp], 16
+    }
+}
+
+// A call in return position reuses the current frame unless an argument can point into it, self recursion jumps back
+// to the function body
+static bool codegen_is_tail_call_arm64(Codegen *codegen, Node *node) {
+    return node->kind == NODE_CALL && !codegen->has_escaped_locals &&
+           (codegen->mode == CODEGEN_EAGER || node->function == codegen->current_function || node->function->address != NULL);
+}
+
+// Eager code leaves the distance to the relocations, far functions like clib functions are called through x6
+static void codegen_branch_arm64(Codegen *codegen, Function *function, bool is_call) {
+    if (codegen->mode == CODEGEN_EAGER) {
+        codegen_add_relocation(codegen, codegen->code_word_ptr, is_call ? RELOCATION_ARM64_CALL26 : RELOCATION_ARM64_JUMP26, function, NULL, 0);
+        inst(is_call ? 0x94000000 : 0x14000000);  // bl function or b function
+        return;
+    }
+
+    int64_t distance = (uint32_t *)function->address - codegen->code_word_ptr;
+    if (distance < -0x2000000 || distance >= 0x2000000) {
+        codegen_arm64_imm64(codegen, x6, (uint64_t)function->address);
+        inst((is_call ? 0xD63F0000 : 0xD61F0000) | ((x6 & 31) << 5));  // blr x6 or br x6
+    } else {
+        inst((is_call ? 0x94000000 : 0x14000000) | (distance & 0x3ffffff));  // bl function or b function
+    }
+}
+
+// The data section is within adr range of the text section, relocatable code can't know that so it uses a page address
+static void codegen_global_arm64(Codegen *codegen, int32_t reg, Global *global) {
+    if (codegen->program->is_relocatable) {
+        codegen_add_relocation(codegen, codegen->code_word_ptr, RELOCATION_ARM64_ADR_PREL_PG_HI21, NULL, global, 0);
+        inst(0x90000000 | (reg & 31));  // adrp reg, global
+        codegen_add_relocation(codegen, codegen->code_word_ptr, RELOCATION_ARM64_ADD_ABS_LO12_NC, NULL, global, 0);
+        inst(0x91000000 | ((reg & 31) << 5) | (reg & 31));  // add reg, reg, :lo12:global
+    } else if (codegen->mode == CODEGEN_EAGER) {
+        codegen_add_relocation(codegen, codegen->code_word_ptr, RELOCATION_ARM64_ADR_PREL_LO21, NULL, global, 0);
+        inst(0x10000000 | (reg & 31));  // adr reg, global
+    } else {
+        inst(0x10000000 | ((((uint32_t *)global->address - codegen->code_word_ptr) & 0x7ffff) << 5) | (reg & 31));  // adr reg, global
+    }
+}
+
+// Vector loops use NEON q registers, operands are indexed with x6 as the element counter
+static void codegen_vector_load_arm64(Codegen *codegen, int32_t reg, int32_t base, size_t size) {
+    inst(0x8B000000 | ((x6 & 31) << 16) | (log_two(size) << 10) | ((base & 31) << 5) | (x10 & 31));  // add x10, base, x6, lsl imm
+    inst(0x3DC00000 | ((x10 & 31) << 5) | (reg & 31));                                               // ldr q, [x10]
+}
+
+static void codegen_vector_arm64(Codegen *codegen, Vector *vector) {
+    size_t size = vector->element_size;
+    uint32_t arrangement = log_two(size) << 22;
+
+    // Load operands in x3, x4, x5 and the bound in x7
+    codegen_expr_arm64(codegen, vector->bound);
+    inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
+    if (vector->destination != NULL) {
+        codegen_expr_arm64(codegen, vector->destination);
+        inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
+    }
+    if (vector->lhs != NULL) {
+        codegen_expr_arm64(codegen, vector->lhs);
+        inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
+    }
+    codegen_expr_arm64(codegen, vector->rhs);
+    inst(0xAA0003E0 | (x5 & 31));                                    // mov x5, x0
+    if (vector->lhs != NULL) inst(0xF84107E0 | (x4 & 31));          // ldr x4, [sp], 16
+    if (vector->destination != NULL) inst(0xF84107E0 | (x3 & 31));  // ldr x3, [sp], 16
+    inst(0xF84107E0 | (x7 & 31));                                    // ldr x7, [sp], 16
+
+    Type *type = vector->induction->type;
+    inst(0xD1000000 | ((vector->induction->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x9 & 31));  // sub x9, fp, imm
+    if (type->size == 1) inst(0x39400126);                                                           // ldrb w6, [x9]
+    if (type->size == 2) inst(0x79400126);                                                           // ldrh w6, [x9]
+    if (type->size == 4) inst(0xB9400126);                                                           // ldr w6, [x9]
+    if (type->size == 8) inst(0xF9400126);                                                           // ldr x6, [x9]
+
+    inst(0x6F00E401);  // movi v1.2d, 0
+
+    // Skip the vector loop when the destination overlaps a source that is read later
+    Label done_label = {0};
+    if (vector->destination != NULL) {
+        for (int32_t i = 0; i < 2; i++) {
+            if (i == 0 && vector->lhs == NULL) continue;
+            if (i == 1 && vector->is_rhs_scalar) continue;
+            int32_t src = i == 0 ? x4 : x5;
+            inst(0xCB000000 | ((src & 31) << 16) | ((x3 & 31) << 5) | (x9 & 31));  // sub x9, x3, src
+            Label over_label = {0};
+            label_branch(codegen, &over_label, LABEL_FIXUP_ARM64_IMM19, 0xB4000000 | (x9 & 31));  // cbz x9, over
+            inst(0xF100001F | (16 << 10) | ((x9 & 31) << 5));                                     // cmp x9, 16
+            label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM19, 0x54000003);              // b.lo done
+            label_place(codegen, &over_label);                                                    // over:
+        }
+    }
+
+    // Broadcast scalar operand to all lanes of v2
+    if (vector->is_rhs_scalar) inst(0x4E000C00 | (size << 16) | ((x5 & 31) << 5) | 2);  // dup v2, x5
+
+    Label loop_label = {0};
+    label_place(codegen, &loop_label);                                        // loop:
+    inst(0x91000000 | ((16 / size) << 10) | ((x6 & 31) << 5) | (x9 & 31));  // add x9, x6, imm
+    inst(0xEB00001F | ((x7 & 31) << 16) | ((x9 & 31) << 5));                // cmp x9, x7
+    label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM19, 0x5400000C);  // b.gt done
+
+    if (vector->accumulator != NULL) {
+        codegen_vector_load_arm64(codegen, 0, x5, size);
+        if (size == 1) {
+            inst(0x6E202800);  // uaddlp v0.8h, v0.16b
+            inst(0x6E602800);  // uaddlp v0.4s, v0.8h
+            inst(0x6EA06801);  // uadalp v1.2d, v0.4s
+        } else if (size < vector->accumulator->type->size) {
+            inst(0x6EA06801);  // uadalp v1.2d, v0.4s
+        } else {
+            inst(0x4E208400 | arrangement | (1 << 5) | 1);  // add v1, v1, v0
+        }
+    } else {
+        if (vector->lhs != NULL) {
+            codegen_vector_load_arm64(codegen, 0, x4, size);
+            int32_t src = 2;
+            if (!vector->is_rhs_scalar) {
+                codegen_vector_load_arm64(codegen, 3, x5, size);
+                src = 3;
+            }
+            if (vector->operation == NODE_ADD) inst(0x4E208400 | arrangement | (src << 16));  // add v0, v0, src
+            if (vector->operation == NODE_SUB) inst(0x6E208400 | arrangement | (src << 16));  // sub v0, v0, src
+            if (vector->operation == NODE_AND) inst(0x4E201C00 | (src << 16));                // and v0, v0, src
+            if (vector->operation == NODE_OR) inst(0x4EA01C00 | (src << 16));                 // orr v0, v0, src
+            if (vector->operation == NODE_XOR) inst(0x6E201C00 | (src << 16));                // eor v0, v0, src
+        } else if (vector->is_rhs_scalar) {
+            inst(0x4EA21C40);  // mov v0.16b, v2.16b
+        } else {
+            codegen_vector_load_arm64(codegen, 0, x5, size);
+        }
+        inst(0x8B000000 | ((x6 & 31) << 16) | (log_two(size) << 10) | ((x3 & 31) << 5) | (x10 & 31));  // add x10, x3, x6, lsl imm
+        inst(0x3D800000 | ((x10 & 31) << 5));                                                           // str q0, [x10]
+    }
+
+    inst(0xAA0903E6);                                                       // mov x6, x9
+    label_branch(codegen, &loop_label, LABEL_FIXUP_ARM64_IMM26, 0x14000000);  // b loop
+
+    label_place(codegen, &done_label);  // done:
+
+    inst(0xD1000000 | ((vector->induction->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x9 & 31));  // sub x9, fp, imm
+    if (type->size == 1) inst(0x39000126);                                                           // strb w6, [x9]
+    if (type->size == 2) inst(0x79000126);                                                           // strh w6, [x9]
+    if (type->size == 4) inst(0xB9000126);                                                           // str w6, [x9]
+    if (type->size == 8) inst(0xF9000126);                                                           // str x6, [x9]
+
+    // Add the lanes of v1 to the accumulator
+    if (vector->accumulator != NULL) {
+        size_t lane_size = size == 1 || size < vector->accumulator->type->size ? 8 : size;
+        if (lane_size == 8) {
+            inst(0x5EF1B820);  // addp d0, v1.2d
+            inst(0x9E660000);  // fmov x0, d0
+        } else {
+            inst(0x4E31B820 | (log_two(lane_size) << 22));  // addv v0, v1
+            if (lane_size == 2) inst(0x0E023C00);           // umov w0, v0.h[0]
+            if (lane_size == 4) inst(0x0E043C00);           // umov w0, v0.s[0]
+        }
+
+        Node accumulator = {.kind = NODE_LOCAL, .type = vector->accumulator->type, .local = vector->accumulator};
+        codegen_leaf_x1_arm64(codegen, &accumulator);
+        inst(0x8B010000);  // add x0, x0, x1
+
+        Type *type = vector->accumulator->type;
+        inst(0xD1000000 | ((vector->accumulator->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x9 & 31));  // sub x9, fp, imm
+        if (type->size == 1) inst(0x39000120);                                                             // strb w0, [x9]
+        if (type->size == 2) inst(0x79000120);                                                             // strh w0, [x9]
+        if (type->size == 4) inst(0xB9000120);                                                             // str w0, [x9]
+        if (type->size == 8) inst(0xF9000120);                                                             // str x0, [x9]
+    }
+}
+
+// Calls back into the compiler with the argument and link registers saved, the returned code address is left in x16
+static void codegen_runtime_call_arm64(Codegen *codegen, void *argument, CodegenRuntimeFunc runtime_function) {
+    inst(0xA9BD07E0);  // stp x0, x1, [sp, -48]!
+    inst(0xA9010FE2);  // stp x2, x3, [sp, 16]
+    inst(0xF90013FE);  // str lr, [sp, 32]
+    codegen_arm64_imm64(codegen, x0, (int64_t)codegen);
+    codegen_arm64_imm64(codegen, x1, (int64_t)argument);
+    codegen_arm64_imm64(codegen, x6, (int64_t)runtime_function);
+    inst(0xD63F0000 | ((x6 & 31) << 5));  // blr x6
+    inst(0xAA0003F0);                     // mov x16, x0
+    inst(0xA9410FE2);                     // ldp x2, x3, [sp, 16]
+    inst(0xF94013FE);                     // ldr lr, [sp, 32]
+    inst(0xA8C307E0);                     // ldp x0, x1, [sp], 48
+}
+
+// Lazy functions start as a stub that lets the compiler compile the function
+void codegen_stub_arm64(Codegen *codegen, Function *function) {
+    function->address = (uint8_t *)codegen->code_word_ptr;
+    function->stub_address = (uint8_t *)codegen->code_word_ptr;
+    codegen_runtime_call_arm64(codegen, function, codegen_compile_function);
+    inst(0xD61F0200);  // br x16
+}
+
+void codegen_patch_jump_arm64(uint8_t *address, uint8_t *target) {
+    uint32_t code = 0x14000000 | (((uint32_t *)target - (uint32_t *)address) & 0x3ffffff);  // b target
+    __atomic_store_n((uint32_t *)address, code, __ATOMIC_RELEASE);
+}
+
+// Baseline code counts calls and loop iterations, when the counter runs out the function is recompiled optimized,
+// loops that support on-stack replacement keep checking the counter and continue in optimized code
+static void codegen_counter_arm64(Codegen *codegen, bool is_entry, CodegenOsr *osr) {
+    Function *function = codegen->current_function;
+    codegen_arm64_imm64(codegen, x9, (int64_t)function->counter);
+    inst(0xB940012A);  // ldr w10, [x9]
+    inst(0x7100054A);  // subs w10, w10, 1
+    inst(0xB900012A);  // str w10, [x9]
+    Label done_label = {0};
+    label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM19, osr != NULL ? 0x5400000C : 0x54000001);  // b.gt done or b.ne done
+
+    if (osr != NULL) {
+        codegen_runtime_call_arm64(codegen, osr, codegen_osr_function);
+        inst(0xD61F0200);  // br x16
+    } else {
+        codegen_runtime_call_arm64(codegen, function, codegen_tier_up_function);
+        if (is_entry) inst(0xD61F0200);  // br x16
+    }
+
+    label_place(codegen, &done_label);  // done:
 }
 
 void codegen_func_arm64(Codegen *codegen, Function *function) {
     codegen->current_function = function;
+    // On-stack replacement code is only the rest of a function, its caller looks at the whole function
+    if (!codegen->is_osr_entry) codegen->has_escaped_locals = codegen_has_escaped_locals(function);
 
     // Set function ptr to current code offset
     function->address = (uint8_t *)codegen->code_word_ptr;
+    if (codegen_is_baseline(codegen)) codegen_counter_arm64(codegen, true, NULL);
 
     // Set main address
     if (!strcmp(function->name, "main")) {
@@ -39,15 +295,31 @@ void codegen_func_arm64(Codegen *codegen, Function *function) {
     }
 
     // Push link register
-    if (!function->is_leaf) inst(0xF81F0FE0 | (lr & 31));  // str lr, [sp, -16]!
+    int32_t lr_offset = function->is_leaf ? 0 : -16;
+    if (!function->is_leaf && !codegen->is_osr_entry) {
+        inst(0xF81F0FE0 | (lr & 31));  // str lr, [sp, -16]!
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, (FunctionFrame){.cfa_offset = 16, .lr_offset = lr_offset});
+    }
 
     // Allocate locals stack frame
     size_t aligned_locals_size = align(function->locals_size, 16);
-    if (aligned_locals_size > 0) {
-        inst(0xF81F0FE0 | (fp & 31));                                                              // str fp, [sp, -16]!
-        inst(0x910003FD);                                                                          // mov fp, sp
+    int32_t frame_size = (function->is_leaf ? 0 : 16) + 16;
+    codegen->body_frame = (FunctionFrame){.cfa_offset = frame_size - 16, .lr_offset = lr_offset};
+    if (codegen->is_osr_entry) {
+        codegen->body_frame = (FunctionFrame){.is_frame_based = true, .cfa_offset = frame_size, .fp_offset = -frame_size, .lr_offset = lr_offset};
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, codegen->body_frame);
+        inst(0x910003BF);                                                                          // mov sp, fp
+        inst(0xD1000000 | ((aligned_locals_size & 0x1fff) << 10) | ((sp & 31) << 5) | (sp & 31));  // sub sp, sp, imm
+    } else if (aligned_locals_size > 0) {
+        inst(0xF81F0FE0 | (fp & 31));  // str fp, [sp, -16]!
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr,
+                          (FunctionFrame){.cfa_offset = frame_size, .fp_offset = -frame_size, .lr_offset = lr_offset});
+        inst(0x910003FD);  // mov fp, sp
+        codegen->body_frame = (FunctionFrame){.is_frame_based = true, .cfa_offset = frame_size, .fp_offset = -frame_size, .lr_offset = lr_offset};
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, codegen->body_frame);
         inst(0xD1000000 | ((aligned_locals_size & 0x1fff) << 10) | ((sp & 31) << 5) | (sp & 31));  // sub sp, sp, imm
     }
+    codegen->body_word_ptr = codegen->code_word_ptr;
 
     // Write arguments to locals
     for (int32_t i = function->arguments_names.size - 1; i >= 0; i--) {
@@ -56,27 +328,27 @@ void codegen_func_arm64(Codegen *codegen, Function *function) {
 
         inst(0xD1000000 | ((local->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x6 & 31));  // sub x6, fp, imm
         if (i == 0) {
-            if (local->type->size == 1) inst(0x3D000000 | ((x6 & 31) << 5) | (x0 & 31));  // str b0, [x6]
-            if (local->type->size == 2) inst(0x7D000000 | ((x6 & 31) << 5) | (x0 & 31));  // str w0, [x6]
-            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x0 & 31));  // str h0, [x6]
+            if (local->type->size == 1) inst(0x39000000 | ((x6 & 31) << 5) | (x0 & 31));  // strb w0, [x6]
+            if (local->type->size == 2) inst(0x79000000 | ((x6 & 31) << 5) | (x0 & 31));  // strh w0, [x6]
+            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x0 & 31));  // str w0, [x6]
             if (local->type->size == 8) inst(0xF9000000 | ((x6 & 31) << 5) | (x0 & 31));  // str x0, [x6]
         }
         if (i == 1) {
-            if (local->type->size == 1) inst(0x3D000000 | ((x6 & 31) << 5) | (x1 & 31));  // str b1, [x6]
-            if (local->type->size == 2) inst(0x7D000000 | ((x6 & 31) << 5) | (x1 & 31));  // str w1, [x6]
-            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x1 & 31));  // str h1, [x6]
+            if (local->type->size == 1) inst(0x39000000 | ((x6 & 31) << 5) | (x1 & 31));  // strb w1, [x6]
+            if (local->type->size == 2) inst(0x79000000 | ((x6 & 31) << 5) | (x1 & 31));  // strh w1, [x6]
+            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x1 & 31));  // str w1, [x6]
             if (local->type->size == 8) inst(0xF9000000 | ((x6 & 31) << 5) | (x1 & 31));  // str x1, [x6]
         }
         if (i == 2) {
-            if (local->type->size == 1) inst(0x3D000000 | ((x6 & 31) << 5) | (x2 & 31));  // str b2, [x6]
-            if (local->type->size == 2) inst(0x7D000000 | ((x6 & 31) << 5) | (x2 & 31));  // str w2, [x6]
-            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x2 & 31));  // str h2, [x6]
+            if (local->type->size == 1) inst(0x39000000 | ((x6 & 31) << 5) | (x2 & 31));  // strb w2, [x6]
+            if (local->type->size == 2) inst(0x79000000 | ((x6 & 31) << 5) | (x2 & 31));  // strh w2, [x6]
+            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x2 & 31));  // str w2, [x6]
             if (local->type->size == 8) inst(0xF9000000 | ((x6 & 31) << 5) | (x2 & 31));  // str x2, [x6]
         }
         if (i == 3) {
-            if (local->type->size == 1) inst(0x3D000000 | ((x6 & 31) << 5) | (x3 & 31));  // str b3, [x6]
-            if (local->type->size == 2) inst(0x7D000000 | ((x6 & 31) << 5) | (x3 & 31));  // str w3, [x6]
-            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x3 & 31));  // str h3, [x6]
+            if (local->type->size == 1) inst(0x39000000 | ((x6 & 31) << 5) | (x3 & 31));  // strb w3, [x6]
+            if (local->type->size == 2) inst(0x79000000 | ((x6 & 31) << 5) | (x3 & 31));  // strh w3, [x6]
+            if (local->type->size == 4) inst(0xB9000000 | ((x6 & 31) << 5) | (x3 & 31));  // str w3, [x6]
             if (local->type->size == 8) inst(0xF9000000 | ((x6 & 31) << 5) | (x3 & 31));  // str x3, [x6]
         }
     }
@@ -87,6 +359,21 @@ void codegen_func_arm64(Codegen *codegen, Function *function) {
     }
 }
 
+// Free locals stack frame and restore link register
+static void codegen_epilogue_arm64(Codegen *codegen) {
+    Function *function = codegen->current_function;
+    if (function->locals_size > 0) {
+        inst(0x910003BF);              // mov sp, fp
+        inst(0xF84107E0 | (fp & 31));  // ldr fp, [sp], 16
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr,
+                          (FunctionFrame){.cfa_offset = function->is_leaf ? 0 : 16, .lr_offset = function->is_leaf ? 0 : -16});
+    }
+    if (!function->is_leaf) {
+        inst(0xF84107E0 | (lr & 31));  // ldr lr, [sp], 16
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, (FunctionFrame){0});
+    }
+}
+
 void codegen_stat_arm64(Codegen *codegen, Node *node) {
     // Nodes
     if (node->kind == NODE_NODES) {
@@ -98,72 +385,85 @@ void codegen_stat_arm64(Codegen *codegen, Node *node) {
     }
 
     // Statements
+    codegen_add_line(codegen, node->token, (uint8_t *)codegen->code_word_ptr);
     if (node->kind == NODE_IF) {
         codegen_expr_arm64(codegen, node->condition);
 
-        uint32_t *else_label = codegen->code_word_ptr;
-        inst(0);  // cbz x0, else
+        Label else_label = {0};
+        label_branch(codegen, &else_label, LABEL_FIXUP_ARM64_IMM19, 0xB4000000 | (x0 & 31));  // cbz x0, else
 
         codegen_stat_arm64(codegen, node->then_block);
 
-        uint32_t *done_label;
-        if (node->else_block) {
-            done_label = codegen->code_word_ptr;
-            inst(0);  // b done
-        }
+        Label done_label = {0};
+        if (node->else_block) label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM26, 0x14000000);  // b done
 
-        *else_label = 0xB4000000 | (((codegen->code_word_ptr - else_label) & 0x7ffff) << 5) | (x0 & 31);  // else:
+        label_place(codegen, &else_label);  // else:
         if (node->else_block) {
             codegen_stat_arm64(codegen, node->else_block);
 
-            *done_label = 0x14000000 | ((codegen->code_word_ptr - done_label) & 0x7ffffff);  // done:
+            label_place(codegen, &done_label);  // done:
         }
         return;
     }
 
     if (node->kind == NODE_WHILE) {
-        uint32_t *loop_label = codegen->code_word_ptr;
+        Label loop_label = {0};
+        label_place(codegen, &loop_label);  // loop:
 
-        uint32_t *done_label;
+        Label done_label = {0};
         if (node->condition != NULL) {
             codegen_expr_arm64(codegen, node->condition);
-            done_label = codegen->code_word_ptr;
-            inst(0);  // cbz x0, done
+            label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM19, 0xB4000000 | (x0 & 31));  // cbz x0, done
         }
 
         codegen_stat_arm64(codegen, node->then_block);
 
-        inst(0x14000000 | ((loop_label - codegen->code_word_ptr) & 0x7ffffff));  // b loop
+        if (codegen_is_baseline(codegen)) codegen_counter_arm64(codegen, false, codegen_find_osr(codegen, node));
+        label_branch(codegen, &loop_label, LABEL_FIXUP_ARM64_IMM26, 0x14000000);  // b loop
 
-        if (node->condition != NULL) {
-            *done_label = 0xB4000000 | (((codegen->code_word_ptr - done_label) & 0x7ffff) << 5) | (x0 & 31);  // done:
-        }
+        if (node->condition != NULL) label_place(codegen, &done_label);  // done:
         return;
     }
 
     if (node->kind == NODE_DOWHILE) {
-        uint32_t *loop_label = codegen->code_word_ptr;
+        Label loop_label = {0};
+        label_place(codegen, &loop_label);  // loop:
 
         codegen_stat_arm64(codegen, node->then_block);
+        if (codegen_is_baseline(codegen)) codegen_counter_arm64(codegen, false, NULL);
 
         codegen_expr_arm64(codegen, node->condition);
-        inst(0xB5000000 | (((loop_label - codegen->code_word_ptr) & 0x7ffff) << 5) | (x0 & 31));  // cbnz x0, loop
+        label_branch(codegen, &loop_label, LABEL_FIXUP_ARM64_IMM19, 0xB5000000 | (x0 & 31));  // cbnz x0, loop
         return;
     }
 
-    if (node->kind == NODE_RETURN) {
-        codegen_expr_arm64(codegen, node->unary);
+    if (node->kind == NODE_VECTOR) {
+        codegen_vector_arm64(codegen, node->vector);
+        return;
+    }
 
-        // Free locals stack frame
-        if (codegen->current_function->locals_size > 0) {
-            inst(0x910003BF);              // mov sp, fp
-            inst(0xF84107E0 | (fp & 31));  // ldr fp, [sp], 16
+    if (node->kind == NODE_RETURN && codegen_is_tail_call_arm64(codegen, node->unary)) {
+        Node *call = node->unary;
+        codegen_call_arguments_arm64(codegen, call);
+        if (call->function == codegen->current_function) {
+            if (codegen_is_baseline(codegen)) codegen_counter_arm64(codegen, false, NULL);
+            inst(0x14000000 | ((codegen->body_word_ptr - codegen->code_word_ptr) & 0x3ffffff));  // b body
+            return;
         }
 
-        // Push link register
-        if (!codegen->current_function->is_leaf) inst(0xF84107E0 | (lr & 31));  // ldr fp, [sp], 16
+        // Free locals stack frame and restore link register so the sibling function returns to our caller
+        codegen_epilogue_arm64(codegen);
+        codegen_branch_arm64(codegen, call->function, false);
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, codegen->body_frame);
+        return;
+    }
+
+    if (node->kind == NODE_RETURN) {
+        codegen_expr_arm64(codegen, node->unary);
 
+        codegen_epilogue_arm64(codegen);
         inst(0xD65F03C0);  // ret
+        codegen_add_frame(codegen, (uint8_t *)codegen->code_word_ptr, codegen->body_frame);
         return;
     }
 
@@ -172,7 +472,7 @@ void codegen_stat_arm64(Codegen *codegen, Node *node) {
 
 void codegen_addr_arm64(Codegen *codegen, Node *node) {
     if (node->kind == NODE_GLOBAL) {
-        inst(0x10000000 | ((((uint32_t *)node->global->address - codegen->code_word_ptr) & 0x7ffff) << 5) | (x0 & 31));  // adr x1, imm
+        codegen_global_arm64(codegen, x0, node->global);
         return;
     }
     if (node->kind == NODE_LOCAL) {
@@ -192,19 +492,19 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
     if (node->kind == NODE_TENARY || node->kind == NODE_IF) {
         codegen_expr_arm64(codegen, node->condition);
 
-        uint32_t *else_label = codegen->code_word_ptr;
-        inst(0);  // cbz x0, else
+        Label else_label = {0};
+        label_branch(codegen, &else_label, LABEL_FIXUP_ARM64_IMM19, 0xB4000000 | (x0 & 31));  // cbz x0, else
 
         codegen_expr_arm64(codegen, node->then_block);
 
-        uint32_t *done_label = codegen->code_word_ptr;
-        inst(0);  // b done
+        Label done_label = {0};
+        label_branch(codegen, &done_label, LABEL_FIXUP_ARM64_IMM26, 0x14000000);  // b done
 
-        *else_label = 0xB4000000 | (((codegen->code_word_ptr - else_label) & 0x7ffff) << 5) | (x0 & 31);  // else:
+        label_place(codegen, &else_label);  // else:
 
         codegen_expr_arm64(codegen, node->else_block);
 
-        *done_label = 0x14000000 | ((codegen->code_word_ptr - done_label) & 0x7ffffff);  // done:
+        label_place(codegen, &done_label);  // done:
         return;
     }
 
@@ -218,8 +518,12 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
         codegen_expr_arm64(codegen, node->unary);
 
         // When array in array just return the pointer
-        if (node->type->kind != TYPE_ARRAY) {
-            inst(0xF9400000);  // ldr x0, [x0]
+        Type *type = node->type;
+        if (type->kind != TYPE_ARRAY) {
+            if (type->size == 1) inst(0x39400000);  // ldrb w0, [x0]
+            if (type->size == 2) inst(0x79400000);  // ldrh w0, [x0]
+            if (type->size == 4) inst(0xB9400000);  // ldr w0, [x0]
+            if (type->size == 8) inst(0xF9400000);  // ldr x0, [x0]
         }
         return;
     }
@@ -238,6 +542,25 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
 
     // Operators
     if (node->kind == NODE_ASSIGN) {
+        // Locals and leaf values don't need to go over the stack
+        if (node->lhs->kind == NODE_LOCAL || codegen_is_leaf_arm64(node->rhs)) {
+            if (node->lhs->kind == NODE_LOCAL) {
+                codegen_expr_arm64(codegen, node->rhs);
+                inst(0xD1000000 | ((node->lhs->local->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x2 & 31));  // sub x2, fp, imm
+            } else {
+                codegen_addr_arm64(codegen, node->lhs);
+                inst(0xAA0003E0 | (x2 & 31));  // mov x2, x0
+                codegen_expr_arm64(codegen, node->rhs);
+            }
+
+            Type *type = node->lhs->type;
+            if (type->size == 1) inst(0x39000040);  // strb w0, [x2]
+            if (type->size == 2) inst(0x79000040);  // strh w0, [x2]
+            if (type->size == 4) inst(0xB9000040);  // str w0, [x2]
+            if (type->size == 8) inst(0xF9000040);  // str x0, [x2]
+            return;
+        }
+
         codegen_addr_arm64(codegen, node->lhs);
         inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
 
@@ -245,19 +568,24 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
         inst(0xF84107E0 | (x1 & 31));  // ldr x1, [sp], 16
 
         Type *type = node->lhs->type;
-        if (type->size == 1) inst(0x3D000020);  // str b0, [x1]
-        if (type->size == 2) inst(0x7D000020);  // str h0, [x1]
+        if (type->size == 1) inst(0x39000020);  // strb w0, [x1]
+        if (type->size == 2) inst(0x79000020);  // strh w0, [x1]
         if (type->size == 4) inst(0xB9000020);  // str w0, [x1]
         if (type->size == 8) inst(0xF9000020);  // str x0, [x1]
         return;
     }
 
     if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
-        codegen_expr_arm64(codegen, node->rhs);
-        inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
+        if (codegen_is_leaf_arm64(node->rhs)) {
+            codegen_expr_arm64(codegen, node->lhs);
+            codegen_leaf_x1_arm64(codegen, node->rhs);
+        } else {
+            codegen_expr_arm64(codegen, node->rhs);
+            inst(0xF81F0FE0 | (x0 & 31));  // str x0, [sp, -16]!
 
-        codegen_expr_arm64(codegen, node->lhs);
-        inst(0xF84107E0 | (x1 & 31));  // ldr x1, [sp], 16
+            codegen_expr_arm64(codegen, node->lhs);
+            inst(0xF84107E0 | (x1 & 31));  // ldr x1, [sp], 16
+        }
 
         if (node->kind == NODE_ADD) inst(0x8B010000);  // add x0, x0, x1
         if (node->kind == NODE_SUB) inst(0xCB010000);  // sub x0, x0, x1
@@ -299,11 +627,11 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
         if (type->kind == TYPE_ARRAY) {
             codegen_addr_arm64(codegen, node);
         } else {
-            inst(0x10000000 | ((((uint32_t *)node->global->address - codegen->code_word_ptr) & 0x7ffff) << 5) | (x1 & 31));  // adr x1, imm
-            if (type->size == 1) inst(0x3D400020);                                                                           // ldr b0, [x1]
-            if (type->size == 2) inst(0x7D400020);                                                                           // ldr h0, [x1]
-            if (type->size == 4) inst(0xB9400020);                                                                           // ldr w0, [x1]
-            if (type->size == 8) inst(0xF9400020);                                                                           // ldr x0, [x1]
+            codegen_global_arm64(codegen, x1, node->global);
+            if (type->size == 1) inst(0x39400020);  // ldrb w0, [x1]
+            if (type->size == 2) inst(0x79400020);  // ldrh w0, [x1]
+            if (type->size == 4) inst(0xB9400020);  // ldr w0, [x1]
+            if (type->size == 8) inst(0xF9400020);  // ldr x0, [x1]
         }
         return;
     }
@@ -314,8 +642,8 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
             codegen_addr_arm64(codegen, node);
         } else {
             inst(0xD1000000 | ((node->local->offset & 0x1fff) << 10) | ((fp & 31) << 5) | (x1 & 31));  // sub x1, fp, imm
-            if (type->size == 1) inst(0x3D400020);                                                     // ldr b0, [x1]
-            if (type->size == 2) inst(0x7D400020);                                                     // ldr h0, [x1]
+            if (type->size == 1) inst(0x39400020);                                                     // ldrb w0, [x1]
+            if (type->size == 2) inst(0x79400020);                                                     // ldrh w0, [x1]
             if (type->size == 4) inst(0xB9400020);                                                     // ldr w0, [x1]
             if (type->size == 8) inst(0xF9400020);                                                     // ldr x0, [x1]
         }
@@ -328,26 +656,12 @@ void codegen_expr_arm64(Codegen *codegen, Node *node) {
     }
 
     if (node->kind == NODE_CALL) {
-        // Write arguments to registers
-        for (int32_t i = node->nodes.size - 1; i >= 0; i--) {
-            Node *argument = node->nodes.items[i];
-            codegen_expr_arm64(codegen, argument);
-
-            if (i == 1) inst(0xAA0003E0 | (x1 & 31));  // mov x1, x0
-            if (i == 2) inst(0xAA0003E0 | (x2 & 31));  // mov x2, x0
-            if (i == 3) inst(0xAA0003E0 | (x3 & 31));  // mov x3, x0
-        }
+        codegen_call_arguments_arm64(codegen, node);
 
-        int64_t distance = (uint32_t *)node->function->address - codegen->code_word_ptr;
-        if (distance < -0x3ffffff || distance > 0x3ffffff) {
-            codegen_arm64_imm64(codegen, x6, (uint64_t)node->function->address);
-            inst(0xD63F0000 | ((x6 & 31) << 5));  // blr x6
-        } else {
-            inst(0x94000000 | ((distance)&0x7ffffff));  // bl function
-        }
+        codegen_branch_arm64(codegen, node->function, true);
         return;
     }
 
     print_error(node->token, "Unknown node kind");
-    exit(EXIT_FAILURE);
+    codegen->has_errors = true;
 }
@@ -1,33 +1,399 @@
 #include "codegen/codegen.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-void codegen(Program *program) {
-    Codegen codegen = {
-        .program = program,
-        .code_byte_ptr = (uint8_t *)program->text_section->data,
-        .code_word_ptr = (uint32_t *)program->text_section->data,
-    };
+#include "debugger.h"
+#include "linker.h"
+#include "optimizer/optimizer.h"
+#include "profiler.h"
+#include "utils/arena.h"
+#include "utils/pool.h"
 
-// Link extern functions to clib library
-#ifdef _WIN32
-    void *handle = LoadLibraryA("msvcrt.dll");
-#endif
-#ifdef __APPLE__
-    void *handle = dlopen("libSystem.B.dylib", RTLD_LAZY);
+#if defined(__x86_64__)
+#include <cpuid.h>
 #endif
-#ifdef __linux__
-    void *handle = dlopen("libc.so.6", RTLD_LAZY);
+
+bool codegen_has_avx2(void) {
+#if defined(__x86_64__)
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) return false;
+
+    // Check that the OS saves the ymm registers
+    uint32_t xcr0, xcr0_high;
+    __asm__("xgetbv" : "=a"(xcr0), "=d"(xcr0_high) : "c"(0));
+    if ((xcr0 & 6) != 6) return false;
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+    return (ebx & bit_AVX2) != 0;
+#else
+    return false;
 #endif
+}
+
+bool codegen_has_escaped_locals(Function *function) {
+    for (size_t i = 0; i < function->locals.size; i++) {
+        Local *local = function->locals.items[i];
+        if (local->type->kind == TYPE_ARRAY) return true;
+    }
+    return optimizer_has_escaped_locals(&function->nodes);
+}
+
+// Emits a function at the code pointers
+static void codegen_function(Codegen *codegen, Function *function) {
+    function->lines = (List){0};
+    list_init(&function->lines);
+    function->frames = (List){0};
+    list_init(&function->frames);
+    if (codegen->program->arch == ARCH_X86_64) {
+        codegen_func_x86_64(codegen, function);
+        function->size = codegen->code_byte_ptr - function->address;
+    } else {
+        codegen_func_arm64(codegen, function);
+        function->size = (uint8_t *)codegen->code_word_ptr - function->address;
+    }
+}
+
+// Reports the code, lines and frames of a placed function to the profiler and debuggers
+static void codegen_report_function(Program *program, Function *function, char *kind) {
+    if (profiler_mode() != PROFILER_NONE || program->has_debug_info) {
+        char name[256];
+        snprintf(name, sizeof(name), kind != NULL ? "%s [%s]" : "%s", function->name, kind);
+        profiler_add_function(function, name);
+        if (program->has_debug_info) debugger_add_function(program->arch, function, name);
+    }
+}
+
+// The text section is executable while the program runs, a page is only writable while code is written to it
+static void codegen_protect(Codegen *codegen, void *address, size_t size, bool is_writable) {
+    if (!section_protect(codegen->program->text_section, address, size, is_writable)) {
+        fprintf(stderr, "Can't change the protection of the text section\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Emits a function while the program runs and flushes it for the instruction cache
+static void codegen_emit_function(Codegen *codegen, Function *function, char *kind) {
+    Section *text_section = codegen->program->text_section;
+    uint8_t *start = (uint8_t *)text_section->data + text_section->filled;
+    size_t size = text_section->size - text_section->filled;
+    codegen_protect(codegen, start, size, true);
+    codegen_function(codegen, function);
+    codegen_protect(codegen, start, size, false);
+    codegen_report_function(codegen->program, function, kind);
+    text_section->filled = function->address + function->size - (uint8_t *)text_section->data;
+    __builtin___clear_cache((char *)function->address, (char *)text_section->data + text_section->filled);
+
+    // A function compiled while the program runs has no caller to report its errors to
+    if (codegen->has_errors) exit(EXIT_FAILURE);
+}
+
+static void codegen_patch_jump(Codegen *codegen, uint8_t *address, uint8_t *target) {
+    codegen_protect(codegen, address, sizeof(uint64_t), true);
+    if (codegen->program->arch == ARCH_X86_64) codegen_patch_jump_x86_64(address, target);
+    if (codegen->program->arch == ARCH_ARM64) codegen_patch_jump_arm64(address, target);
+    codegen_protect(codegen, address, sizeof(uint64_t), false);
+    __builtin___clear_cache((char *)address, (char *)address + sizeof(uint64_t));
+}
+
+// Loops that are only nested in blocks can continue in an optimized copy of the loop and the statements after it
+static void codegen_find_osr_loops(Codegen *codegen, Function *function, List *nodes, List *following) {
+    for (size_t i = 0; i < nodes->size; i++) {
+        Node *node = nodes->items[i];
+        if (node->kind != NODE_WHILE && node->kind != NODE_NODES) continue;
+
+        List continuation = {0};
+        list_init(&continuation);
+        for (size_t j = i + 1; j < nodes->size; j++) list_add(&continuation, nodes->items[j]);
+        for (size_t j = 0; j < following->size; j++) list_add(&continuation, following->items[j]);
+        if (node->kind == NODE_NODES) {
+            codegen_find_osr_loops(codegen, function, &node->nodes, &continuation);
+            list_free(&continuation, NULL);
+            continue;
+        }
+
+        CodegenOsr *osr = arena_calloc(1, sizeof(CodegenOsr));
+        osr->function = function;
+        osr->loop = node;
+        list_init(&osr->continuation);
+        list_add(&osr->continuation, node);
+        for (size_t j = 0; j < continuation.size; j++) list_add(&osr->continuation, continuation.items[j]);
+        list_free(&continuation, NULL);
+        list_add(&codegen->osr_loops, osr);
+    }
+}
+
+CodegenOsr *codegen_find_osr(Codegen *codegen, Node *loop) {
+    for (size_t i = 0; i < codegen->osr_loops.size; i++) {
+        CodegenOsr *osr = codegen->osr_loops.items[i];
+        if (osr->loop == loop) return osr;
+    }
+    return NULL;
+}
+
+// Called by a function stub on its first call, compiles the function and patches the stub to jump to it
+void *codegen_compile_function(Codegen *codegen, void *argument) {
+    Function *function = argument;
+    if (codegen->mode == CODEGEN_LAZY && codegen->is_optimizing && function->is_implemented) {
+        optimizer_function(codegen->program, function, codegen->unroll_factor, optimizer_has_escaped_locals(&function->nodes));
+    }
+    if (codegen->mode == CODEGEN_TIERED && function->locals_size > 0) {
+        List following = {0};
+        codegen_find_osr_loops(codegen, function, &function->nodes, &following);
+    }
+    codegen_emit_function(codegen, function, codegen->mode == CODEGEN_TIERED ? "baseline" : NULL);
+    codegen_patch_jump(codegen, function->stub_address, function->address);
+    return function->address;
+}
+
+// Called by baseline code when its counter runs out, recompiles the function optimized and sends every entry to it
+void *codegen_tier_up_function(Codegen *codegen, void *argument) {
+    Function *function = argument;
+    if (function->is_optimized) return function->address;
+    uint8_t *baseline_address = function->address;
+    function->is_optimized = true;
+
+    // The optimizer works on a copy so on-stack replacement can still copy the original loops
+    List nodes = function->nodes;
+    List optimized_nodes = {0};
+    list_init(&optimized_nodes);
+    for (size_t i = 0; i < nodes.size; i++) list_add(&optimized_nodes, optimizer_clone(nodes.items[i]));
+    function->nodes = optimized_nodes;
+    if (function->is_implemented) {
+        optimizer_function(codegen->program, function, codegen->unroll_factor, optimizer_has_escaped_locals(&function->nodes));
+    }
+    codegen_emit_function(codegen, function, NULL);
+    function->nodes = nodes;
+
+    codegen_patch_jump(codegen, function->stub_address, function->address);
+    codegen_patch_jump(codegen, baseline_address, function->address);
+    return function->address;
+}
+
+// Called by a hot baseline loop, compiles the rest of the function starting at the loop condition into code that
+// takes over the frame of the baseline code, so every local keeps its value
+void *codegen_osr_function(Codegen *codegen, void *argument) {
+    CodegenOsr *osr = argument;
+    codegen_tier_up_function(codegen, osr->function);
+    if (osr->address != NULL) return osr->address;
+
+    Function function = *osr->function;
+    function.locals = (List){0};
+    list_init(&function.locals);
+    for (size_t i = 0; i < osr->function->locals.size; i++) list_add(&function.locals, osr->function->locals.items[i]);
+    function.arguments_names = (List){0};
+    function.nodes = (List){0};
+    list_init(&function.nodes);
+    for (size_t i = 0; i < osr->continuation.size; i++) list_add(&function.nodes, optimizer_clone(osr->continuation.items[i]));
+    optimizer_function(codegen->program, &function, codegen->unroll_factor, optimizer_has_escaped_locals(&osr->function->nodes));
+
+    codegen->is_osr_entry = true;
+    codegen->has_escaped_locals = codegen_has_escaped_locals(osr->function);
+    codegen_emit_function(codegen, &function, "osr");
+    codegen->is_osr_entry = false;
+    osr->address = function.address;
+    return osr->address;
+}
+
+void codegen_add_line(Codegen *codegen, Token *token, uint8_t *address) {
+    Function *function = codegen->current_function;
+    if (!codegen->program->has_debug_info || token == NULL || token->source == NULL) return;
+
+    // Only the first statement at an address and only a change of line are kept
+    if (function->lines.size > 0) {
+        FunctionLine *last = function->lines.items[function->lines.size - 1];
+        if (last->address == address) {
+            last->token = token;
+            return;
+        }
+        if (last->token->line == token->line && last->token->source == token->source) return;
+    }
+    FunctionLine *line = arena_malloc(sizeof(FunctionLine));
+    line->address = address;
+    line->token = token;
+    list_add(&function->lines, line);
+}
+
+void codegen_add_frame(Codegen *codegen, uint8_t *address, FunctionFrame frame) {
+    Function *function = codegen->current_function;
+    if (!codegen->program->has_debug_info) return;
+
+    // A row that doesn't change the layout is dropped and a later row at the same address replaces the earlier one
+    frame.address = address;
+    if (function->frames.size > 0) {
+        FunctionFrame *last = function->frames.items[function->frames.size - 1];
+        if (last->address == address) {
+            *last = frame;
+            return;
+        }
+        if (last->is_frame_based == frame.is_frame_based && last->cfa_offset == frame.cfa_offset && last->fp_offset == frame.fp_offset &&
+            last->lr_offset == frame.lr_offset) {
+            return;
+        }
+    }
+    FunctionFrame *row = arena_malloc(sizeof(FunctionFrame));
+    *row = frame;
+    list_add(&function->frames, row);
+}
+
+bool codegen_is_baseline(Codegen *codegen) { return codegen->mode == CODEGEN_TIERED && !codegen->current_function->is_optimized; }
+
+void codegen_add_relocation(Codegen *codegen, void *address, RelocationKind kind, Function *function, Global *global, int64_t addend) {
+    Relocation *relocation = arena_calloc(1, sizeof(Relocation));
+    relocation->kind = kind;
+    relocation->offset = (uint8_t *)address - codegen->code_start;
+    relocation->function = function;
+    relocation->global = global;
+    relocation->addend = addend;
+    list_add(&codegen->relocations, relocation);
+}
+
+// Eager functions are emitted on a thread pool, every worker emits the functions it takes after each other in its own
+// buffer and keeps where the code and relocations of every function are
+typedef struct CodegenUnit {
+    size_t worker;
+    uint8_t *code;
+    size_t first_relocation;
+    size_t last_relocation;
+    Buffer errors;
+    bool has_errors;
+} CodegenUnit;
+
+typedef struct CodegenEager {
+    Codegen *codegen;
+    CodegenUnit *units;
+    Codegen *workers;
+    size_t capacity;
+} CodegenEager;
+
+static void codegen_eager_function(void *context, size_t worker, size_t task) {
+    CodegenEager *eager = context;
+    Function *function = eager->codegen->program->functions.items[task];
+    if (function->is_extern) return;
+
+    Codegen *codegen = &eager->workers[worker];
+    if (codegen->code_start == NULL) {
+        codegen->code_start = arena_malloc(eager->capacity);
+        codegen->code_byte_ptr = codegen->code_start;
+        codegen->code_word_ptr = (uint32_t *)codegen->code_start;
+        codegen->relocations = (List){0};
+        list_init(&codegen->relocations);
+    }
+    codegen->has_errors = false;
+
+    CodegenUnit *unit = &eager->units[task];
+    unit->worker = worker;
+    unit->first_relocation = codegen->relocations.size;
+    Buffer *previous_errors = print_error_redirect(&unit->errors);
+    codegen_function(codegen, function);
+    print_error_redirect(previous_errors);
+    unit->code = function->address;
+    unit->last_relocation = codegen->relocations.size;
+    unit->has_errors = codegen->has_errors;
+}
+
+// The layout places the functions after each other in program order and then fills in the relocations, so the code is
+// the same for every number of threads and calls to functions that come later are resolved like the others
+static void codegen_eager(Codegen *codegen, size_t jobs) {
+    Program *program = codegen->program;
+    Section *text_section = program->text_section;
+    CodegenEager eager = {
+        .codegen = codegen,
+        .units = arena_calloc(program->functions.size, sizeof(CodegenUnit)),
+        .workers = arena_malloc(jobs * sizeof(Codegen)),
+        .capacity = text_section->size - (codegen->code_byte_ptr - (uint8_t *)text_section->data),
+    };
+    for (size_t i = 0; i < jobs; i++) {
+        eager.workers[i] = *codegen;
+        eager.workers[i].code_start = NULL;
+        eager.workers[i].labels_size = 0;
+        eager.workers[i].fixups_size = 0;
+    }
+    pool_run(jobs, program->functions.size, codegen_eager_function, &eager);
+
+    uint8_t *code = codegen->code_byte_ptr;
     for (size_t i = 0; i < program->functions.size; i++) {
         Function *function = program->functions.items[i];
-        if (function->is_extern) {
-#ifdef _WIN32
-            function->address = GetProcAddress(handle, function->name);
-#else
-            function->address = dlsym(handle, function->name);
-#endif
+        if (function->is_extern) continue;
+        CodegenUnit *unit = &eager.units[i];
+        Codegen *worker = &eager.workers[unit->worker];
+        memcpy(code, unit->code, function->size);
+
+        // Move the function, its lines and frames and its relocations from the buffer of the worker to its place
+        int64_t distance = code - unit->code;
+        function->address = code;
+        for (size_t j = 0; j < function->lines.size; j++) ((FunctionLine *)function->lines.items[j])->address += distance;
+        for (size_t j = 0; j < function->frames.size; j++) ((FunctionFrame *)function->frames.items[j])->address += distance;
+        if (!strcmp(function->name, "main")) program->main_func = function->address;
+        for (size_t j = unit->first_relocation; j < unit->last_relocation; j++) {
+            Relocation *relocation = worker->relocations.items[j];
+            relocation->offset += code - (uint8_t *)text_section->data - (unit->code - worker->code_start);
+            list_add(&codegen->relocations, relocation);
         }
+        print_error_buffer(&unit->errors);
+        arena_release(unit->errors.data);
+        codegen->has_errors |= unit->has_errors;
+        code += function->size;
+    }
+    codegen->code_byte_ptr = code;
+    codegen->code_word_ptr = (uint32_t *)code;
+    for (size_t i = 0; i < jobs; i++) {
+        codegen->labels_size += eager.workers[i].labels_size;
+        codegen->fixups_size += eager.workers[i].fixups_size;
+        if (eager.workers[i].code_start == NULL) continue;
+        arena_release(eager.workers[i].code_start);
+        list_free(&eager.workers[i].relocations, NULL);
+    }
+    arena_release(eager.workers);
+    arena_release(eager.units);
+
+    // Relocatable code keeps the relocations for the linker, the others are filled in now every function has its place
+    program->relocations_size = codegen->relocations.size;
+    for (size_t i = 0; i < codegen->relocations.size; i++) {
+        Relocation *relocation = codegen->relocations.items[i];
+        if (program->is_relocatable) {
+            list_add(&program->relocations, relocation);
+            continue;
+        }
+        uint8_t *place = (uint8_t *)text_section->data + relocation->offset;
+        uint8_t *target = relocation->function != NULL ? relocation->function->address : relocation->global->address;
+        linker_relocate(place, relocation->kind, (uint64_t)place, (uint64_t)target + relocation->addend);
+        arena_release(relocation);
+    }
+    list_free(&codegen->relocations, NULL);
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (!function->is_extern) codegen_report_function(program, function, NULL);
+    }
+}
+
+bool codegen(Program *program, CodegenMode mode, bool is_optimizing, size_t unroll_factor, size_t jobs) {
+    // Lazy functions are compiled while the program runs so the codegen state must outlive this call
+    Codegen *codegen = arena_calloc(1, sizeof(Codegen));
+    codegen->program = program;
+    codegen->mode = mode;
+    codegen->is_optimizing = is_optimizing;
+    codegen->unroll_factor = unroll_factor;
+    codegen->code_start = (uint8_t *)program->text_section->data;
+    codegen->code_byte_ptr = codegen->code_start;
+    codegen->code_word_ptr = (uint32_t *)codegen->code_start;
+    // Object files and executables run on other machines so they keep to the SSE2 every x86_64 has
+    codegen->has_avx2 = program->arch == ARCH_X86_64 && !program->is_portable && codegen_has_avx2();
+    list_init(&codegen->osr_loops);
+    list_init(&codegen->relocations);
+
+    // Link extern functions to clib library, unless the library user already resolved them, functions that are out
+    // of branch range are called through a veneer at the start of the text section
+    for (size_t i = 0; i < program->functions.size && !program->is_relocatable; i++) {
+        Function *function = program->functions.items[i];
+        if (!function->is_extern) continue;
+        if (function->address == NULL) function->address = linker_find_host_symbol(function->name);
+        if (linker_is_near(program->arch, program->text_section, function->address)) continue;
+        linker_write_veneer(program->arch, codegen->code_byte_ptr, function->address);
+        function->address = codegen->code_byte_ptr;
+        codegen->code_byte_ptr += LINKER_VENEER_SIZE;
+        codegen->code_word_ptr += LINKER_VENEER_SIZE / sizeof(uint32_t);
     }
 
     // Fill globals in data section
@@ -44,21 +410,40 @@ void codegen(Program *program) {
     }
     program->data_section->filled = global_address - (uint8_t *)program->data_section->data;
 
-    // x86_64
-    if (program->arch == ARCH_X86_64) {
+    // Tiered functions count their calls and loop iterations in the data section
+    if (mode == CODEGEN_TIERED) {
         for (size_t i = 0; i < program->functions.size; i++) {
             Function *function = program->functions.items[i];
-            if (!function->is_extern) codegen_func_x86_64(&codegen, function);
+            if (function->is_extern) continue;
+            function->counter = (int32_t *)((uint8_t *)program->data_section->data + program->data_section->filled);
+            *function->counter = CODEGEN_TIER_UP_THRESHOLD;
+            program->data_section->filled += sizeof(int32_t);
         }
-        program->text_section->filled = codegen.code_byte_ptr - (uint8_t *)program->text_section->data;
     }
 
-    // arm64
-    if (program->arch == ARCH_ARM64) {
+    // Lazy and tiered mode only emit a stub for every function, the body is compiled on the first call
+    if (mode != CODEGEN_EAGER) {
         for (size_t i = 0; i < program->functions.size; i++) {
             Function *function = program->functions.items[i];
-            if (!function->is_extern) codegen_func_arm64(&codegen, function);
+            if (function->is_extern) continue;
+            if (program->arch == ARCH_X86_64) codegen_stub_x86_64(codegen, function);
+            if (program->arch == ARCH_ARM64) codegen_stub_arm64(codegen, function);
+            if (!strcmp(function->name, "main")) program->main_func = function->address;
+            if (profiler_mode() != PROFILER_NONE) {
+                char name[256];
+                snprintf(name, sizeof(name), "%s [stub]", function->name);
+                function->size = (program->arch == ARCH_X86_64 ? codegen->code_byte_ptr : (uint8_t *)codegen->code_word_ptr) - function->address;
+                profiler_add_function(function, name);
+            }
         }
-        program->text_section->filled = (uint8_t *)codegen.code_word_ptr - (uint8_t *)program->text_section->data;
     }
+
+    if (mode == CODEGEN_EAGER) codegen_eager(codegen, jobs);
+    program->text_section->filled =
+        (program->arch == ARCH_X86_64 ? codegen->code_byte_ptr : (uint8_t *)codegen->code_word_ptr) - (uint8_t *)program->text_section->data;
+    program->labels_size = codegen->labels_size;
+    program->fixups_size = codegen->fixups_size;
+    bool has_errors = codegen->has_errors;
+    if (mode == CODEGEN_EAGER) arena_release(codegen);
+    return !has_errors;
 }
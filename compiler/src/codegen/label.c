@@ -0,0 +1,48 @@
+#include "codegen/label.h"
+
+#include <assert.h>
+
+static void label_patch(LabelFixup *fixup, uint8_t *target) {
+    if (fixup->kind == LABEL_FIXUP_X86_64_REL8) {
+        // The backends only take a short jump over code that is known to fit in it
+        int64_t distance = target - (fixup->address + 1);
+        assert(distance >= -128 && distance <= 127);
+        *fixup->address = distance;
+    }
+    if (fixup->kind == LABEL_FIXUP_X86_64_REL32) *((int32_t *)fixup->address) = target - (fixup->address + sizeof(int32_t));
+    int64_t words = (uint32_t *)target - (uint32_t *)fixup->address;
+    if (fixup->kind == LABEL_FIXUP_ARM64_IMM26) *((uint32_t *)fixup->address) |= words & 0x3ffffff;
+    if (fixup->kind == LABEL_FIXUP_ARM64_IMM19) *((uint32_t *)fixup->address) |= (words & 0x7ffff) << 5;
+}
+
+void label_branch(Codegen *codegen, Label *label, LabelFixupKind kind, uint32_t instruction) {
+    LabelFixup fixup = {.kind = kind};
+    if (kind == LABEL_FIXUP_X86_64_REL8) {
+        fixup.address = codegen->code_byte_ptr;
+        *codegen->code_byte_ptr = 0;
+        codegen->code_byte_ptr += 1;
+    } else if (kind == LABEL_FIXUP_X86_64_REL32) {
+        fixup.address = codegen->code_byte_ptr;
+        *((int32_t *)codegen->code_byte_ptr) = 0;
+        codegen->code_byte_ptr += sizeof(int32_t);
+    } else {
+        fixup.address = (uint8_t *)codegen->code_word_ptr;
+        *codegen->code_word_ptr = instruction;
+        codegen->code_word_ptr++;
+    }
+
+    // The backends never leave more branches waiting on one label than fit in it
+    if (label->address != NULL) {
+        label_patch(&fixup, label->address);
+    } else {
+        assert(label->fixups_size < LABEL_FIXUPS_CAPACITY);
+        label->fixups[label->fixups_size++] = fixup;
+    }
+}
+
+void label_place(Codegen *codegen, Label *label) {
+    label->address = codegen->program->arch == ARCH_X86_64 ? codegen->code_byte_ptr : (uint8_t *)codegen->code_word_ptr;
+    for (size_t i = 0; i < label->fixups_size; i++) label_patch(&label->fixups[i], label->address);
+    codegen->labels_size++;
+    codegen->fixups_size += label->fixups_size;
+}
@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "codegen/codegen.h"
+#include "codegen/label.h"
 
 #define rax 0
 #define rcx 1
@@ -11,6 +12,10 @@
 #define rbp 5
 #define rsi 6
 #define rdi 7
+#define r8 8
+#define r9 9
+#define r10 10
+#define r11 11
 
 #define inst1(a) *codegen->code_byte_ptr++ = a
 #define inst2(a, b)                    \
@@ -40,11 +45,367 @@
         codegen->code_byte_ptr += sizeof(int64_t);  \
     }
 
+// Leaf nodes can be loaded straight into rcx without going over the stack
+static bool codegen_is_leaf_x86_64(Node *node) {
+    if (node->kind == NODE_INTEGER) return node->integer > INT32_MIN && node->integer < INT32_MAX;
+    if (node->kind == NODE_LOCAL) return node->type->kind != TYPE_ARRAY;
+    return false;
+}
+
+static void codegen_leaf_rcx_x86_64(Codegen *codegen, Node *node) {
+    if (node->kind == NODE_INTEGER) {
+        inst3(0x48, 0xc7, 0xc0 | (rcx & 7));  // mov rcx, imm
+        imm32(node->integer);
+    }
+    if (node->kind == NODE_LOCAL) {
+        Type *type = node->local->type;
+        if (type->size == 1) inst4(0x48, 0x0f, 0xb6, 0x8d);  // movzx rcx, byte [rbp - imm]
+        if (type->size == 2) inst4(0x48, 0x0f, 0xb7, 0x8d);  // movzx rcx, word [rbp - imm]
+        if (type->size == 4) inst2(0x8b, 0x8d);              // mov ecx, dword [rbp - imm]
+        if (type->size == 8) inst3(0x48, 0x8b, 0x8d);        // mov rcx, qword [rbp - imm]
+        imm32(-node->local->offset);
+    }
+}
+
+// Functions that call other functions need a frame to keep the stack aligned
+static bool codegen_has_frame_x86_64(Function *function) { return function->locals_size > 0 || !function->is_leaf; }
+
+// Write call arguments to registers, the other arguments wait on the stack because evaluating an argument can clobber registers
+static void codegen_call_arguments_x86_64(Codegen *codegen, Node *node) {
+    for (int32_t i = node->nodes.size - 1; i >= 0; i--) {
+        Node *argument = node->nodes.items[i];
+        codegen_expr_x86_64(codegen, argument);
+        if (i > 0) inst1(0x50 | (rax & 7));  // push rax
+    }
+
+    for (size_t i = 0; i < node->nodes.size; i++) {
+#ifdef _WIN32
+        if (i == 0) inst3(0x48, 0x89, 0xc1);       // mov rcx, rax
+        if (i == 1) inst1(0x58 | (rdx & 7));       // pop rdx
+        if (i == 2) inst2(0x41, 0x58 | (r8 & 7));  // pop r8
+        if (i == 3) inst2(0x41, 0x58 | (r9 & 7));  // pop r9
+#else
+        if (i == 0) inst3(0x48, 0x89, 0xc7);  // mov rdi, rax
+        if (i == 1) inst1(0x58 | (rsi & 7));  // pop rsi
+        if (i == 2) inst1(0x58 | (rdx & 7));  // pop rdx
+        if (i == 3) inst1(0x58 | (rcx & 7));  // pop rcx
+#endif
+    }
+}
+
+// A call in return position reuses the current frame unless an argument can point into it, self recursion jumps back
+// to the function body
+static bool codegen_is_tail_call_x86_64(Codegen *codegen, Node *node) {
+    return node->kind == NODE_CALL && !codegen->has_escaped_locals &&
+           (codegen->mode == CODEGEN_EAGER || node->function == codegen->current_function || node->function->address != NULL);
+}
+
+// Eager code leaves the distance to the relocations, far functions like clib functions are called through rax
+static void codegen_branch_x86_64(Codegen *codegen, Function *function, bool is_call) {
+    if (codegen->mode == CODEGEN_EAGER) {
+        inst1(is_call ? 0xe8 : 0xe9);  // call function or jmp function
+        codegen_add_relocation(codegen, codegen->code_byte_ptr, RELOCATION_X86_64_PLT32, function, NULL, -(int64_t)sizeof(int32_t));
+        imm32(0);
+        return;
+    }
+
+    int64_t distance = function->address - (codegen->code_byte_ptr + 1 + sizeof(int32_t));
+    if (distance < INT32_MIN || distance > INT32_MAX) {
+        inst2(0x48, 0xb8 | (rax & 7));  // movabs rax, imm
+        imm64((int64_t)function->address);
+        inst2(0xff, is_call ? 0xd0 : 0xe0);  // call rax or jmp rax
+    } else {
+        inst1(is_call ? 0xe8 : 0xe9);  // call function or jmp function
+        imm32(distance);
+    }
+}
+
+static void codegen_global_x86_64(Codegen *codegen, Global *global) {
+    inst3(0x48, 0x8d, 0x05);  // lea rax, [rip + imm]
+    if (codegen->mode == CODEGEN_EAGER) {
+        codegen_add_relocation(codegen, codegen->code_byte_ptr, RELOCATION_X86_64_PC32, NULL, global, -(int64_t)sizeof(int32_t));
+        imm32(0);
+    } else {
+        imm32((uint8_t *)global->address - (codegen->code_byte_ptr + sizeof(int32_t)));
+    }
+}
+
+// Vector loops use SSE2 or AVX2 registers, operands are indexed with r8 as the element counter
+static void codegen_vector_op_x86_64(Codegen *codegen, uint8_t opcode, int32_t dst, int32_t src) {
+    if (codegen->has_avx2) {
+        int32_t vvvv = opcode == 0x6f ? 15 : (~dst & 15);
+        inst3(0xc5, 0x85 | (vvvv << 3), opcode);  // vpop ymm, ymm, ymm
+    } else {
+        inst3(0x66, 0x0f, opcode);  // pop xmm, xmm
+    }
+    inst1(0xc0 | (dst << 3) | src);
+}
+
+static void codegen_vector_memory_x86_64(Codegen *codegen, uint8_t opcode, int32_t reg, int32_t base, size_t scale) {
+    if (codegen->has_avx2) {
+        inst4(0xc4, 0xa1 ^ ((base >> 3) << 5), 0x7e, opcode);  // vmovdqu ymm, [base + r8 * scale]
+    } else {
+        inst4(0xf3, 0x42 | (base >> 3), 0x0f, opcode);  // movdqu xmm, [base + r8 * scale]
+    }
+    inst2(0x04 | (reg << 3), (log_two(scale) << 6) | (base & 7));
+}
+
+static void codegen_vector_x86_64(Codegen *codegen, Vector *vector) {
+    size_t vector_size = codegen->has_avx2 ? 32 : 16;
+    size_t size = vector->element_size;
+    uint8_t add_opcode = size == 1 ? 0xfc : (size == 2 ? 0xfd : (size == 4 ? 0xfe : 0xd4));
+    uint8_t sub_opcode = size == 1 ? 0xf8 : (size == 2 ? 0xf9 : (size == 4 ? 0xfa : 0xfb));
+
+    // Load operands in r10, r11, rdx and the bound in r9
+    codegen_expr_x86_64(codegen, vector->bound);
+    inst1(0x50 | (rax & 7));  // push rax
+    if (vector->destination != NULL) {
+        codegen_expr_x86_64(codegen, vector->destination);
+        inst1(0x50 | (rax & 7));  // push rax
+    }
+    if (vector->lhs != NULL) {
+        codegen_expr_x86_64(codegen, vector->lhs);
+        inst1(0x50 | (rax & 7));  // push rax
+    }
+    codegen_expr_x86_64(codegen, vector->rhs);
+    inst3(0x48, 0x89, 0xc2);                            // mov rdx, rax
+    if (vector->lhs != NULL) inst2(0x41, 0x58 | (r11 & 7));          // pop r11
+    if (vector->destination != NULL) inst2(0x41, 0x58 | (r10 & 7));  // pop r10
+    inst2(0x41, 0x58 | (r9 & 7));                                    // pop r9
+
+    Type *type = vector->induction->type;
+    if (type->size == 1) inst4(0x4c, 0x0f, 0xb6, 0x85);  // movzx r8, byte [rbp - imm]
+    if (type->size == 2) inst4(0x4c, 0x0f, 0xb7, 0x85);  // movzx r8, word [rbp - imm]
+    if (type->size == 4) inst3(0x44, 0x8b, 0x85);        // mov r8d, dword [rbp - imm]
+    if (type->size == 8) inst3(0x4c, 0x8b, 0x85);        // mov r8, qword [rbp - imm]
+    imm32(-vector->induction->offset);
+
+    codegen_vector_op_x86_64(codegen, 0xef, 1, 1);  // pxor xmm1, xmm1
+    codegen_vector_op_x86_64(codegen, 0xef, 4, 4);  // pxor xmm4, xmm4
+
+    // Skip the vector loop when the destination overlaps a source that is read later
+    Label done_label = {0};
+    if (vector->destination != NULL) {
+        for (int32_t i = 0; i < 2; i++) {
+            if (i == 0 && vector->lhs == NULL) continue;
+            if (i == 1 && vector->is_rhs_scalar) continue;
+            inst3(0x4c, 0x89, 0xd0);               // mov rax, r10
+            if (i == 0) inst3(0x4c, 0x29, 0xd8);   // sub rax, r11
+            if (i == 1) inst3(0x48, 0x29, 0xd0);   // sub rax, rdx
+            Label over_label = {0};
+            inst1(0x74);  // je over
+            label_branch(codegen, &over_label, LABEL_FIXUP_X86_64_REL8, 0);
+            inst4(0x48, 0x83, 0xf8, vector_size);  // cmp rax, imm
+            inst2(0x0f, 0x82);                     // jb done
+            label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL32, 0);
+            label_place(codegen, &over_label);  // over:
+        }
+    }
+
+    // Broadcast scalar operand to all lanes of xmm2
+    if (vector->is_rhs_scalar) {
+        inst4(0x66, 0x48, 0x0f, 0x6e);  // movq xmm2, rdx
+        inst1(0xd2);
+        if (codegen->has_avx2) {
+            uint8_t opcode = size == 1 ? 0x78 : (size == 2 ? 0x79 : (size == 4 ? 0x58 : 0x59));
+            inst4(0xc4, 0xe2, 0x7d, opcode);  // vpbroadcast ymm2, xmm2
+            inst1(0xd2);
+        } else {
+            if (size == 1) inst4(0x66, 0x0f, 0x60, 0xd2);  // punpcklbw xmm2, xmm2
+            if (size <= 2) inst4(0x66, 0x0f, 0x61, 0xd2);  // punpcklwd xmm2, xmm2
+            if (size <= 4) {
+                inst4(0x66, 0x0f, 0x70, 0xd2);  // pshufd xmm2, xmm2, 0
+                inst1(0);
+            }
+            if (size == 8) inst4(0x66, 0x0f, 0x6c, 0xd2);  // punpcklqdq xmm2, xmm2
+        }
+    }
+
+    Label loop_label = {0};
+    label_place(codegen, &loop_label);            // loop:
+    inst4(0x49, 0x8d, 0x40, vector_size / size);  // lea rax, [r8 + imm]
+    inst3(0x4c, 0x39, 0xc8);                      // cmp rax, r9
+    inst2(0x0f, 0x8f);                            // jg done
+    label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL32, 0);
+
+    if (vector->accumulator != NULL) {
+        codegen_vector_memory_x86_64(codegen, 0x6f, 0, rdx, size);  // movdqu xmm0, [rdx + r8 * size]
+        if (size == 1) {
+            codegen_vector_op_x86_64(codegen, 0xf6, 0, 4);     // psadbw xmm0, xmm4
+            codegen_vector_op_x86_64(codegen, 0xd4, 1, 0);     // paddq xmm1, xmm0
+        } else if (size < vector->accumulator->type->size) {
+            codegen_vector_op_x86_64(codegen, 0x6f, 3, 0);     // movdqa xmm3, xmm0
+            codegen_vector_op_x86_64(codegen, 0x62, 0, 4);     // punpckldq xmm0, xmm4
+            codegen_vector_op_x86_64(codegen, 0x6a, 3, 4);     // punpckhdq xmm3, xmm4
+            codegen_vector_op_x86_64(codegen, 0xd4, 1, 0);     // paddq xmm1, xmm0
+            codegen_vector_op_x86_64(codegen, 0xd4, 1, 3);     // paddq xmm1, xmm3
+        } else {
+            codegen_vector_op_x86_64(codegen, add_opcode, 1, 0);  // padd xmm1, xmm0
+        }
+    } else {
+        if (vector->lhs != NULL) {
+            codegen_vector_memory_x86_64(codegen, 0x6f, 0, r11, size);  // movdqu xmm0, [r11 + r8 * size]
+            int32_t src = 2;
+            if (!vector->is_rhs_scalar) {
+                codegen_vector_memory_x86_64(codegen, 0x6f, 3, rdx, size);  // movdqu xmm3, [rdx + r8 * size]
+                src = 3;
+            }
+            if (vector->operation == NODE_ADD) codegen_vector_op_x86_64(codegen, add_opcode, 0, src);  // padd xmm0, src
+            if (vector->operation == NODE_SUB) codegen_vector_op_x86_64(codegen, sub_opcode, 0, src);  // psub xmm0, src
+            if (vector->operation == NODE_AND) codegen_vector_op_x86_64(codegen, 0xdb, 0, src);        // pand xmm0, src
+            if (vector->operation == NODE_OR) codegen_vector_op_x86_64(codegen, 0xeb, 0, src);         // por xmm0, src
+            if (vector->operation == NODE_XOR) codegen_vector_op_x86_64(codegen, 0xef, 0, src);        // pxor xmm0, src
+        } else if (vector->is_rhs_scalar) {
+            codegen_vector_op_x86_64(codegen, 0x6f, 0, 2);  // movdqa xmm0, xmm2
+        } else {
+            codegen_vector_memory_x86_64(codegen, 0x6f, 0, rdx, size);  // movdqu xmm0, [rdx + r8 * size]
+        }
+        codegen_vector_memory_x86_64(codegen, 0x7f, 0, r10, size);  // movdqu [r10 + r8 * size], xmm0
+    }
+
+    inst3(0x49, 0x89, 0xc0);  // mov r8, rax
+    inst1(0xe9);              // jmp loop
+    label_branch(codegen, &loop_label, LABEL_FIXUP_X86_64_REL32, 0);
+
+    label_place(codegen, &done_label);  // done:
+
+    if (type->size == 1) inst3(0x44, 0x88, 0x85);        // mov byte [rbp - imm], r8b
+    if (type->size == 2) inst4(0x66, 0x44, 0x89, 0x85);  // mov word [rbp - imm], r8w
+    if (type->size == 4) inst3(0x44, 0x89, 0x85);        // mov dword [rbp - imm], r8d
+    if (type->size == 8) inst3(0x4c, 0x89, 0x85);        // mov qword [rbp - imm], r8
+    imm32(-vector->induction->offset);
+
+    // Add the lanes of xmm1 to the accumulator
+    if (vector->accumulator != NULL) {
+        size_t lane_size = size == 1 || size < vector->accumulator->type->size ? 8 : size;
+        inst4(0x48, 0x83, 0xec, 32);  // sub rsp, 32
+        if (codegen->has_avx2) {
+            inst3(0xc5, 0xfe, 0x7f);  // vmovdqu [rsp], ymm1
+        } else {
+            inst3(0xf3, 0x0f, 0x7f);  // movdqu [rsp], xmm1
+        }
+        inst2(0x0c, 0x24);
+        inst2(0x31, 0xc0);  // xor eax, eax
+        for (size_t i = 0; i < vector_size / lane_size; i++) {
+            if (lane_size == 2) inst4(0x0f, 0xb7, 0x4c, 0x24);        // movzx ecx, word [rsp + imm]
+            if (lane_size == 4) inst3(0x8b, 0x4c, 0x24);              // mov ecx, dword [rsp + imm]
+            if (lane_size == 8) inst4(0x48, 0x8b, 0x4c, 0x24);        // mov rcx, qword [rsp + imm]
+            inst1(i * lane_size);
+            inst3(0x48, 0x01, 0xc8);  // add rax, rcx
+        }
+        inst4(0x48, 0x83, 0xc4, 32);  // add rsp, 32
+
+        Node accumulator = {.kind = NODE_LOCAL, .type = vector->accumulator->type, .local = vector->accumulator};
+        codegen_leaf_rcx_x86_64(codegen, &accumulator);
+        inst3(0x48, 0x01, 0xc8);  // add rax, rcx
+
+        Type *type = vector->accumulator->type;
+        if (type->size == 1) inst2(0x88, 0x85);        // mov byte [rbp - imm], al
+        if (type->size == 2) inst3(0x66, 0x89, 0x85);  // mov word [rbp - imm], ax
+        if (type->size == 4) inst2(0x89, 0x85);        // mov dword [rbp - imm], eax
+        if (type->size == 8) inst3(0x48, 0x89, 0x85);  // mov qword [rbp - imm], rax
+        imm32(-vector->accumulator->offset);
+    }
+    if (codegen->has_avx2) inst3(0xc5, 0xf8, 0x77);  // vzeroupper
+}
+
+// Calls back into the compiler with the argument registers saved, the call can happen in the middle of an expression
+// so the stack is aligned here, the returned code address is left in rax
+static void codegen_runtime_call_x86_64(Codegen *codegen, void *argument, CodegenRuntimeFunc runtime_function) {
+    inst1(0x50 | (rbp & 7));  // push rbp
+    inst3(0x48, 0x89, 0xe5);  // mov rbp, rsp
+#ifdef _WIN32
+    inst1(0x50 | (rcx & 7));        // push rcx
+    inst1(0x50 | (rdx & 7));        // push rdx
+    inst2(0x41, 0x50 | (r8 & 7));   // push r8
+    inst2(0x41, 0x50 | (r9 & 7));   // push r9
+    inst4(0x48, 0x83, 0xe4, 0xf0);  // and rsp, -16
+    inst4(0x48, 0x83, 0xec, 0x20);  // sub rsp, 32
+    inst2(0x48, 0xb8 | (rcx & 7));  // movabs rcx, imm
+    imm64((int64_t)codegen);
+    inst2(0x48, 0xb8 | (rdx & 7));  // movabs rdx, imm
+    imm64((int64_t)argument);
+#else
+    inst1(0x50 | (rdi & 7));        // push rdi
+    inst1(0x50 | (rsi & 7));        // push rsi
+    inst1(0x50 | (rdx & 7));        // push rdx
+    inst1(0x50 | (rcx & 7));        // push rcx
+    inst4(0x48, 0x83, 0xe4, 0xf0);  // and rsp, -16
+    inst2(0x48, 0xb8 | (rdi & 7));  // movabs rdi, imm
+    imm64((int64_t)codegen);
+    inst2(0x48, 0xb8 | (rsi & 7));  // movabs rsi, imm
+    imm64((int64_t)argument);
+#endif
+    inst2(0x48, 0xb8 | (rax & 7));  // movabs rax, imm
+    imm64((int64_t)runtime_function);
+    inst2(0xff, 0xd0);              // call rax
+    inst4(0x48, 0x8d, 0x65, 0xe0);  // lea rsp, [rbp - 32]
+#ifdef _WIN32
+    inst2(0x41, 0x58 | (r9 & 7));  // pop r9
+    inst2(0x41, 0x58 | (r8 & 7));  // pop r8
+    inst1(0x58 | (rdx & 7));       // pop rdx
+    inst1(0x58 | (rcx & 7));       // pop rcx
+#else
+    inst1(0x58 | (rcx & 7));  // pop rcx
+    inst1(0x58 | (rdx & 7));  // pop rdx
+    inst1(0x58 | (rsi & 7));  // pop rsi
+    inst1(0x58 | (rdi & 7));  // pop rdi
+#endif
+    inst1(0x58 | (rbp & 7));  // pop rbp
+}
+
+// Patchable entries are 8 byte aligned so a jump can be written over them with one store
+static void codegen_align_entry_x86_64(Codegen *codegen) {
+    while ((uintptr_t)codegen->code_byte_ptr % sizeof(uint64_t) != 0) inst1(0xcc);  // int3
+}
+
+// Lazy functions start as a stub that lets the compiler compile the function
+void codegen_stub_x86_64(Codegen *codegen, Function *function) {
+    codegen_align_entry_x86_64(codegen);
+    function->address = codegen->code_byte_ptr;
+    function->stub_address = codegen->code_byte_ptr;
+    codegen_runtime_call_x86_64(codegen, function, codegen_compile_function);
+    inst2(0xff, 0xe0);  // jmp rax
+}
+
+void codegen_patch_jump_x86_64(uint8_t *address, uint8_t *target) {
+    uint64_t code = *((uint64_t *)address);
+    int32_t distance = target - (address + 1 + sizeof(int32_t));
+    code = (code & ~(uint64_t)0xffffffffff) | 0xe9 | ((uint64_t)(uint32_t)distance << 8);  // jmp target
+    __atomic_store_n((uint64_t *)address, code, __ATOMIC_RELEASE);
+}
+
+// Baseline code counts calls and loop iterations, when the counter runs out the function is recompiled optimized,
+// loops that support on-stack replacement keep checking the counter and continue in optimized code
+static void codegen_counter_x86_64(Codegen *codegen, bool is_entry, CodegenOsr *osr) {
+    Function *function = codegen->current_function;
+    inst2(0x83, 0x2d);  // sub dword [rip + imm], 1
+    imm32((uint8_t *)function->counter - (codegen->code_byte_ptr + sizeof(int32_t) + 1));
+    inst1(1);
+    inst1(osr != NULL ? 0x7f : 0x75);  // jg done or jnz done
+    Label done_label = {0};
+    label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL8, 0);
+
+    if (osr != NULL) {
+        codegen_runtime_call_x86_64(codegen, osr, codegen_osr_function);
+        inst2(0xff, 0xe0);  // jmp rax
+    } else {
+        codegen_runtime_call_x86_64(codegen, function, codegen_tier_up_function);
+        if (is_entry) inst2(0xff, 0xe0);  // jmp rax
+    }
+
+    label_place(codegen, &done_label);  // done:
+}
+
 void codegen_func_x86_64(Codegen *codegen, Function *function) {
     codegen->current_function = function;
+    // On-stack replacement code is only the rest of a function, its caller looks at the whole function
+    if (!codegen->is_osr_entry) codegen->has_escaped_locals = codegen_has_escaped_locals(function);
 
     // Set function ptr to current code offset
+    if (codegen_is_baseline(codegen)) codegen_align_entry_x86_64(codegen);
     function->address = codegen->code_byte_ptr;
+    if (codegen_is_baseline(codegen)) codegen_counter_x86_64(codegen, true, NULL);
 
     // Set main address
     if (!strcmp(function->name, "main")) {
@@ -53,12 +414,23 @@ void codegen_func_x86_64(Codegen *codegen, Function *function) {
 
     // Allocate locals stack frame
     size_t aligned_locals_size = align(function->locals_size, 16);
-    if (aligned_locals_size > 0) {
+    codegen->body_frame = (FunctionFrame){.cfa_offset = 8};
+    if (codegen->is_osr_entry) {
+        codegen->body_frame = (FunctionFrame){.is_frame_based = true, .cfa_offset = 16, .fp_offset = -16};
+        codegen_add_frame(codegen, codegen->code_byte_ptr, codegen->body_frame);
+        inst3(0x48, 0x89, 0xec);  // mov rsp, rbp
+        inst3(0x48, 0x81, 0xec);  // sub rsp, imm
+        imm32(aligned_locals_size);
+    } else if (codegen_has_frame_x86_64(function)) {
         inst1(0x50 | (rbp & 7));  // push rbp
+        codegen_add_frame(codegen, codegen->code_byte_ptr, (FunctionFrame){.cfa_offset = 16, .fp_offset = -16});
         inst3(0x48, 0x89, 0xe5);  // mov rbp, rsp
+        codegen->body_frame = (FunctionFrame){.is_frame_based = true, .cfa_offset = 16, .fp_offset = -16};
+        codegen_add_frame(codegen, codegen->code_byte_ptr, codegen->body_frame);
         inst3(0x48, 0x81, 0xec);  // sub rsp, imm
         imm32(aligned_locals_size);
     }
+    codegen->body_byte_ptr = codegen->code_byte_ptr;
 
     // Write arguments to locals
     for (int32_t i = function->arguments_names.size - 1; i >= 0; i--) {
@@ -125,63 +497,90 @@ void codegen_stat_x86_64(Codegen *codegen, Node *node) {
     }
 
     // Statements
+    codegen_add_line(codegen, node->token, codegen->code_byte_ptr);
     if (node->kind == NODE_IF) {
         codegen_expr_x86_64(codegen, node->condition);
         inst4(0x48, 0x83, 0xf8, 0x00);  // cmp rax, 0
         inst2(0x0f, 0x84);              // je else
-        uint8_t *else_label = codegen->code_byte_ptr;
-        imm32(0);
+        Label else_label = {0};
+        label_branch(codegen, &else_label, LABEL_FIXUP_X86_64_REL32, 0);
 
         codegen_stat_x86_64(codegen, node->then_block);
 
-        uint8_t *done_label;
+        Label done_label = {0};
         if (node->else_block) {
             inst1(0xe9);  // jmp done
-            done_label = codegen->code_byte_ptr;
-            imm32(0);
+            label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL32, 0);
         }
 
-        *((int32_t *)else_label) = codegen->code_byte_ptr - (else_label + sizeof(int32_t));  // else:
+        label_place(codegen, &else_label);  // else:
         if (node->else_block) {
             codegen_stat_x86_64(codegen, node->else_block);
 
-            *((int32_t *)done_label) = codegen->code_byte_ptr - (done_label + sizeof(int32_t));  // done:
+            label_place(codegen, &done_label);  // done:
         }
         return;
     }
 
     if (node->kind == NODE_WHILE) {
-        uint8_t *loop_label = codegen->code_byte_ptr;
+        Label loop_label = {0};
+        label_place(codegen, &loop_label);  // loop:
 
-        uint8_t *done_label;
+        Label done_label = {0};
         if (node->condition != NULL) {
             codegen_expr_x86_64(codegen, node->condition);
             inst4(0x48, 0x83, 0xf8, 0x00);  // cmp rax, 0
             inst2(0x0f, 0x84);              // je done
-            done_label = codegen->code_byte_ptr;
-            imm32(0);
+            label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL32, 0);
         }
 
         codegen_stat_x86_64(codegen, node->then_block);
 
+        if (codegen_is_baseline(codegen)) codegen_counter_x86_64(codegen, false, codegen_find_osr(codegen, node));
         inst1(0xe9);  // jmp loop
-        imm32(loop_label - (codegen->code_byte_ptr + sizeof(int32_t)));
+        label_branch(codegen, &loop_label, LABEL_FIXUP_X86_64_REL32, 0);
 
-        if (node->condition != NULL) {
-            *((int32_t *)done_label) = codegen->code_byte_ptr - (done_label + sizeof(int32_t));  // done:
-        }
+        if (node->condition != NULL) label_place(codegen, &done_label);  // done:
         return;
     }
 
     if (node->kind == NODE_DOWHILE) {
-        uint8_t *loop_label = codegen->code_byte_ptr;
+        Label loop_label = {0};
+        label_place(codegen, &loop_label);  // loop:
 
         codegen_stat_x86_64(codegen, node->then_block);
+        if (codegen_is_baseline(codegen)) codegen_counter_x86_64(codegen, false, NULL);
 
         codegen_expr_x86_64(codegen, node->condition);
         inst4(0x48, 0x83, 0xf8, 0x00);  // cmp rax, 0
         inst2(0x0f, 0x85);              // jne loop
-        imm32(loop_label - (codegen->code_byte_ptr + sizeof(int32_t)));
+        label_branch(codegen, &loop_label, LABEL_FIXUP_X86_64_REL32, 0);
+        return;
+    }
+
+    if (node->kind == NODE_VECTOR) {
+        codegen_vector_x86_64(codegen, node->vector);
+        return;
+    }
+
+    if (node->kind == NODE_RETURN && codegen_is_tail_call_x86_64(codegen, node->unary)) {
+        Node *call = node->unary;
+        codegen_call_arguments_x86_64(codegen, call);
+        if (call->function == codegen->current_function) {
+            if (codegen_is_baseline(codegen)) codegen_counter_x86_64(codegen, false, NULL);
+            inst1(0xe9);  // jmp body
+            imm32(codegen->body_byte_ptr - (codegen->code_byte_ptr + sizeof(int32_t)));
+            return;
+        }
+
+        // Free locals stack frame so the sibling function returns to our caller
+        if (codegen_has_frame_x86_64(codegen->current_function)) {
+            inst3(0x48, 0x89, 0xec);  // mov rsp, rbp
+            inst1(0x58 | (rbp & 7));  // pop rbp
+            codegen_add_frame(codegen, codegen->code_byte_ptr, (FunctionFrame){.cfa_offset = 8});
+        }
+        codegen_branch_x86_64(codegen, call->function, false);
+        codegen_add_frame(codegen, codegen->code_byte_ptr, codegen->body_frame);
         return;
     }
 
@@ -189,11 +588,13 @@ void codegen_stat_x86_64(Codegen *codegen, Node *node) {
         codegen_expr_x86_64(codegen, node->unary);
 
         // Free locals stack frame
-        if (codegen->current_function->locals_size > 0) {
+        if (codegen_has_frame_x86_64(codegen->current_function)) {
             inst3(0x48, 0x89, 0xec);  // mov rsp, rbp
             inst1(0x58 | (rbp & 7));  // pop rbp
+            codegen_add_frame(codegen, codegen->code_byte_ptr, (FunctionFrame){.cfa_offset = 8});
         }
         inst1(0xc3);  // ret
+        codegen_add_frame(codegen, codegen->code_byte_ptr, codegen->body_frame);
         return;
     }
 
@@ -202,8 +603,7 @@ void codegen_stat_x86_64(Codegen *codegen, Node *node) {
 
 void codegen_addr_x86_64(Codegen *codegen, Node *node) {
     if (node->kind == NODE_GLOBAL) {
-        inst3(0x48, 0x8d, 0x05);  // lea rax, [rip + imm]
-        imm32((uint8_t *)node->global->address - (codegen->code_byte_ptr + sizeof(int32_t)));
+        codegen_global_x86_64(codegen, node->global);
         return;
     }
     if (node->kind == NODE_LOCAL) {
@@ -225,20 +625,20 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
         codegen_expr_x86_64(codegen, node->condition);
         inst4(0x48, 0x83, 0xf8, 0x00);  // cmp rax, 0
         inst2(0x0f, 0x84);              // je else
-        uint8_t *else_label = codegen->code_byte_ptr;
-        imm32(0);
+        Label else_label = {0};
+        label_branch(codegen, &else_label, LABEL_FIXUP_X86_64_REL32, 0);
 
         codegen_expr_x86_64(codegen, node->then_block);
 
         inst1(0xe9);  // jmp done
-        uint8_t *done_label = codegen->code_byte_ptr;
-        imm32(0);
+        Label done_label = {0};
+        label_branch(codegen, &done_label, LABEL_FIXUP_X86_64_REL32, 0);
 
-        *((int32_t *)else_label) = codegen->code_byte_ptr - (else_label + sizeof(int32_t));  // else:
+        label_place(codegen, &else_label);  // else:
 
         codegen_expr_x86_64(codegen, node->else_block);
 
-        *((int32_t *)done_label) = codegen->code_byte_ptr - (done_label + sizeof(int32_t));  // done:
+        label_place(codegen, &done_label);  // done:
         return;
     }
 
@@ -252,8 +652,12 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
         codegen_expr_x86_64(codegen, node->unary);
 
         // When array in array just return the pointer
-        if (node->type->kind != TYPE_ARRAY) {
-            inst3(0x48, 0x8b, 0x00);  // mov rax, qword [rax]
+        Type *type = node->type;
+        if (type->kind != TYPE_ARRAY) {
+            if (type->size == 1) inst4(0x48, 0x0f, 0xb6, 0x00);  // movzx rax, byte [rax]
+            if (type->size == 2) inst4(0x48, 0x0f, 0xb7, 0x00);  // movzx rax, word [rax]
+            if (type->size == 4) inst2(0x8b, 0x00);              // mov eax, dword [rax]
+            if (type->size == 8) inst3(0x48, 0x8b, 0x00);        // mov rax, qword [rax]
         }
         return;
     }
@@ -273,14 +677,32 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
 
     // Operators
     if (node->kind == NODE_ASSIGN) {
+        // Locals are stored directly relative to the frame pointer
+        if (node->lhs->kind == NODE_LOCAL) {
+            codegen_expr_x86_64(codegen, node->rhs);
+
+            Type *type = node->lhs->type;
+            if (type->size == 1) inst2(0x88, 0x85);        // mov byte [rbp - imm], al
+            if (type->size == 2) inst3(0x66, 0x89, 0x85);  // mov word [rbp - imm], ax
+            if (type->size == 4) inst2(0x89, 0x85);        // mov dword [rbp - imm], eax
+            if (type->size == 8) inst3(0x48, 0x89, 0x85);  // mov qword [rbp - imm], rax
+            imm32(-node->lhs->local->offset);
+            return;
+        }
+
         codegen_addr_x86_64(codegen, node->lhs);
-        inst1(0x50 | (rax & 7));  // push rax
+        if (codegen_is_leaf_x86_64(node->rhs)) {
+            inst3(0x48, 0x89, 0xc1);  // mov rcx, rax
+            codegen_expr_x86_64(codegen, node->rhs);
+        } else {
+            inst1(0x50 | (rax & 7));  // push rax
 
-        codegen_expr_x86_64(codegen, node->rhs);
-        inst1(0x58 | (rcx & 7));  // pop rcx
+            codegen_expr_x86_64(codegen, node->rhs);
+            inst1(0x58 | (rcx & 7));  // pop rcx
+        }
 
         Type *type = node->lhs->type;
-        if (type->size == 1) inst3(0x88, 0x41, 0x01);  // mov byte [rcx], al
+        if (type->size == 1) inst2(0x88, 0x01);        // mov byte [rcx], al
         if (type->size == 2) inst3(0x66, 0x89, 0x01);  // mov word [rcx], ax
         if (type->size == 4) inst2(0x89, 0x01);        // mov dword [rcx], eax
         if (type->size == 8) inst3(0x48, 0x89, 0x01);  // mov qword [rcx], rax
@@ -288,11 +710,16 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
     }
 
     if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
-        codegen_expr_x86_64(codegen, node->rhs);
-        inst1(0x50 | (rax & 7));  // push rax
+        if (codegen_is_leaf_x86_64(node->rhs)) {
+            codegen_expr_x86_64(codegen, node->lhs);
+            codegen_leaf_rcx_x86_64(codegen, node->rhs);
+        } else {
+            codegen_expr_x86_64(codegen, node->rhs);
+            inst1(0x50 | (rax & 7));  // push rax
 
-        codegen_expr_x86_64(codegen, node->lhs);
-        inst1(0x58 | (rcx & 7));  // pop rcx
+            codegen_expr_x86_64(codegen, node->lhs);
+            inst1(0x58 | (rcx & 7));  // pop rcx
+        }
 
         if (node->kind == NODE_ADD) inst3(0x48, 0x01, 0xc8);        // add rax, rcx
         if (node->kind == NODE_SUB) inst3(0x48, 0x29, 0xc8);        // sub rax, rcx
@@ -340,8 +767,7 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
         if (type->kind == TYPE_ARRAY) {
             codegen_addr_x86_64(codegen, node);
         } else {
-            inst3(0x48, 0x8d, 0x05);  // lea rax, [rip + imm]
-            imm32((uint8_t *)node->global->address - (codegen->code_byte_ptr + sizeof(int32_t)));
+            codegen_global_x86_64(codegen, node->global);
             if (type->size == 1) inst2(0x8a, 0x00);              // mov al, byte [rax]
             if (type->size == 2) inst3(0x66, 0x8b, 0x00);        // mov ax, word [rax]
             if (type->size == 4) inst2(0x8b, 0x00);              // mov eax, dword [rax]
@@ -370,9 +796,12 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
     }
 
     if (node->kind == NODE_INTEGER) {
-        if (node->integer > INT32_MIN && node->integer < INT32_MAX) {
+        if (node->integer >= 0 && node->integer < INT32_MAX) {
             inst1(0xb8 | (rax & 7));  // mov eax, imm
             imm32(node->integer);
+        } else if (node->integer > INT32_MIN && node->integer < 0) {
+            inst3(0x48, 0xc7, 0xc0 | (rax & 7));  // mov rax, imm
+            imm32(node->integer);
         } else {
             inst2(0x48, 0xb8 | (rax & 7));  // movabs rax, imm
             imm64(node->integer);
@@ -381,37 +810,13 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
     }
 
     if (node->kind == NODE_CALL) {
-        // Write arguments to registers
-        for (int32_t i = node->nodes.size - 1; i >= 0; i--) {
-            Node *argument = node->nodes.items[i];
-            codegen_expr_x86_64(codegen, argument);
-
-#ifdef _WIN32
-            if (i == 0) inst3(0x48, 0x89, 0xc1);  // mov rcx, rax
-            if (i == 1) inst3(0x48, 0x89, 0xc2);  // mov rdx, rax
-            if (i == 2) inst3(0x49, 0x89, 0xc0);  // mov r8, rax
-            if (i == 3) inst3(0x49, 0x89, 0xc1);  // mov r9, rax
-#else
-            if (i == 0) inst3(0x48, 0x89, 0xc7);  // mov rdi, rax
-            if (i == 1) inst3(0x48, 0x89, 0xc6);  // mov rsi, rax
-            if (i == 2) inst3(0x48, 0x89, 0xc2);  // mov rdx, rax
-            if (i == 3) inst3(0x48, 0x89, 0xc1);  // mov rcx, rax
-#endif
-        }
+        codegen_call_arguments_x86_64(codegen, node);
 
 #ifdef _WIN32
         inst4(0x48, 0x83, 0xec, 0x20);  // sub rsp, 32
 #endif
 
-        int64_t distance = (uint8_t *)node->function->address - (codegen->code_byte_ptr + 1 + sizeof(int32_t));
-        if (distance < INT32_MIN || distance > INT32_MAX) {
-            inst2(0x48, 0xb8 | (rax & 7));  // movabs rax, imm
-            imm64((int64_t)node->function->address);
-            inst2(0xff, 0xd0);  // call rax
-        } else {
-            inst1(0xe8);  // call function
-            imm32(distance);
-        }
+        codegen_branch_x86_64(codegen, node->function, true);
 
 #ifdef _WIN32
         inst4(0x48, 0x83, 0xc4, 0x20);  // add rsp, 32
@@ -420,5 +825,5 @@ void codegen_expr_x86_64(Codegen *codegen, Node *node) {
     }
 
     print_error(node->token, "Unknown node kind");
-    exit(EXIT_FAILURE);
+    codegen->has_errors = true;
 }
@@ -0,0 +1,328 @@
+#include "debugger.h"
+
+#include <string.h>
+
+#include "linker.h"
+#include "utils/arena.h"
+#include "utils/utils.h"
+
+#ifdef _WIN32
+#define DEBUGGER_EXPORT
+#else
+#define DEBUGGER_EXPORT __attribute__((visibility("default")))
+#endif
+
+// The debugger sets a breakpoint on this function and reads the descriptor when it is hit, so both keep these names
+DEBUGGER_EXPORT DebuggerDescriptor __jit_debug_descriptor = {.version = 1};
+
+DEBUGGER_EXPORT __attribute__((noinline)) void __jit_debug_register_code(void) { __asm__ volatile(""); }
+
+static bool debugger_lock = false;
+
+// DWARF encoding
+static void debugger_byte(Buffer *buffer, uint8_t byte) { buffer_write(buffer, &byte, sizeof(uint8_t)); }
+
+static void debugger_uleb(Buffer *buffer, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        debugger_byte(buffer, value != 0 ? byte | 0x80 : byte);
+    } while (value != 0);
+}
+
+static void debugger_sleb(Buffer *buffer, int64_t value) {
+    for (;;) {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+            debugger_byte(buffer, byte);
+            return;
+        }
+        debugger_byte(buffer, byte | 0x80);
+    }
+}
+
+// Pads a call frame entry with nops to 8 bytes and writes its length
+static void debugger_end_frame_entry(Buffer *buffer, size_t entry) {
+    while ((buffer->size - entry) % 8 != 0) debugger_byte(buffer, 0);
+    uint32_t length = buffer->size - entry - sizeof(uint32_t);
+    memcpy(buffer->data + entry, &length, sizeof(uint32_t));
+}
+
+// Call frame information
+size_t debugger_write_eh_frame(Buffer *buffer, Arch arch, Function *function, bool has_header) {
+    bool is_x86_64 = arch == ARCH_X86_64;
+    uint8_t sp_register = is_x86_64 ? 7 : 31;
+    uint8_t fp_register = is_x86_64 ? 6 : 29;
+    uint8_t lr_register = is_x86_64 ? 16 : 30;
+    uint32_t code_alignment = is_x86_64 ? 1 : 4;
+    size_t start = buffer->size;
+    uint64_t eh_frame_address = (uintptr_t)function->address + align(function->size, 8);
+
+    // The return address is on top of the stack of the caller on x86_64 and in the link register on arm64
+    size_t cie = buffer_write(buffer, NULL, sizeof(uint32_t));
+    buffer_write(buffer, &(uint32_t){0}, sizeof(uint32_t));
+    debugger_byte(buffer, 1);
+    buffer_write(buffer, "zR", 3);
+    debugger_uleb(buffer, code_alignment);
+    debugger_sleb(buffer, -8);
+    debugger_uleb(buffer, lr_register);
+    debugger_uleb(buffer, 1);
+    debugger_byte(buffer, DWARF_EH_PE_PCREL_SDATA4);
+    debugger_byte(buffer, DWARF_CFA_DEF_CFA);
+    debugger_uleb(buffer, sp_register);
+    debugger_uleb(buffer, is_x86_64 ? 8 : 0);
+    if (is_x86_64) {
+        debugger_byte(buffer, DWARF_CFA_OFFSET | lr_register);
+        debugger_uleb(buffer, 1);
+    }
+    debugger_end_frame_entry(buffer, cie);
+
+    // Every frame row is written out whole
+    size_t fde = buffer_write(buffer, NULL, sizeof(uint32_t));
+    buffer_write(buffer, &(uint32_t){buffer->size - cie}, sizeof(uint32_t));
+    buffer_write(buffer, &(int32_t){(uintptr_t)function->address - (eh_frame_address + buffer->size - start)}, sizeof(int32_t));
+    buffer_write(buffer, &(uint32_t){function->size}, sizeof(uint32_t));
+    debugger_uleb(buffer, 0);
+    uint8_t *address = function->address;
+    for (size_t i = 0; i < function->frames.size; i++) {
+        FunctionFrame *frame = function->frames.items[i];
+        debugger_byte(buffer, DWARF_CFA_ADVANCE_LOC4);
+        buffer_write(buffer, &(uint32_t){(frame->address - address) / code_alignment}, sizeof(uint32_t));
+        address = frame->address;
+        debugger_byte(buffer, DWARF_CFA_DEF_CFA);
+        debugger_uleb(buffer, frame->is_frame_based ? fp_register : sp_register);
+        debugger_uleb(buffer, frame->cfa_offset);
+        if (frame->fp_offset != 0) {
+            debugger_byte(buffer, DWARF_CFA_OFFSET | fp_register);
+            debugger_uleb(buffer, frame->fp_offset / -8);
+        } else {
+            debugger_byte(buffer, DWARF_CFA_RESTORE | fp_register);
+        }
+        if (!is_x86_64 && frame->lr_offset != 0) {
+            debugger_byte(buffer, DWARF_CFA_OFFSET | lr_register);
+            debugger_uleb(buffer, frame->lr_offset / -8);
+        } else if (!is_x86_64) {
+            debugger_byte(buffer, DWARF_CFA_RESTORE | lr_register);
+        }
+    }
+    debugger_end_frame_entry(buffer, fde);
+    buffer_write(buffer, &(uint32_t){0}, sizeof(uint32_t));
+    if (!has_header) return 0;
+
+    // The header has a sorted table with one function
+    size_t header = buffer->size;
+    uint64_t header_address = eh_frame_address + header - start;
+    debugger_byte(buffer, 1);
+    debugger_byte(buffer, DWARF_EH_PE_PCREL_SDATA4);
+    debugger_byte(buffer, DWARF_EH_PE_UDATA4);
+    debugger_byte(buffer, DWARF_EH_PE_DATAREL_SDATA4);
+    buffer_write(buffer, &(int32_t){eh_frame_address - (header_address + sizeof(uint32_t))}, sizeof(int32_t));
+    buffer_write(buffer, &(uint32_t){1}, sizeof(uint32_t));
+    buffer_write(buffer, &(int32_t){(uintptr_t)function->address - header_address}, sizeof(int32_t));
+    buffer_write(buffer, &(int32_t){eh_frame_address + (fde - start) - header_address}, sizeof(int32_t));
+    return buffer->size - header;
+}
+
+// Line table, a row for every statement line with its column and file
+static int64_t debugger_file_index(List *sources, Source *source) {
+    for (size_t i = 0; i < sources->size; i++) {
+        if (sources->items[i] == source) return i + 1;
+    }
+    return 0;
+}
+
+static void debugger_write_debug_line(Buffer *buffer, Function *function) {
+    size_t start = buffer_write(buffer, NULL, sizeof(uint32_t));
+    buffer_write(buffer, &(uint16_t){2}, sizeof(uint16_t));
+    size_t header_length = buffer_write(buffer, NULL, sizeof(uint32_t));
+    uint8_t parameters[] = {1, 1, (uint8_t)-5, 14, 13, 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1};
+    buffer_write(buffer, parameters, sizeof(parameters));
+    debugger_byte(buffer, 0);
+
+    List sources = {0};
+    list_init(&sources);
+    for (size_t i = 0; i < function->lines.size; i++) {
+        FunctionLine *line = function->lines.items[i];
+        if (debugger_file_index(&sources, line->token->source) != 0) continue;
+        list_add(&sources, line->token->source);
+        buffer_write(buffer, line->token->source->path, strlen(line->token->source->path) + 1);
+        debugger_uleb(buffer, 0);
+        debugger_uleb(buffer, 0);
+        debugger_uleb(buffer, 0);
+    }
+    debugger_byte(buffer, 0);
+    memcpy(buffer->data + header_length, &(uint32_t){buffer->size - header_length - sizeof(uint32_t)}, sizeof(uint32_t));
+
+    debugger_byte(buffer, 0);
+    debugger_uleb(buffer, 1 + sizeof(uint64_t));
+    debugger_byte(buffer, DWARF_LNE_SET_ADDRESS);
+    buffer_write(buffer, &(uint64_t){(uintptr_t)function->address}, sizeof(uint64_t));
+    uint8_t *address = function->address;
+    int64_t file = 1;
+    int64_t line_number = 1;
+    for (size_t i = 0; i < function->lines.size; i++) {
+        FunctionLine *line = function->lines.items[i];
+        int64_t line_file = debugger_file_index(&sources, line->token->source);
+        if (line_file != file) {
+            debugger_byte(buffer, DWARF_LNS_SET_FILE);
+            debugger_uleb(buffer, line_file);
+            file = line_file;
+        }
+        debugger_byte(buffer, DWARF_LNS_ADVANCE_LINE);
+        debugger_sleb(buffer, line->token->line - line_number);
+        line_number = line->token->line;
+        debugger_byte(buffer, DWARF_LNS_SET_COLUMN);
+        debugger_uleb(buffer, line->token->column);
+        debugger_byte(buffer, DWARF_LNS_ADVANCE_PC);
+        debugger_uleb(buffer, line->address - address);
+        address = line->address;
+        debugger_byte(buffer, DWARF_LNS_COPY);
+    }
+    debugger_byte(buffer, DWARF_LNS_ADVANCE_PC);
+    debugger_uleb(buffer, function->address + function->size - address);
+    debugger_byte(buffer, 0);
+    debugger_uleb(buffer, 1);
+    debugger_byte(buffer, DWARF_LNE_END_SEQUENCE);
+    memcpy(buffer->data + start, &(uint32_t){buffer->size - start - sizeof(uint32_t)}, sizeof(uint32_t));
+    list_free(&sources, NULL);
+}
+
+// A compile unit with one subprogram that points to the line table
+static void debugger_write_debug_info(Buffer *info, Buffer *abbrev, Function *function, char *name) {
+    uint8_t abbreviations[] = {
+        1, DWARF_TAG_COMPILE_UNIT, 1,
+        DWARF_AT_NAME, DWARF_FORM_STRING, DWARF_AT_LANGUAGE, DWARF_FORM_DATA1, DWARF_AT_LOW_PC, DWARF_FORM_ADDR,
+        DWARF_AT_HIGH_PC, DWARF_FORM_ADDR, DWARF_AT_STMT_LIST, DWARF_FORM_DATA4, 0, 0,
+        2, DWARF_TAG_SUBPROGRAM, 0,
+        DWARF_AT_NAME, DWARF_FORM_STRING, DWARF_AT_LOW_PC, DWARF_FORM_ADDR, DWARF_AT_HIGH_PC, DWARF_FORM_ADDR, 0, 0,
+        0,
+    };
+    buffer_write(abbrev, abbreviations, sizeof(abbreviations));
+
+    uint64_t low_pc = (uintptr_t)function->address;
+    uint64_t high_pc = low_pc + function->size;
+    char *path = function->lines.size > 0 ? ((FunctionLine *)function->lines.items[0])->token->source->path : name;
+    size_t start = buffer_write(info, NULL, sizeof(uint32_t));
+    buffer_write(info, &(uint16_t){2}, sizeof(uint16_t));
+    buffer_write(info, &(uint32_t){0}, sizeof(uint32_t));
+    debugger_byte(info, sizeof(uint64_t));
+    debugger_uleb(info, 1);
+    buffer_write(info, path, strlen(path) + 1);
+    debugger_byte(info, DWARF_LANG_C99);
+    buffer_write(info, &low_pc, sizeof(uint64_t));
+    buffer_write(info, &high_pc, sizeof(uint64_t));
+    buffer_write(info, &(uint32_t){0}, sizeof(uint32_t));
+    debugger_uleb(info, 2);
+    buffer_write(info, name, strlen(name) + 1);
+    buffer_write(info, &low_pc, sizeof(uint64_t));
+    buffer_write(info, &high_pc, sizeof(uint64_t));
+    debugger_byte(info, 0);
+    memcpy(info->data + start, &(uint32_t){info->size - start - sizeof(uint32_t)}, sizeof(uint32_t));
+}
+
+// In-memory object
+typedef enum DebuggerSection {
+    DEBUGGER_SECTION_NULL,
+    DEBUGGER_SECTION_TEXT,
+    DEBUGGER_SECTION_EH_FRAME,
+    DEBUGGER_SECTION_DEBUG_ABBREV,
+    DEBUGGER_SECTION_DEBUG_INFO,
+    DEBUGGER_SECTION_DEBUG_LINE,
+    DEBUGGER_SECTION_SYMTAB,
+    DEBUGGER_SECTION_STRTAB,
+    DEBUGGER_SECTION_SHSTRTAB,
+    DEBUGGER_SECTIONS_SIZE,
+} DebuggerSection;
+
+static char *debugger_section_names[DEBUGGER_SECTIONS_SIZE] = {
+    "", ".text", ".eh_frame", ".debug_abbrev", ".debug_info", ".debug_line", ".symtab", ".strtab", ".shstrtab",
+};
+
+// The code stays where it is, the object only describes it so its text section has no bytes
+static DebuggerEntry *debugger_entry_new(Arch arch, Function *function, char *name) {
+    Buffer sections[DEBUGGER_SECTIONS_SIZE] = {0};
+    debugger_write_eh_frame(&sections[DEBUGGER_SECTION_EH_FRAME], arch, function, false);
+    debugger_write_debug_info(&sections[DEBUGGER_SECTION_DEBUG_INFO], &sections[DEBUGGER_SECTION_DEBUG_ABBREV], function, name);
+    debugger_write_debug_line(&sections[DEBUGGER_SECTION_DEBUG_LINE], function);
+    buffer_write(&sections[DEBUGGER_SECTION_STRTAB], "", 1);
+    buffer_write(&sections[DEBUGGER_SECTION_SYMTAB], &(ElfSymbol){0}, sizeof(ElfSymbol));
+    ElfSymbol symbol = {.name = buffer_write(&sections[DEBUGGER_SECTION_STRTAB], name, strlen(name) + 1),
+                        .info = (ELF_SYMBOL_GLOBAL << 4) | ELF_SYMBOL_FUNC,
+                        .shndx = DEBUGGER_SECTION_TEXT,
+                        .size = function->size};
+    buffer_write(&sections[DEBUGGER_SECTION_SYMTAB], &symbol, sizeof(ElfSymbol));
+
+    ElfSectionHeader headers[DEBUGGER_SECTIONS_SIZE] = {
+        [DEBUGGER_SECTION_TEXT] = {.type = ELF_SECTION_NOBITS,
+                                   .flags = ELF_FLAG_ALLOC | ELF_FLAG_EXECINSTR,
+                                   .addr = (uintptr_t)function->address,
+                                   .size = function->size,
+                                   .addralign = 1},
+        [DEBUGGER_SECTION_EH_FRAME] = {.type = ELF_SECTION_PROGBITS,
+                                       .flags = ELF_FLAG_ALLOC,
+                                       .addr = (uintptr_t)function->address + align(function->size, 8),
+                                       .addralign = 8},
+        [DEBUGGER_SECTION_DEBUG_ABBREV] = {.type = ELF_SECTION_PROGBITS, .addralign = 1},
+        [DEBUGGER_SECTION_DEBUG_INFO] = {.type = ELF_SECTION_PROGBITS, .addralign = 1},
+        [DEBUGGER_SECTION_DEBUG_LINE] = {.type = ELF_SECTION_PROGBITS, .addralign = 1},
+        [DEBUGGER_SECTION_SYMTAB] = {.type = ELF_SECTION_SYMTAB,
+                                     .link = DEBUGGER_SECTION_STRTAB,
+                                     .info = 1,
+                                     .addralign = 8,
+                                     .entsize = sizeof(ElfSymbol)},
+        [DEBUGGER_SECTION_STRTAB] = {.type = ELF_SECTION_STRTAB, .addralign = 1},
+        [DEBUGGER_SECTION_SHSTRTAB] = {.type = ELF_SECTION_STRTAB, .addralign = 1},
+    };
+    Buffer file = {0};
+    linker_write_elf_object(&file, arch, sections, headers, debugger_section_names, DEBUGGER_SECTIONS_SIZE);
+    for (DebuggerSection section = DEBUGGER_SECTION_NULL; section < DEBUGGER_SECTIONS_SIZE; section++) arena_release(sections[section].data);
+
+    DebuggerEntry *entry = arena_calloc(1, sizeof(DebuggerEntry));
+    entry->object = file.data;
+    entry->object_size = file.size;
+    entry->address = function->address;
+    return entry;
+}
+
+// Registration
+void debugger_add_function(Arch arch, Function *function, char *name) {
+    // Entries live until their code is freed, not as long as the arena of the compile
+    Arena *previous_arena = arena_swap(NULL);
+    DebuggerEntry *entry = debugger_entry_new(arch, function, name);
+    arena_swap(previous_arena);
+
+    while (__atomic_test_and_set(&debugger_lock, __ATOMIC_ACQUIRE)) {
+    }
+    entry->next = __jit_debug_descriptor.first_entry;
+    if (entry->next != NULL) entry->next->previous = entry;
+    __jit_debug_descriptor.first_entry = entry;
+    __jit_debug_descriptor.relevant_entry = entry;
+    __jit_debug_descriptor.action = DEBUGGER_REGISTER;
+    __jit_debug_register_code();
+    __jit_debug_descriptor.action = DEBUGGER_NO_ACTION;
+    __atomic_clear(&debugger_lock, __ATOMIC_RELEASE);
+}
+
+void debugger_remove_functions(void *start, void *end) {
+    while (__atomic_test_and_set(&debugger_lock, __ATOMIC_ACQUIRE)) {
+    }
+    DebuggerEntry *entry = __jit_debug_descriptor.first_entry;
+    while (entry != NULL) {
+        DebuggerEntry *next = entry->next;
+        if (entry->address >= (uint8_t *)start && entry->address < (uint8_t *)end) {
+            if (entry->previous != NULL) entry->previous->next = entry->next;
+            if (entry->next != NULL) entry->next->previous = entry->previous;
+            if (__jit_debug_descriptor.first_entry == entry) __jit_debug_descriptor.first_entry = entry->next;
+            __jit_debug_descriptor.relevant_entry = entry;
+            __jit_debug_descriptor.action = DEBUGGER_UNREGISTER;
+            __jit_debug_register_code();
+            arena_release(entry->object);
+            arena_release(entry);
+        }
+        entry = next;
+    }
+    __jit_debug_descriptor.action = DEBUGGER_NO_ACTION;
+    __jit_debug_descriptor.relevant_entry = NULL;
+    __atomic_clear(&debugger_lock, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,853 @@
+#include "disassembler.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "linker.h"
+
+static void disassembler_print(DisassemblerInstruction *instruction, char *fmt, ...) {
+    size_t length = strlen(instruction->text);
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(instruction->text + length, sizeof(instruction->text) - length, fmt, args);
+    va_end(args);
+}
+
+static void disassembler_print_immediate(DisassemblerInstruction *instruction, int64_t imm) {
+    if (imm > -0x10000 && imm < 0x10000) {
+        disassembler_print(instruction, "%" PRId64, imm);
+    } else {
+        disassembler_print(instruction, "0x%" PRIx64, (uint64_t)imm);
+    }
+}
+
+// x86_64
+static char *disassembler_x86_64_registers[4][16] = {
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+};
+static char *disassembler_x86_64_high_registers[4] = {"ah", "ch", "dh", "bh"};
+static char *disassembler_x86_64_memory_sizes[4] = {"byte", "word", "dword", "qword"};
+static char *disassembler_x86_64_conditions[16] = {"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"};
+static char *disassembler_x86_64_alu[8] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+static char *disassembler_x86_64_shifts[8] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"};
+
+typedef struct DisassemblerX86_64 {
+    uint8_t *code;
+    size_t size;
+    size_t position;
+    uint64_t address;
+    bool is_invalid;
+    bool has_operand_size;
+    bool has_rep;
+    uint8_t rex;
+    bool is_vex;
+    uint8_t vex_map;
+    uint8_t vex_vvvv;
+    bool vex_l;
+
+    // ModRM, the register field and the register or memory operand it points to
+    uint8_t reg;
+    bool is_memory;
+    uint8_t rm;
+    char memory[64];
+    DisassemblerInstruction *instruction;
+} DisassemblerX86_64;
+
+static uint64_t disassembler_x86_64_fetch(DisassemblerX86_64 *d, size_t size) {
+    if (d->position + size > d->size) {
+        d->is_invalid = true;
+        d->position = d->size;
+        return 0;
+    }
+    uint64_t value = 0;
+    memcpy(&value, d->code + d->position, size);
+    d->position += size;
+    return value;
+}
+
+static int64_t disassembler_x86_64_fetch_signed(DisassemblerX86_64 *d, size_t size) {
+    uint64_t value = disassembler_x86_64_fetch(d, size);
+    if (size == 1) return (int8_t)value;
+    if (size == 2) return (int16_t)value;
+    if (size == 4) return (int32_t)value;
+    return (int64_t)value;
+}
+
+static size_t disassembler_x86_64_size_index(size_t size) { return size == 1 ? 0 : (size == 2 ? 1 : (size == 4 ? 2 : 3)); }
+
+static char *disassembler_x86_64_register(DisassemblerX86_64 *d, uint8_t reg, size_t size) {
+    if (size == 1 && d->rex == 0 && reg >= 4 && reg < 8) return disassembler_x86_64_high_registers[reg - 4];
+    return disassembler_x86_64_registers[disassembler_x86_64_size_index(size)][reg];
+}
+
+// Reads the ModRM byte and its SIB and displacement, rip relative operands need the size of the immediate that follows
+static void disassembler_x86_64_modrm(DisassemblerX86_64 *d, size_t immediate_size) {
+    uint8_t modrm = disassembler_x86_64_fetch(d, 1);
+    uint8_t mod = modrm >> 6;
+    d->reg = ((modrm >> 3) & 7) | ((d->rex & 4) << 1);
+    d->rm = (modrm & 7) | ((d->rex & 1) << 3);
+    d->is_memory = mod != 3;
+    if (!d->is_memory) return;
+
+    char base[8] = "";
+    char index[16] = "";
+    int64_t disp = 0;
+    bool is_rip = false;
+    if ((modrm & 7) == 4) {
+        uint8_t sib = disassembler_x86_64_fetch(d, 1);
+        uint8_t index_reg = ((sib >> 3) & 7) | ((d->rex & 2) << 2);
+        uint8_t base_reg = (sib & 7) | ((d->rex & 1) << 3);
+        if (index_reg != 4) snprintf(index, sizeof(index), "%s * %d", disassembler_x86_64_registers[3][index_reg], 1 << (sib >> 6));
+        if ((sib & 7) == 5 && mod == 0) {
+            disp = disassembler_x86_64_fetch_signed(d, 4);
+        } else {
+            snprintf(base, sizeof(base), "%s", disassembler_x86_64_registers[3][base_reg]);
+        }
+    } else if ((modrm & 7) == 5 && mod == 0) {
+        is_rip = true;
+        disp = disassembler_x86_64_fetch_signed(d, 4);
+    } else {
+        snprintf(base, sizeof(base), "%s", disassembler_x86_64_registers[3][d->rm]);
+    }
+    if (mod == 1) disp = disassembler_x86_64_fetch_signed(d, 1);
+    if (mod == 2) disp = disassembler_x86_64_fetch_signed(d, 4);
+
+    if (is_rip) {
+        snprintf(base, sizeof(base), "rip");
+        d->instruction->has_target = true;
+        d->instruction->target = d->address + d->position + immediate_size + disp;
+    }
+    size_t length = snprintf(d->memory, sizeof(d->memory), "[%s%s%s", base, base[0] != '\0' && index[0] != '\0' ? " + " : "", index);
+    if (base[0] == '\0' && index[0] == '\0') {
+        length += snprintf(d->memory + length, sizeof(d->memory) - length, "%" PRId64, disp);
+    } else if (disp != 0) {
+        length += snprintf(d->memory + length, sizeof(d->memory) - length, " %c %" PRId64, disp < 0 ? '-' : '+', disp < 0 ? -disp : disp);
+    }
+    snprintf(d->memory + length, sizeof(d->memory) - length, "]");
+}
+
+// The register or memory operand, general purpose registers have a size and vector registers none
+static void disassembler_x86_64_print_rm(DisassemblerX86_64 *d, size_t size, bool has_memory_size) {
+    if (d->is_memory) {
+        if (has_memory_size) disassembler_print(d->instruction, "%s ", disassembler_x86_64_memory_sizes[disassembler_x86_64_size_index(size)]);
+        disassembler_print(d->instruction, "%s", d->memory);
+    } else if (size == 0) {
+        disassembler_print(d->instruction, "%s%d", d->vex_l ? "ymm" : "xmm", d->rm);
+    } else {
+        disassembler_print(d->instruction, "%s", disassembler_x86_64_register(d, d->rm, size));
+    }
+}
+
+static void disassembler_x86_64_print_branch(DisassemblerX86_64 *d, char *name, size_t size) {
+    int64_t distance = disassembler_x86_64_fetch_signed(d, size);
+    d->instruction->has_target = true;
+    d->instruction->target = d->address + d->position + distance;
+    disassembler_print(d->instruction, "%s 0x%" PRIx64, name, d->instruction->target);
+}
+
+// SSE2 and AVX2 integer instructions with a 66 prefix, VEX encoded ones have a second source register
+static char *disassembler_x86_64_vector_name(uint8_t opcode) {
+    switch (opcode) {
+        case 0x60: return "punpcklbw";
+        case 0x61: return "punpcklwd";
+        case 0x62: return "punpckldq";
+        case 0x6a: return "punpckhdq";
+        case 0x6c: return "punpcklqdq";
+        case 0x6d: return "punpckhqdq";
+        case 0xd4: return "paddq";
+        case 0xdb: return "pand";
+        case 0xeb: return "por";
+        case 0xef: return "pxor";
+        case 0xf6: return "psadbw";
+        case 0xf8: return "psubb";
+        case 0xf9: return "psubw";
+        case 0xfa: return "psubd";
+        case 0xfb: return "psubq";
+        case 0xfc: return "paddb";
+        case 0xfd: return "paddw";
+        case 0xfe: return "paddd";
+        default: return NULL;
+    }
+}
+
+static void disassembler_x86_64_vector(DisassemblerX86_64 *d, uint8_t opcode) {
+    char *v = d->is_vex ? "v" : "";
+    char *xmm = d->vex_l ? "ymm" : "xmm";
+    char *name = disassembler_x86_64_vector_name(opcode);
+    if (name != NULL && d->has_operand_size) {
+        disassembler_x86_64_modrm(d, 0);
+        disassembler_print(d->instruction, "%s%s %s%d, ", v, name, xmm, d->reg);
+        if (d->is_vex) disassembler_print(d->instruction, "%s%d, ", xmm, d->vex_vvvv);
+        disassembler_x86_64_print_rm(d, 0, false);
+        return;
+    }
+    if ((opcode == 0x6f || opcode == 0x7f) && (d->has_operand_size || d->has_rep)) {
+        disassembler_x86_64_modrm(d, 0);
+        disassembler_print(d->instruction, "%s%s ", v, d->has_rep ? "movdqu" : "movdqa");
+        if (opcode == 0x6f) disassembler_print(d->instruction, "%s%d, ", xmm, d->reg);
+        disassembler_x86_64_print_rm(d, 0, false);
+        if (opcode == 0x7f) disassembler_print(d->instruction, ", %s%d", xmm, d->reg);
+        return;
+    }
+    if (opcode == 0x70 && d->has_operand_size) {
+        disassembler_x86_64_modrm(d, 1);
+        disassembler_print(d->instruction, "%spshufd %s%d, ", v, xmm, d->reg);
+        disassembler_x86_64_print_rm(d, 0, false);
+        disassembler_print(d->instruction, ", %d", (int)disassembler_x86_64_fetch(d, 1));
+        return;
+    }
+    if ((opcode == 0x6e || opcode == 0x7e) && d->has_operand_size) {
+        disassembler_x86_64_modrm(d, 0);
+        size_t size = d->rex & 8 ? 8 : 4;
+        disassembler_print(d->instruction, "%s%s ", v, size == 8 ? "movq" : "movd");
+        if (opcode == 0x6e) disassembler_print(d->instruction, "xmm%d, ", d->reg);
+        disassembler_x86_64_print_rm(d, size, false);
+        if (opcode == 0x7e) disassembler_print(d->instruction, ", xmm%d", d->reg);
+        return;
+    }
+    if (opcode == 0x77 && d->is_vex) {
+        disassembler_print(d->instruction, d->vex_l ? "vzeroall" : "vzeroupper");
+        return;
+    }
+    d->is_invalid = true;
+}
+
+void disassembler_x86_64(uint8_t *code, size_t size, uint64_t address, DisassemblerInstruction *instruction) {
+    *instruction = (DisassemblerInstruction){0};
+    DisassemblerX86_64 decoder = {.code = code, .size = size, .address = address, .instruction = instruction};
+    DisassemblerX86_64 *d = &decoder;
+
+    // Prefixes
+    uint8_t opcode = disassembler_x86_64_fetch(d, 1);
+    for (;;) {
+        if (opcode == 0x66) {
+            d->has_operand_size = true;
+        } else if (opcode == 0xf3) {
+            d->has_rep = true;
+        } else {
+            break;
+        }
+        opcode = disassembler_x86_64_fetch(d, 1);
+    }
+    if (opcode >= 0x40 && opcode <= 0x4f) {
+        d->rex = opcode;
+        opcode = disassembler_x86_64_fetch(d, 1);
+    }
+    if (opcode == 0xc4 || opcode == 0xc5) {
+        uint8_t byte1 = disassembler_x86_64_fetch(d, 1);
+        uint8_t byte2 = byte1;
+        d->rex = 0x40 | (~byte1 & 0x80 ? 4 : 0);
+        d->vex_map = 1;
+        if (opcode == 0xc4) {
+            d->rex |= (~byte1 & 0x40 ? 2 : 0) | (~byte1 & 0x20 ? 1 : 0);
+            d->vex_map = byte1 & 0x1f;
+            byte2 = disassembler_x86_64_fetch(d, 1);
+            if (byte2 & 0x80) d->rex |= 8;
+        }
+        d->is_vex = true;
+        d->vex_vvvv = (~byte2 >> 3) & 15;
+        d->vex_l = (byte2 & 4) != 0;
+        d->has_operand_size = (byte2 & 3) == 1;
+        d->has_rep = (byte2 & 3) == 2;
+        opcode = disassembler_x86_64_fetch(d, 1);
+    }
+    size_t operand_size = d->rex & 8 ? 8 : (d->has_operand_size ? 2 : 4);
+
+    if (d->is_vex && d->vex_map == 2) {
+        // vpbroadcast
+        char *names[4] = {"vpbroadcastb", "vpbroadcastw", "vpbroadcastd", "vpbroadcastq"};
+        int32_t index = opcode == 0x78 ? 0 : (opcode == 0x79 ? 1 : (opcode == 0x58 ? 2 : (opcode == 0x59 ? 3 : -1)));
+        if (index == -1 || !d->has_operand_size) {
+            d->is_invalid = true;
+        } else {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "%s %s%d, ", names[index], d->vex_l ? "ymm" : "xmm", d->reg);
+            bool vex_l = d->vex_l;
+            d->vex_l = false;
+            disassembler_x86_64_print_rm(d, 0, false);
+            d->vex_l = vex_l;
+        }
+    } else if (d->is_vex) {
+        if (d->vex_map != 1) d->is_invalid = true;
+        if (!d->is_invalid) disassembler_x86_64_vector(d, opcode);
+    } else if (opcode < 0x40 && (opcode & 7) < 6) {
+        // add, or, adc, sbb, and, sub, xor and cmp
+        char *name = disassembler_x86_64_alu[opcode >> 3];
+        size_t size = opcode & 1 ? operand_size : 1;
+        if ((opcode & 7) >= 4) {
+            int64_t imm = disassembler_x86_64_fetch_signed(d, size == 1 ? 1 : (size == 2 ? 2 : 4));
+            disassembler_print(instruction, "%s %s, ", name, disassembler_x86_64_registers[disassembler_x86_64_size_index(size)][0]);
+            disassembler_print_immediate(instruction, imm);
+        } else {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "%s ", name);
+            if (opcode & 2) disassembler_print(instruction, "%s, ", disassembler_x86_64_register(d, d->reg, size));
+            disassembler_x86_64_print_rm(d, size, true);
+            if (!(opcode & 2)) disassembler_print(instruction, ", %s", disassembler_x86_64_register(d, d->reg, size));
+        }
+    } else if (opcode >= 0x50 && opcode <= 0x5f) {
+        disassembler_print(instruction, "%s %s", opcode < 0x58 ? "push" : "pop", disassembler_x86_64_registers[3][(opcode & 7) | ((d->rex & 1) << 3)]);
+    } else if (opcode == 0x68 || opcode == 0x6a) {
+        disassembler_print(instruction, "push ");
+        disassembler_print_immediate(instruction, disassembler_x86_64_fetch_signed(d, opcode == 0x68 ? 4 : 1));
+    } else if (opcode == 0x69 || opcode == 0x6b) {
+        size_t immediate_size = opcode == 0x6b ? 1 : (operand_size == 2 ? 2 : 4);
+        disassembler_x86_64_modrm(d, immediate_size);
+        disassembler_print(instruction, "imul %s, ", disassembler_x86_64_register(d, d->reg, operand_size));
+        disassembler_x86_64_print_rm(d, operand_size, true);
+        disassembler_print(instruction, ", ");
+        disassembler_print_immediate(instruction, disassembler_x86_64_fetch_signed(d, immediate_size));
+    } else if (opcode >= 0x70 && opcode <= 0x7f) {
+        char name[8];
+        snprintf(name, sizeof(name), "j%s", disassembler_x86_64_conditions[opcode & 15]);
+        disassembler_x86_64_print_branch(d, name, 1);
+    } else if (opcode >= 0x80 && opcode <= 0x83 && opcode != 0x82) {
+        size_t size = opcode == 0x80 ? 1 : operand_size;
+        size_t immediate_size = opcode == 0x81 ? (size == 2 ? 2 : 4) : 1;
+        disassembler_x86_64_modrm(d, immediate_size);
+        disassembler_print(instruction, "%s ", disassembler_x86_64_alu[d->reg & 7]);
+        disassembler_x86_64_print_rm(d, size, true);
+        disassembler_print(instruction, ", ");
+        disassembler_print_immediate(instruction, disassembler_x86_64_fetch_signed(d, immediate_size));
+    } else if (opcode == 0x84 || opcode == 0x85) {
+        size_t size = opcode == 0x84 ? 1 : operand_size;
+        disassembler_x86_64_modrm(d, 0);
+        disassembler_print(instruction, "test ");
+        disassembler_x86_64_print_rm(d, size, true);
+        disassembler_print(instruction, ", %s", disassembler_x86_64_register(d, d->reg, size));
+    } else if (opcode >= 0x88 && opcode <= 0x8b) {
+        size_t size = opcode & 1 ? operand_size : 1;
+        disassembler_x86_64_modrm(d, 0);
+        disassembler_print(instruction, "mov ");
+        if (opcode & 2) disassembler_print(instruction, "%s, ", disassembler_x86_64_register(d, d->reg, size));
+        disassembler_x86_64_print_rm(d, size, true);
+        if (!(opcode & 2)) disassembler_print(instruction, ", %s", disassembler_x86_64_register(d, d->reg, size));
+    } else if (opcode == 0x8d) {
+        disassembler_x86_64_modrm(d, 0);
+        if (!d->is_memory) d->is_invalid = true;
+        disassembler_print(instruction, "lea %s, %s", disassembler_x86_64_register(d, d->reg, operand_size), d->memory);
+    } else if (opcode == 0x90) {
+        disassembler_print(instruction, d->has_rep ? "pause" : "nop");
+    } else if (opcode == 0x98) {
+        disassembler_print(instruction, operand_size == 8 ? "cdqe" : (operand_size == 2 ? "cbw" : "cwde"));
+    } else if (opcode == 0x99) {
+        disassembler_print(instruction, operand_size == 8 ? "cqo" : (operand_size == 2 ? "cwd" : "cdq"));
+    } else if (opcode >= 0xb0 && opcode <= 0xbf) {
+        size_t size = opcode < 0xb8 ? 1 : operand_size;
+        uint8_t reg = (opcode & 7) | ((d->rex & 1) << 3);
+        int64_t imm = disassembler_x86_64_fetch_signed(d, size);
+        disassembler_print(instruction, "%s %s, ", size == 8 ? "movabs" : "mov", disassembler_x86_64_register(d, reg, size));
+        disassembler_print_immediate(instruction, imm);
+    } else if (opcode == 0xc0 || opcode == 0xc1 || (opcode >= 0xd0 && opcode <= 0xd3)) {
+        size_t size = opcode & 1 ? operand_size : 1;
+        disassembler_x86_64_modrm(d, opcode <= 0xc1 ? 1 : 0);
+        disassembler_print(instruction, "%s ", disassembler_x86_64_shifts[d->reg & 7]);
+        disassembler_x86_64_print_rm(d, size, true);
+        if (opcode <= 0xc1) disassembler_print(instruction, ", %d", (int)disassembler_x86_64_fetch(d, 1));
+        if (opcode == 0xd0 || opcode == 0xd1) disassembler_print(instruction, ", 1");
+        if (opcode == 0xd2 || opcode == 0xd3) disassembler_print(instruction, ", cl");
+    } else if (opcode == 0xc2) {
+        disassembler_print(instruction, "ret %d", (int)disassembler_x86_64_fetch(d, 2));
+    } else if (opcode == 0xc3) {
+        disassembler_print(instruction, "ret");
+    } else if (opcode == 0xc6 || opcode == 0xc7) {
+        size_t size = opcode == 0xc6 ? 1 : operand_size;
+        size_t immediate_size = size == 8 ? 4 : size;
+        disassembler_x86_64_modrm(d, immediate_size);
+        if ((d->reg & 7) != 0) d->is_invalid = true;
+        disassembler_print(instruction, "mov ");
+        disassembler_x86_64_print_rm(d, size, true);
+        disassembler_print(instruction, ", ");
+        disassembler_print_immediate(instruction, disassembler_x86_64_fetch_signed(d, immediate_size));
+    } else if (opcode == 0xc9) {
+        disassembler_print(instruction, "leave");
+    } else if (opcode == 0xcc) {
+        disassembler_print(instruction, "int3");
+    } else if (opcode == 0xcd) {
+        disassembler_print(instruction, "int %d", (int)disassembler_x86_64_fetch(d, 1));
+    } else if (opcode == 0xe8 || opcode == 0xe9 || opcode == 0xeb) {
+        disassembler_x86_64_print_branch(d, opcode == 0xe8 ? "call" : "jmp", opcode == 0xeb ? 1 : 4);
+    } else if (opcode == 0xf6 || opcode == 0xf7) {
+        char *names[8] = {"test", "test", "not", "neg", "mul", "imul", "div", "idiv"};
+        size_t size = opcode == 0xf6 ? 1 : operand_size;
+        size_t immediate_size = size == 1 ? 1 : (size == 2 ? 2 : 4);
+        bool has_immediate = d->position < d->size && (d->code[d->position] & 0x30) == 0;
+        disassembler_x86_64_modrm(d, has_immediate ? immediate_size : 0);
+        disassembler_print(instruction, "%s ", names[d->reg & 7]);
+        disassembler_x86_64_print_rm(d, size, true);
+        if ((d->reg & 6) == 0) {
+            disassembler_print(instruction, ", ");
+            disassembler_print_immediate(instruction, disassembler_x86_64_fetch_signed(d, immediate_size));
+        }
+    } else if (opcode == 0xfe || opcode == 0xff) {
+        char *names[8] = {"inc", "dec", "call", NULL, "jmp", NULL, "push", NULL};
+        disassembler_x86_64_modrm(d, 0);
+        char *name = names[d->reg & 7];
+        if (name == NULL || (opcode == 0xfe && (d->reg & 7) >= 2)) {
+            d->is_invalid = true;
+        } else {
+            // Calls, jumps and pushes are always 64 bit
+            disassembler_print(instruction, "%s ", name);
+            disassembler_x86_64_print_rm(d, opcode == 0xfe ? 1 : ((d->reg & 7) >= 2 ? 8 : operand_size), true);
+        }
+    } else if (opcode == 0x0f) {
+        opcode = disassembler_x86_64_fetch(d, 1);
+        if (opcode == 0x05) {
+            disassembler_print(instruction, "syscall");
+        } else if (opcode == 0x0b) {
+            disassembler_print(instruction, "ud2");
+        } else if (opcode == 0x1f) {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "nop ");
+            disassembler_x86_64_print_rm(d, operand_size, true);
+        } else if (opcode >= 0x40 && opcode <= 0x4f) {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "cmov%s %s, ", disassembler_x86_64_conditions[opcode & 15], disassembler_x86_64_register(d, d->reg, operand_size));
+            disassembler_x86_64_print_rm(d, operand_size, true);
+        } else if (opcode >= 0x80 && opcode <= 0x8f) {
+            char name[8];
+            snprintf(name, sizeof(name), "j%s", disassembler_x86_64_conditions[opcode & 15]);
+            disassembler_x86_64_print_branch(d, name, 4);
+        } else if (opcode >= 0x90 && opcode <= 0x9f) {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "set%s ", disassembler_x86_64_conditions[opcode & 15]);
+            disassembler_x86_64_print_rm(d, 1, true);
+        } else if (opcode == 0xaf) {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "imul %s, ", disassembler_x86_64_register(d, d->reg, operand_size));
+            disassembler_x86_64_print_rm(d, operand_size, true);
+        } else if (opcode == 0xb6 || opcode == 0xb7 || opcode == 0xbe || opcode == 0xbf) {
+            disassembler_x86_64_modrm(d, 0);
+            disassembler_print(instruction, "%s %s, ", opcode < 0xb8 ? "movzx" : "movsx", disassembler_x86_64_register(d, d->reg, operand_size));
+            disassembler_x86_64_print_rm(d, opcode & 1 ? 2 : 1, true);
+        } else {
+            disassembler_x86_64_vector(d, opcode);
+        }
+    } else {
+        d->is_invalid = true;
+    }
+
+    if (d->is_invalid) {
+        *instruction = (DisassemblerInstruction){.size = 1};
+        disassembler_print(instruction, ".byte 0x%02x", code[0]);
+        return;
+    }
+    instruction->size = d->position;
+}
+
+// arm64
+static char *disassembler_arm64_conditions[16] = {"eq", "ne", "hs", "lo", "mi", "pl", "vs", "vc", "hi", "ls", "ge", "lt", "gt", "le", "al", "nv"};
+
+// Register 31 is the stack pointer or the zero register depending on the instruction
+static char *disassembler_arm64_register(char *buffer, uint32_t reg, bool is_64, bool is_sp) {
+    if (reg == 31) return is_sp ? (is_64 ? "sp" : "wsp") : (is_64 ? "xzr" : "wzr");
+    if (is_64 && reg == 29) return "fp";
+    if (is_64 && reg == 30) return "lr";
+    snprintf(buffer, 8, "%c%d", is_64 ? 'x' : 'w', reg);
+    return buffer;
+}
+
+static int64_t disassembler_arm64_sign_extend(uint32_t value, int32_t bits) { return (int64_t)((uint64_t)value << (64 - bits)) >> (64 - bits); }
+
+static char *disassembler_arm64_arrangement(uint32_t size, bool q) {
+    char *arrangements[4][2] = {{"8b", "16b"}, {"4h", "8h"}, {"2s", "4s"}, {"1d", "2d"}};
+    return arrangements[size & 3][q];
+}
+
+static bool disassembler_arm64_branch(uint32_t code, uint64_t address, DisassemblerInstruction *instruction) {
+    char rt[8];
+    if ((code & 0x7C000000) == 0x14000000) {
+        instruction->target = address + disassembler_arm64_sign_extend(code & 0x3ffffff, 26) * 4;
+        disassembler_print(instruction, "%s 0x%" PRIx64, code >> 31 ? "bl" : "b", instruction->target);
+    } else if ((code & 0xFF000010) == 0x54000000) {
+        instruction->target = address + disassembler_arm64_sign_extend((code >> 5) & 0x7ffff, 19) * 4;
+        disassembler_print(instruction, "b.%s 0x%" PRIx64, disassembler_arm64_conditions[code & 15], instruction->target);
+    } else if ((code & 0x7E000000) == 0x34000000) {
+        instruction->target = address + disassembler_arm64_sign_extend((code >> 5) & 0x7ffff, 19) * 4;
+        disassembler_print(instruction, "%s %s, 0x%" PRIx64, code & (1 << 24) ? "cbnz" : "cbz", disassembler_arm64_register(rt, code & 31, code >> 31, false),
+                           instruction->target);
+    } else if ((code & 0x1F000000) == 0x10000000) {
+        int64_t imm = disassembler_arm64_sign_extend((((code >> 5) & 0x7ffff) << 2) | ((code >> 29) & 3), 21);
+        instruction->target = code >> 31 ? (address & ~(uint64_t)0xfff) + (imm << 12) : address + imm;
+        disassembler_print(instruction, "%s %s, 0x%" PRIx64, code >> 31 ? "adrp" : "adr", disassembler_arm64_register(rt, code & 31, true, false),
+                           instruction->target);
+    } else if ((code & 0xBF000000) == 0x18000000) {
+        instruction->target = address + disassembler_arm64_sign_extend((code >> 5) & 0x7ffff, 19) * 4;
+        disassembler_print(instruction, "ldr %s, 0x%" PRIx64, disassembler_arm64_register(rt, code & 31, (code >> 30) & 1, false), instruction->target);
+    } else {
+        return false;
+    }
+    instruction->has_target = true;
+    return true;
+}
+
+static bool disassembler_arm64_load_store(uint32_t code, DisassemblerInstruction *instruction) {
+    char rt[8], rt2[8], rn[8];
+    uint32_t size = code >> 30;
+    bool is_vector = (code >> 26) & 1;
+    char *base = disassembler_arm64_register(rn, (code >> 5) & 31, true, true);
+    if ((code & 0x3A000000) == 0x28000000 && !is_vector && ((code >> 23) & 3) != 0) {
+        // ldp and stp
+        bool is_64 = size == 2;
+        int64_t imm = disassembler_arm64_sign_extend((code >> 15) & 0x7f, 7) * (is_64 ? 8 : 4);
+        uint32_t kind = (code >> 23) & 3;
+        disassembler_print(instruction, "%s %s, %s, [%s", code & (1 << 22) ? "ldp" : "stp", disassembler_arm64_register(rt, code & 31, is_64, false),
+                           disassembler_arm64_register(rt2, (code >> 10) & 31, is_64, false), base);
+        if (kind == 1) disassembler_print(instruction, "], %" PRId64, imm);
+        if (kind == 2) disassembler_print(instruction, imm != 0 ? ", %" PRId64 "]" : "]", imm);
+        if (kind == 3) disassembler_print(instruction, ", %" PRId64 "]!", imm);
+        return true;
+    }
+    if ((code & 0x3B000000) != 0x39000000 && (code & 0x3B200400) != 0x38000400) return false;
+
+    // Loads and stores of one register, q registers have the size bits clear and the high opc bit set
+    uint32_t opc = (code >> 22) & 3;
+    char *name;
+    char reg[8];
+    uint32_t scale = size;
+    if (is_vector) {
+        if (size != 0 || (opc & 2) == 0) return false;
+        scale = 4;
+        name = opc & 1 ? "ldr" : "str";
+        snprintf(reg, sizeof(reg), "q%d", code & 31);
+    } else {
+        if (opc >= 2) return false;
+        char *loads[4] = {"ldrb", "ldrh", "ldr", "ldr"};
+        char *stores[4] = {"strb", "strh", "str", "str"};
+        name = opc == 1 ? loads[size] : stores[size];
+        snprintf(reg, sizeof(reg), "%s", disassembler_arm64_register(rt, code & 31, size == 3, false));
+    }
+    disassembler_print(instruction, "%s %s, [%s", name, reg, base);
+    if ((code & 0x3B000000) == 0x39000000) {
+        uint64_t imm = (uint64_t)((code >> 10) & 0xfff) << scale;
+        disassembler_print(instruction, imm != 0 ? ", %" PRIu64 "]" : "]", imm);
+    } else {
+        int64_t imm = disassembler_arm64_sign_extend((code >> 12) & 0x1ff, 9);
+        disassembler_print(instruction, code & (1 << 11) ? ", %" PRId64 "]!" : "], %" PRId64, imm);
+    }
+    return true;
+}
+
+static bool disassembler_arm64_data_processing(uint32_t code, DisassemblerInstruction *instruction) {
+    char rd[8], rn[8], rm[8], ra[8];
+    bool is_64 = code >> 31;
+    uint32_t d = code & 31, n = (code >> 5) & 31, m = (code >> 16) & 31;
+    if ((code & 0x1F800000) == 0x11000000) {
+        // add and sub with an immediate, the aliases are mov to and from sp and cmp
+        bool is_sub = (code >> 30) & 1, is_flags = (code >> 29) & 1;
+        uint32_t imm = (code >> 10) & 0xfff;
+        bool is_shifted = (code >> 22) & 1;
+        if (!is_sub && !is_flags && imm == 0 && !is_shifted && (d == 31 || n == 31)) {
+            disassembler_print(instruction, "mov %s, %s", disassembler_arm64_register(rd, d, is_64, true), disassembler_arm64_register(rn, n, is_64, true));
+            return true;
+        }
+        if (is_flags && d == 31) {
+            disassembler_print(instruction, "%s %s, %u", is_sub ? "cmp" : "cmn", disassembler_arm64_register(rn, n, is_64, true), imm);
+        } else {
+            char *names[4] = {"add", "adds", "sub", "subs"};
+            disassembler_print(instruction, "%s %s, %s, %u", names[(is_sub << 1) | is_flags], disassembler_arm64_register(rd, d, is_64, !is_flags),
+                               disassembler_arm64_register(rn, n, is_64, true), imm);
+        }
+        if (is_shifted) disassembler_print(instruction, ", lsl 12");
+        return true;
+    }
+    if ((code & 0x1F800000) == 0x12800000) {
+        uint32_t opc = (code >> 29) & 3, shift = ((code >> 21) & 3) * 16;
+        uint32_t imm = (code >> 5) & 0xffff;
+        if (opc == 1) return false;
+        char *name = opc == 0 ? "movn" : (opc == 2 ? (shift == 0 ? "mov" : "movz") : "movk");
+        disassembler_print(instruction, "%s %s, ", name, disassembler_arm64_register(rd, d, is_64, false));
+        disassembler_print_immediate(instruction, imm);
+        if (shift != 0) disassembler_print(instruction, ", lsl %u", shift);
+        return true;
+    }
+    if ((code & 0x1F000000) == 0x0A000000 || (code & 0x1F200000) == 0x0B000000) {
+        // Logical and arithmetic with a shifted register, the aliases are mov, mvn, tst, cmp and neg
+        char *shifts[4] = {"lsl", "lsr", "asr", "ror"};
+        uint32_t shift = (code >> 22) & 3, amount = (code >> 10) & 0x3f;
+        uint32_t opc = (code >> 29) & 3;
+        bool is_logical = (code & 0x1F000000) == 0x0A000000;
+        bool is_inverted = is_logical && ((code >> 21) & 1);
+        char *name;
+        if (is_logical) {
+            char *names[2][4] = {{"and", "orr", "eor", "ands"}, {"bic", "orn", "eon", "bics"}};
+            name = names[is_inverted][opc];
+        } else {
+            char *names[4] = {"add", "adds", "sub", "subs"};
+            name = names[opc];
+        }
+        disassembler_arm64_register(rd, d, is_64, false);
+        disassembler_arm64_register(rn, n, is_64, false);
+        disassembler_arm64_register(rm, m, is_64, false);
+        if (is_logical && opc == 1 && n == 31 && amount == 0) {
+            disassembler_print(instruction, "%s %s, %s", is_inverted ? "mvn" : "mov", rd, rm);
+        } else if ((opc == 3 || (!is_logical && opc == 1)) && d == 31) {
+            disassembler_print(instruction, "%s %s, %s", is_logical ? "tst" : (opc == 3 ? "cmp" : "cmn"), rn, rm);
+        } else if (!is_logical && opc == 2 && n == 31) {
+            disassembler_print(instruction, "neg %s, %s", rd, rm);
+        } else {
+            disassembler_print(instruction, "%s %s, %s, %s", name, rd, rn, rm);
+        }
+        if (amount != 0) disassembler_print(instruction, ", %s %u", shifts[shift], amount);
+        return true;
+    }
+    if ((code & 0x5FE00000) == 0x1AC00000) {
+        char *names[16] = {NULL, NULL, "udiv", "sdiv", NULL, NULL, NULL, NULL, "lsl", "lsr", "asr", "ror", NULL, NULL, NULL, NULL};
+        uint32_t opcode = (code >> 10) & 0x3f;
+        if (opcode >= 16 || names[opcode] == NULL) return false;
+        disassembler_print(instruction, "%s %s, %s, %s", names[opcode], disassembler_arm64_register(rd, d, is_64, false),
+                           disassembler_arm64_register(rn, n, is_64, false), disassembler_arm64_register(rm, m, is_64, false));
+        return true;
+    }
+    if ((code & 0x7FE00000) == 0x1B000000) {
+        uint32_t a = (code >> 10) & 31;
+        bool is_sub = (code >> 15) & 1;
+        disassembler_arm64_register(rd, d, is_64, false);
+        disassembler_arm64_register(rn, n, is_64, false);
+        disassembler_arm64_register(rm, m, is_64, false);
+        if (a == 31) {
+            disassembler_print(instruction, "%s %s, %s, %s", is_sub ? "mneg" : "mul", rd, rn, rm);
+        } else {
+            disassembler_print(instruction, "%s %s, %s, %s, %s", is_sub ? "msub" : "madd", rd, rn, rm, disassembler_arm64_register(ra, a, is_64, false));
+        }
+        return true;
+    }
+    if ((code & 0x3FE00800) == 0x1A800000) {
+        // csel, csinc, csinv and csneg, csinc of the zero register is cset with the inverted condition
+        char *names[4] = {"csel", "csinc", "csinv", "csneg"};
+        uint32_t op = (((code >> 30) & 1) << 1) | ((code >> 10) & 1);
+        uint32_t condition = (code >> 12) & 15;
+        disassembler_arm64_register(rd, d, is_64, false);
+        if (op == 1 && n == 31 && m == 31 && condition < 14) {
+            disassembler_print(instruction, "cset %s, %s", rd, disassembler_arm64_conditions[condition ^ 1]);
+        } else {
+            disassembler_print(instruction, "%s %s, %s, %s, %s", names[op], rd, disassembler_arm64_register(rn, n, is_64, false),
+                               disassembler_arm64_register(rm, m, is_64, false), disassembler_arm64_conditions[condition]);
+        }
+        return true;
+    }
+    if ((code & 0xFFFFFC00) == 0x9E660000 || (code & 0xFFFFFC00) == 0x9E670000) {
+        if (code & (1 << 16)) {
+            disassembler_print(instruction, "fmov d%u, %s", d, disassembler_arm64_register(rn, n, true, false));
+        } else {
+            disassembler_print(instruction, "fmov %s, d%u", disassembler_arm64_register(rd, d, true, false), n);
+        }
+        return true;
+    }
+    return false;
+}
+
+static bool disassembler_arm64_vector(uint32_t code, DisassemblerInstruction *instruction) {
+    char rn[8];
+    bool q = (code >> 30) & 1, u = (code >> 29) & 1;
+    uint32_t size = (code >> 22) & 3;
+    uint32_t d = code & 31, n = (code >> 5) & 31, m = (code >> 16) & 31;
+    if ((code & 0xBFE0FC00) == 0x0E000C00 || (code & 0xBFE0FC00) == 0x0E003C00) {
+        // dup from a general register and umov to one, the lowest set bit of imm5 is the lane size
+        uint32_t imm5 = (code >> 16) & 31;
+        uint32_t lane = imm5 & 1 ? 0 : (imm5 & 2 ? 1 : (imm5 & 4 ? 2 : 3));
+        if ((imm5 & 15) == 0) return false;
+        if ((code & 0xFC00) == 0x0C00) {
+            disassembler_print(instruction, "dup v%u.%s, %s", d, disassembler_arm64_arrangement(lane, q), disassembler_arm64_register(rn, n, lane == 3, false));
+        } else {
+            char lanes[4] = {'b', 'h', 's', 'd'};
+            disassembler_print(instruction, "%s %s, v%u.%c[%u]", lane >= 2 && q == (lane == 3) ? "mov" : "umov",
+                               disassembler_arm64_register(rn, d, lane == 3, false), n, lanes[lane], imm5 >> (lane + 1));
+        }
+        return true;
+    }
+    if ((code & 0x9F200400) == 0x0E200400) {
+        uint32_t opcode = (code >> 11) & 31;
+        char *name = NULL;
+        if (opcode == 0x10) name = u ? "sub" : "add";
+        if (opcode == 0x17 && !u) name = "addp";
+        if (opcode == 0x03) {
+            char *names[2][4] = {{"and", "bic", "orr", "orn"}, {"eor", "bsl", "bit", "bif"}};
+            name = names[u][size];
+            if (!u && size == 2 && n == m) {
+                disassembler_print(instruction, "mov v%u.%s, v%u.%s", d, disassembler_arm64_arrangement(0, q), n, disassembler_arm64_arrangement(0, q));
+                return true;
+            }
+        }
+        if (name == NULL) return false;
+        char *arrangement = disassembler_arm64_arrangement(opcode == 0x03 ? 0 : size, q);
+        disassembler_print(instruction, "%s v%u.%s, v%u.%s, v%u.%s", name, d, arrangement, n, arrangement, m, arrangement);
+        return true;
+    }
+    if ((code & 0x9F3E0C00) == 0x0E200800) {
+        uint32_t opcode = (code >> 12) & 31;
+        char *name = NULL;
+        if (opcode == 0x02) name = u ? "uaddlp" : "saddlp";
+        if (opcode == 0x06) name = u ? "uadalp" : "sadalp";
+        if (name == NULL || size == 3) return false;
+        disassembler_print(instruction, "%s v%u.%s, v%u.%s", name, d, disassembler_arm64_arrangement(size + 1, q), n, disassembler_arm64_arrangement(size, q));
+        return true;
+    }
+    if ((code & 0xBF3FFC00) == 0x0E31B800 && size < 3) {
+        char lanes[3] = {'b', 'h', 's'};
+        disassembler_print(instruction, "addv %c%u, v%u.%s", lanes[size], d, n, disassembler_arm64_arrangement(size, q));
+        return true;
+    }
+    if ((code & 0xFFFFFC00) == 0x5EF1B800) {
+        disassembler_print(instruction, "addp d%u, v%u.2d", d, n);
+        return true;
+    }
+    if ((code & 0x9FF8FC00) == 0x0F00E400) {
+        // movi of bytes, with op set every bit of the immediate is a byte of ones
+        uint64_t imm = (((code >> 16) & 7) << 5) | ((code >> 5) & 31);
+        if (u) {
+            uint64_t mask = 0;
+            for (int32_t i = 0; i < 8; i++) mask |= imm & (1 << i) ? (uint64_t)0xff << (i * 8) : 0;
+            disassembler_print(instruction, q ? "movi v%u.2d, " : "movi d%u, ", d);
+            disassembler_print_immediate(instruction, mask);
+        } else {
+            disassembler_print(instruction, "movi v%u.%s, ", d, disassembler_arm64_arrangement(0, q));
+            disassembler_print_immediate(instruction, imm);
+        }
+        return true;
+    }
+    return false;
+}
+
+void disassembler_arm64(uint8_t *code, size_t size, uint64_t address, DisassemblerInstruction *instruction) {
+    *instruction = (DisassemblerInstruction){0};
+    if (size < sizeof(uint32_t)) {
+        instruction->size = 1;
+        disassembler_print(instruction, ".byte 0x%02x", code[0]);
+        return;
+    }
+    uint32_t word;
+    memcpy(&word, code, sizeof(uint32_t));
+    instruction->size = sizeof(uint32_t);
+
+    char rn[8];
+    if ((word & 0xFFFFFC1F) == 0xD61F0000 || (word & 0xFFFFFC1F) == 0xD63F0000) {
+        disassembler_print(instruction, "%s %s", word & (1 << 21) ? "blr" : "br", disassembler_arm64_register(rn, (word >> 5) & 31, true, false));
+    } else if ((word & 0xFFFFFC1F) == 0xD65F0000) {
+        disassembler_print(instruction, (word >> 5 & 31) == 30 ? "ret" : "ret %s", disassembler_arm64_register(rn, (word >> 5) & 31, true, false));
+    } else if ((word & 0xFFE0001F) == 0xD4000001) {
+        disassembler_print(instruction, "svc %u", (word >> 5) & 0xffff);
+    } else if ((word & 0xFFE0001F) == 0xD4200000) {
+        disassembler_print(instruction, "brk %u", (word >> 5) & 0xffff);
+    } else if (word == 0xD503201F) {
+        disassembler_print(instruction, "nop");
+    } else if (!disassembler_arm64_branch(word, address, instruction) && !disassembler_arm64_load_store(word, instruction) &&
+               !disassembler_arm64_data_processing(word, instruction) && !disassembler_arm64_vector(word, instruction)) {
+        disassembler_print(instruction, ".word 0x%08x", word);
+    }
+}
+
+// Dump
+typedef struct DisassemblerSymbol {
+    uint8_t *address;
+    Function *function;
+    bool is_veneer;
+} DisassemblerSymbol;
+
+static int disassembler_symbol_compare(const void *a, const void *b) {
+    const DisassemblerSymbol *lhs = a, *rhs = b;
+    return lhs->address < rhs->address ? -1 : lhs->address > rhs->address;
+}
+
+// Names a branch or memory target after the function or global it is in, relocatable code names the symbol of its
+// relocation because the target isn't filled in yet
+static void disassembler_print_target(FILE *f, Program *program, uint8_t *code, size_t size, uint8_t *target) {
+    size_t offset = code - (uint8_t *)program->text_section->data;
+    for (size_t i = 0; i < program->relocations.size; i++) {
+        Relocation *relocation = program->relocations.items[i];
+        if (relocation->offset < offset || relocation->offset >= offset + size) continue;
+        fprintf(f, " <%s>", relocation->function != NULL ? relocation->function->name : relocation->global->name);
+        return;
+    }
+    if (program->is_relocatable) return;
+
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (function->address == NULL || target < function->address) continue;
+        if (target == function->address) {
+            fprintf(f, " <%s>", function->name);
+            return;
+        }
+        if (!function->is_extern && target < function->address + function->size) {
+            fprintf(f, " <%s + %zu>", function->name, (size_t)(target - function->address));
+            return;
+        }
+    }
+    for (size_t i = 0; i < program->globals.size; i++) {
+        Global *global = program->globals.items[i];
+        if (global->address != NULL && target >= (uint8_t *)global->address && target < (uint8_t *)global->address + global->type->size) {
+            fprintf(f, target == global->address ? " <%s>" : " <%s + %zu>", global->name, (size_t)(target - (uint8_t *)global->address));
+            return;
+        }
+    }
+}
+
+static void disassembler_print_line(FILE *f, Token *token) {
+    char *text = token->source->text;
+    for (int32_t line = 1; line < token->line && *text != '\0'; text++) {
+        if (*text == '\n') line++;
+    }
+    char *end = strchr(text, '\n');
+    while (*text == ' ' || *text == '\t') text++;
+    fprintf(f, "; %s:%d: %.*s\n", token->source->path, token->line, end != NULL ? (int)(end - text) : (int)strlen(text), text);
+}
+
+void disassembler_dump(FILE *f, Program *program) {
+    Section *text_section = program->text_section;
+    uint8_t *text = text_section->data;
+    uint8_t *text_end = text + text_section->filled;
+
+    // Functions and the veneers of extern functions at the start of the text section, sorted by address
+    DisassemblerSymbol *symbols = malloc((program->functions.size + 1) * sizeof(DisassemblerSymbol));
+    size_t symbols_size = 0;
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (function->address == NULL || function->address < text || function->address >= text_end) continue;
+        symbols[symbols_size++] = (DisassemblerSymbol){.address = function->address, .function = function, .is_veneer = function->is_extern};
+    }
+    qsort(symbols, symbols_size, sizeof(DisassemblerSymbol), disassembler_symbol_compare);
+
+    uint8_t *code = text;
+    for (size_t i = 0; i <= symbols_size; i++) {
+        uint8_t *end = i < symbols_size ? symbols[i].address : text_end;
+        DisassemblerSymbol *symbol = i > 0 ? &symbols[i - 1] : NULL;
+        size_t line_index = 0;
+        while (code < end) {
+            // Veneers end with the address they jump to
+            if (symbol != NULL && symbol->is_veneer && code == symbol->address + LINKER_VENEER_SIZE - sizeof(uint64_t)) {
+                uint64_t address;
+                memcpy(&address, code, sizeof(uint64_t));
+                fprintf(f, "%8zx:  %-30s .quad 0x%" PRIx64 "\n", (size_t)(code - text), "", address);
+                code += sizeof(uint64_t);
+                continue;
+            }
+            for (; symbol != NULL && !symbol->is_veneer && line_index < symbol->function->lines.size; line_index++) {
+                FunctionLine *line = symbol->function->lines.items[line_index];
+                if (line->address > code) break;
+                disassembler_print_line(f, line->token);
+            }
+
+            DisassemblerInstruction instruction;
+            if (program->arch == ARCH_X86_64) {
+                disassembler_x86_64(code, end - code, code - text, &instruction);
+            } else {
+                disassembler_arm64(code, end - code, code - text, &instruction);
+            }
+            char bytes[64] = "";
+            for (size_t j = 0; j < instruction.size && j < 10; j++) snprintf(bytes + j * 3, sizeof(bytes) - j * 3, "%02x ", code[j]);
+            fprintf(f, "%8zx:  %-30s %s", (size_t)(code - text), bytes, instruction.text);
+            if (instruction.has_target) disassembler_print_target(f, program, code, instruction.size, text + instruction.target);
+            fprintf(f, "\n");
+            code += instruction.size;
+        }
+        if (i < symbols_size) {
+            fprintf(f, "%s%s%s:\n", i > 0 ? "\n" : "", symbols[i].function->name, symbols[i].is_veneer ? " [veneer]" : "");
+        }
+    }
+    free(symbols);
+}
@@ -5,20 +5,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils/arena.h"
 #include "utils/utils.h"
 
 // Source
 Source *source_new(char *path, char *text) {
-    Source *source = calloc(1, sizeof(Source));
-    source->path = strdup(path);
-    source->text = strdup(text);
+    Source *source = arena_calloc(1, sizeof(Source));
+    source->path = string_dup(path);
+    source->text = string_dup(text);
 
     // Reverse loop over path to find basename
     char *c = source->path + strlen(source->path);
     while (*c != '/' && c != source->path) c--;
     source->basename = c + 1;
 
-    source->dirname = strndup(source->path, source->basename - 1 - source->path);
+    source->dirname = string_ndup(source->path, source->basename - 1 - source->path);
     return source;
 }
 
@@ -211,7 +212,7 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
     Source *source = source_new(path, text);
 
     size_t capacity = 1024;
-    Token *tokens = malloc(capacity * sizeof(Token));
+    Token *tokens = arena_malloc(capacity * sizeof(Token));
     size_t size = 0;
 
     bool has_errors = false;
@@ -219,15 +220,15 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
     char *line_start = c;
     int32_t line = 1;
     for (;;) {
-        tokens[size].source = source;
-        tokens[size].line = line;
-        tokens[size].column = c - line_start + 1;
-
         if (size == capacity) {
             capacity *= 2;
-            tokens = realloc(tokens, capacity * sizeof(Token));
+            tokens = arena_realloc(tokens, capacity * sizeof(Token));
         }
 
+        tokens[size].source = source;
+        tokens[size].line = line;
+        tokens[size].column = c - line_start + 1;
+
         // EOF
         if (*c == '\0') {
             tokens[size++].kind = TOKEN_EOF;
@@ -310,18 +311,17 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
             // Read unescaped string
             c++;
             char *unescaped = c;
-            while (*c != '\"') {
-                if (*c == '\r' || *c == '\n') {
-                    print_error(&tokens[size], "Unclosed string literal");
-                    exit(EXIT_FAILURE);
-                }
-                c++;
+            while (*c != '\"' && *c != '\r' && *c != '\n' && *c != '\0') c++;
+            if (*c != '\"') {
+                has_errors = true;
+                print_error(&tokens[size], "Unclosed string literal");
+                continue;
             }
             size_t unescape_size = c - unescaped;
             c++;
 
             // Process escape characters
-            char *string = malloc(unescape_size + 1);
+            char *string = arena_malloc(unescape_size + 1);
             char *ec = unescaped;
             char *sc = string;
 
@@ -333,6 +333,7 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
             // Create string token
             tokens[size].kind = TOKEN_STRING;
             tokens[size++].string = string;
+            continue;
         }
 
         // Variables
@@ -345,7 +346,7 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
             for (size_t i = 0; i < sizeof(keywords) / sizeof(Keyword); i++) {
                 Keyword *keyword = &keywords[i];
                 size_t keyword_size = strlen(keyword->keyword);
-                if (!memcmp(string, keyword->keyword, keyword_size) && string_size == keyword_size) {
+                if (string_size == keyword_size && !memcmp(string, keyword->keyword, keyword_size)) {
                     tokens[size++].kind = keyword->kind;
                     keyword_found = true;
                     break;
@@ -353,7 +354,7 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
             }
             if (!keyword_found) {
                 tokens[size].kind = TOKEN_VARIABLE;
-                tokens[size++].string = strndup(string, string_size);
+                tokens[size++].string = string_ndup(string, string_size);
             }
             continue;
         }
@@ -363,7 +364,7 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
         for (size_t i = 0; i < sizeof(operators) / sizeof(Keyword); i++) {
             Keyword *keyword = &operators[i];
             size_t keyword_size = strlen(keyword->keyword);
-            if (!memcmp(c, keyword->keyword, keyword_size)) {
+            if (!strncmp(c, keyword->keyword, keyword_size)) {
                 tokens[size++].kind = keyword->kind;
                 c += keyword_size;
                 operator_found = true;
@@ -382,8 +383,6 @@ Token *lexer(char *path, char *text, size_t *tokens_size) {
     *tokens_size = size;
 
     // Stop when we had some errors
-    if (has_errors) {
-        exit(EXIT_FAILURE);
-    }
+    if (has_errors) return NULL;
     return tokens;
 }
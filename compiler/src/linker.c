@@ -0,0 +1,552 @@
+#include "linker.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "resolver.h"
+#include "utils/arena.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+// Object file sections, the section symbols use the same indexes
+typedef enum LinkerSection {
+    LINKER_SECTION_NULL,
+    LINKER_SECTION_TEXT,
+    LINKER_SECTION_DATA,
+    LINKER_SECTION_RODATA,
+    LINKER_SECTION_BSS,
+    LINKER_SECTION_SYMTAB,
+    LINKER_SECTION_STRTAB,
+    LINKER_SECTION_RELA_TEXT,
+    LINKER_SECTION_NOTE_GNU_STACK,
+    LINKER_SECTION_SHSTRTAB,
+    LINKER_SECTIONS_SIZE,
+} LinkerSection;
+
+static char *linker_section_names[LINKER_SECTIONS_SIZE] = {
+    "", ".text", ".data", ".rodata", ".bss", ".symtab", ".strtab", ".rela.text", ".note.GNU-stack", ".shstrtab",
+};
+
+static uint32_t linker_relocation_type(RelocationKind kind) {
+    if (kind == RELOCATION_X86_64_PC32) return ELF_R_X86_64_PC32;
+    if (kind == RELOCATION_X86_64_PLT32) return ELF_R_X86_64_PLT32;
+    if (kind == RELOCATION_ARM64_CALL26) return ELF_R_AARCH64_CALL26;
+    if (kind == RELOCATION_ARM64_JUMP26) return ELF_R_AARCH64_JUMP26;
+    if (kind == RELOCATION_ARM64_ADR_PREL_PG_HI21) return ELF_R_AARCH64_ADR_PREL_PG_HI21;
+    if (kind == RELOCATION_ARM64_ADR_PREL_LO21) return ELF_R_AARCH64_ADR_PREL_LO21;
+    return ELF_R_AARCH64_ADD_ABS_LO12_NC;
+}
+
+// Functions are emitted in program order, so a function ends where the next one starts
+static size_t linker_function_size(Program *program, size_t index) {
+    Function *function = program->functions.items[index];
+    for (size_t i = index + 1; i < program->functions.size; i++) {
+        Function *next = program->functions.items[i];
+        if (!next->is_extern) return next->address - function->address;
+    }
+    return (uint8_t *)program->text_section->data + program->text_section->filled - function->address;
+}
+
+static size_t linker_function_index(Program *program, Function *function) {
+    size_t index = 0;
+    while (program->functions.items[index] != function) index++;
+    return index;
+}
+
+static size_t linker_global_index(Program *program, Global *global) {
+    size_t index = 0;
+    while (program->globals.items[index] != global) index++;
+    return index;
+}
+
+// Strings go in .rodata, initialized globals in .data and the others in .bss
+typedef struct Linker {
+    Program *program;
+    Buffer sections[LINKER_SECTIONS_SIZE];
+    LinkerSection *global_sections;
+    size_t *global_offsets;
+    size_t bss_size;
+} Linker;
+
+static void linker_init(Linker *linker, Program *program) {
+    *linker = (Linker){.program = program};
+    linker->global_sections = arena_malloc(program->globals.size * sizeof(LinkerSection));
+    linker->global_offsets = arena_malloc(program->globals.size * sizeof(size_t));
+    for (size_t i = 0; i < program->globals.size; i++) {
+        Global *global = program->globals.items[i];
+        if (global->init_data != NULL) {
+            LinkerSection section = global->is_readonly ? LINKER_SECTION_RODATA : LINKER_SECTION_DATA;
+            linker->global_sections[i] = section;
+            linker->global_offsets[i] = buffer_write(&linker->sections[section], global->init_data, global->type->size);
+            buffer_align(&linker->sections[section], 4);
+        } else {
+            linker->global_sections[i] = LINKER_SECTION_BSS;
+            linker->global_offsets[i] = linker->bss_size;
+            linker->bss_size += align(global->type->size, 4);
+        }
+    }
+}
+
+static void linker_free(Linker *linker) {
+    for (LinkerSection section = LINKER_SECTION_NULL; section < LINKER_SECTIONS_SIZE; section++) arena_release(linker->sections[section].data);
+    arena_release(linker->global_sections);
+    arena_release(linker->global_offsets);
+}
+
+static bool linker_write_file(Buffer *file, char *path, bool is_executable) {
+    FILE *f = fopen(path, "wb");
+    bool is_written = f != NULL && fwrite(file->data, 1, file->size, f) == file->size;
+    if (f != NULL) is_written = fclose(f) == 0 && is_written;
+#ifndef _WIN32
+    if (is_written && is_executable) is_written = chmod(path, 0755) == 0;
+#else
+    (void)is_executable;
+#endif
+    return is_written;
+}
+
+void linker_write_elf_object(Buffer *file, Arch arch, Buffer *sections, ElfSectionHeader *headers, char **names, size_t sections_size) {
+    size_t shstrtab = sections_size - 1;
+    for (size_t i = 0; i < sections_size; i++) headers[i].name = buffer_write(&sections[shstrtab], names[i], strlen(names[i]) + 1);
+
+    // Write sections after the header and the section headers at the end
+    buffer_write(file, NULL, sizeof(ElfHeader));
+    for (size_t i = 1; i < sections_size; i++) {
+        buffer_align(file, headers[i].addralign);
+        headers[i].offset = buffer_write(file, sections[i].data, sections[i].size);
+        if (headers[i].type != ELF_SECTION_NOBITS) headers[i].size = sections[i].size;
+    }
+    buffer_align(file, 8);
+    ElfHeader header = {
+        .ident = {0x7f, 'E', 'L', 'F', ELF_CLASS_64, ELF_DATA_LSB, ELF_VERSION_CURRENT},
+        .type = ELF_TYPE_REL,
+        .machine = arch == ARCH_X86_64 ? ELF_MACHINE_X86_64 : ELF_MACHINE_AARCH64,
+        .version = ELF_VERSION_CURRENT,
+        .shoff = buffer_write(file, headers, sections_size * sizeof(ElfSectionHeader)),
+        .ehsize = sizeof(ElfHeader),
+        .shentsize = sizeof(ElfSectionHeader),
+        .shnum = sections_size,
+        .shstrndx = shstrtab,
+    };
+    memcpy(file->data, &header, sizeof(ElfHeader));
+}
+
+bool linker_write_object(Program *program, char *path) {
+    Linker linker;
+    linker_init(&linker, program);
+    Buffer *sections = linker.sections;
+    buffer_write(&sections[LINKER_SECTION_TEXT], program->text_section->data, program->text_section->filled);
+
+    // Local symbols come first, every function and non string global is a global symbol
+    Buffer *symbols = &sections[LINKER_SECTION_SYMTAB];
+    Buffer *strings = &sections[LINKER_SECTION_STRTAB];
+    buffer_write(strings, "", 1);
+    buffer_write(symbols, &(ElfSymbol){0}, sizeof(ElfSymbol));
+    for (LinkerSection section = LINKER_SECTION_TEXT; section <= LINKER_SECTION_BSS; section++) {
+        buffer_write(symbols, &(ElfSymbol){.info = ELF_SYMBOL_SECTION, .shndx = section}, sizeof(ElfSymbol));
+    }
+    size_t first_global_symbol = symbols->size / sizeof(ElfSymbol);
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        ElfSymbol symbol = {.name = buffer_write(strings, function->name, strlen(function->name) + 1)};
+        if (function->is_extern) {
+            symbol.info = (ELF_SYMBOL_GLOBAL << 4) | ELF_SYMBOL_NOTYPE;
+        } else {
+            symbol.info = (ELF_SYMBOL_GLOBAL << 4) | ELF_SYMBOL_FUNC;
+            symbol.shndx = LINKER_SECTION_TEXT;
+            symbol.value = function->address - (uint8_t *)program->text_section->data;
+            symbol.size = linker_function_size(program, i);
+        }
+        buffer_write(symbols, &symbol, sizeof(ElfSymbol));
+    }
+    for (size_t i = 0; i < program->globals.size; i++) {
+        Global *global = program->globals.items[i];
+        if (global->is_readonly) continue;
+        ElfSymbol symbol = {.name = buffer_write(strings, global->name, strlen(global->name) + 1),
+                            .info = (ELF_SYMBOL_GLOBAL << 4) | ELF_SYMBOL_OBJECT,
+                            .shndx = linker.global_sections[i],
+                            .value = linker.global_offsets[i],
+                            .size = global->type->size};
+        buffer_write(symbols, &symbol, sizeof(ElfSymbol));
+    }
+
+    // Functions are relocated against their symbol, globals against their section symbol
+    for (size_t i = 0; i < program->relocations.size; i++) {
+        Relocation *relocation = program->relocations.items[i];
+        ElfRela rela = {.offset = relocation->offset, .addend = relocation->addend};
+        uint64_t symbol;
+        if (relocation->function != NULL) {
+            symbol = first_global_symbol + linker_function_index(program, relocation->function);
+        } else {
+            size_t index = linker_global_index(program, relocation->global);
+            symbol = linker.global_sections[index];
+            rela.addend += linker.global_offsets[index];
+        }
+        rela.info = (symbol << 32) | linker_relocation_type(relocation->kind);
+        buffer_write(&sections[LINKER_SECTION_RELA_TEXT], &rela, sizeof(ElfRela));
+    }
+
+    ElfSectionHeader headers[LINKER_SECTIONS_SIZE] = {
+        [LINKER_SECTION_TEXT] = {.type = ELF_SECTION_PROGBITS, .flags = ELF_FLAG_ALLOC | ELF_FLAG_EXECINSTR, .addralign = 16},
+        [LINKER_SECTION_DATA] = {.type = ELF_SECTION_PROGBITS, .flags = ELF_FLAG_WRITE | ELF_FLAG_ALLOC, .addralign = 8},
+        [LINKER_SECTION_RODATA] = {.type = ELF_SECTION_PROGBITS, .flags = ELF_FLAG_ALLOC, .addralign = 8},
+        [LINKER_SECTION_BSS] = {.type = ELF_SECTION_NOBITS, .flags = ELF_FLAG_WRITE | ELF_FLAG_ALLOC, .addralign = 8},
+        [LINKER_SECTION_SYMTAB] = {.type = ELF_SECTION_SYMTAB,
+                                   .link = LINKER_SECTION_STRTAB,
+                                   .info = first_global_symbol,
+                                   .addralign = 8,
+                                   .entsize = sizeof(ElfSymbol)},
+        [LINKER_SECTION_STRTAB] = {.type = ELF_SECTION_STRTAB, .addralign = 1},
+        [LINKER_SECTION_RELA_TEXT] = {.type = ELF_SECTION_RELA,
+                                      .flags = ELF_FLAG_INFO_LINK,
+                                      .link = LINKER_SECTION_SYMTAB,
+                                      .info = LINKER_SECTION_TEXT,
+                                      .addralign = 8,
+                                      .entsize = sizeof(ElfRela)},
+        [LINKER_SECTION_NOTE_GNU_STACK] = {.type = ELF_SECTION_PROGBITS, .addralign = 1},
+        [LINKER_SECTION_SHSTRTAB] = {.type = ELF_SECTION_STRTAB, .addralign = 1},
+    };
+    headers[LINKER_SECTION_BSS].size = linker.bss_size;
+    Buffer file = {0};
+    linker_write_elf_object(&file, program->arch, sections, headers, linker_section_names, LINKER_SECTIONS_SIZE);
+    linker_free(&linker);
+
+    bool is_written = linker_write_file(&file, path, false);
+    arena_release(file.data);
+    return is_written;
+}
+
+// Resolves a relocation like the system linker would, place is the address the code runs at and target includes the addend
+void linker_relocate(uint8_t *code, RelocationKind kind, uint64_t place, uint64_t target) {
+    int64_t distance = target - place;
+    uint32_t instruction;
+    memcpy(&instruction, code, sizeof(uint32_t));
+    if (kind == RELOCATION_X86_64_PC32 || kind == RELOCATION_X86_64_PLT32) {
+        instruction = (int32_t)distance;
+    }
+    if (kind == RELOCATION_ARM64_CALL26 || kind == RELOCATION_ARM64_JUMP26) {
+        instruction |= (distance >> 2) & 0x3ffffff;
+    }
+    if (kind == RELOCATION_ARM64_ADR_PREL_PG_HI21) {
+        int64_t pages = (int64_t)((target & ~(uint64_t)0xfff) - (place & ~(uint64_t)0xfff)) >> 12;
+        instruction |= ((pages & 3) << 29) | (((pages >> 2) & 0x7ffff) << 5);
+    }
+    if (kind == RELOCATION_ARM64_ADD_ABS_LO12_NC) {
+        instruction |= (target & 0xfff) << 10;
+    }
+    if (kind == RELOCATION_ARM64_ADR_PREL_LO21) {
+        instruction |= ((distance & 3) << 29) | (((distance >> 2) & 0x7ffff) << 5);
+    }
+    memcpy(code, &instruction, sizeof(uint32_t));
+}
+
+// In memory
+void *linker_find_host_symbol(char *name) { return resolver_find(resolver_host(), name); }
+
+// Veneers, the veneer area is a stub that jumps to the absolute address stored right after it
+void linker_write_veneer(Arch arch, uint8_t *veneer, void *target) {
+    uint64_t address = (uint64_t)target;
+    if (arch == ARCH_X86_64) {
+        memcpy(veneer, (uint8_t[]){0xff, 0x25, 0x02, 0, 0, 0, 0xcc, 0xcc}, 8);  // jmp [rip + 2]; int3; int3
+    } else {
+        memcpy(veneer, (uint32_t[]){0x58000050, 0xD61F0200}, 8);  // ldr x16, 8; br x16
+    }
+    memcpy(veneer + 8, &address, sizeof(uint64_t));
+}
+
+// Checks if a direct call or bl anywhere in the text section reaches target
+bool linker_is_near(Arch arch, Section *text_section, void *target) {
+    int64_t range = arch == ARCH_X86_64 ? INT32_MAX : 0x8000000;
+    int64_t start_distance = (int64_t)((uintptr_t)target - (uintptr_t)text_section->data);
+    int64_t end_distance = start_distance - (int64_t)text_section->size;
+    return start_distance > -range && start_distance < range && end_distance > -range && end_distance < range;
+}
+
+// Code is mapped below the first host function it calls so the host libraries are within direct branch range
+void *linker_text_hint(Program *program, size_t size) {
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (!function->is_extern) continue;
+        uintptr_t address = (uintptr_t)linker_find_host_symbol(function->name);
+        uintptr_t distance = (program->arch == ARCH_X86_64 ? 0x40000000 : 0x4000000) + size;
+        if (address > distance) return (void *)((address - distance) & ~(uintptr_t)0xffff);
+    }
+    return NULL;
+}
+
+// Relocatable code in the text section is linked where it is, clib functions that are out of range are called
+// through a veneer after the code
+void linker_link(Program *program) {
+    Section *text_section = program->text_section;
+    uint8_t *text = text_section->data;
+    text_section->filled = align(text_section->filled, LINKER_VENEER_SIZE);
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (!function->is_extern) continue;
+        function->address = linker_find_host_symbol(function->name);
+        if (linker_is_near(program->arch, text_section, function->address)) continue;
+        linker_write_veneer(program->arch, text + text_section->filled, function->address);
+        function->address = text + text_section->filled;
+        text_section->filled += LINKER_VENEER_SIZE;
+    }
+
+    for (size_t i = 0; i < program->relocations.size; i++) {
+        Relocation *relocation = program->relocations.items[i];
+        uint8_t *target = relocation->function != NULL ? relocation->function->address : relocation->global->address;
+        linker_relocate(text + relocation->offset, relocation->kind, (uint64_t)(text + relocation->offset), (uint64_t)target + relocation->addend);
+    }
+    __builtin___clear_cache((char *)text, (char *)text + text_section->filled);
+}
+
+// Executable
+#define LINKER_START_SIZE 16
+#define LINKER_X86_64_PLT_SIZE 8
+#define LINKER_ARM64_PLT_SIZE 16
+
+static size_t linker_import_index(List *imports, Function *function) {
+    size_t index = 0;
+    while (imports->items[index] != function) index++;
+    return index;
+}
+
+bool linker_write_executable(Program *program, char *path) {
+    Function *main_function = program_find_function(program, "main");
+    if (main_function == NULL || main_function->is_extern) return false;
+    Linker linker;
+    linker_init(&linker, program);
+    bool is_x86_64 = program->arch == ARCH_X86_64;
+    uint64_t page_size = is_x86_64 ? 0x1000 : 0x10000;
+    size_t plt_size = is_x86_64 ? LINKER_X86_64_PLT_SIZE : LINKER_ARM64_PLT_SIZE;
+
+    // Extern functions are imported from libc through the GOT, a program without them is fully static
+    List imports = {0};
+    list_init(&imports);
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (function->is_extern) list_add(&imports, function);
+    }
+    Function exit_function = {.name = "exit", .is_extern = true};
+    Function *exit_import = program_find_function(program, "exit");
+    if (imports.size > 0 && (exit_import == NULL || !exit_import->is_extern)) {
+        exit_import = &exit_function;
+        list_add(&imports, exit_import);
+    }
+    bool is_dynamic = imports.size > 0;
+    size_t segments_size = is_dynamic ? 6 : 3;
+
+    // Text segment: headers, dynamic linking tables, _start, text, PLT and rodata
+    Buffer file = {0};
+    buffer_write(&file, NULL, sizeof(ElfHeader) + segments_size * sizeof(ElfProgramHeader));
+    char *interpreter = is_x86_64 ? "/lib64/ld-linux-x86-64.so.2" : "/lib/ld-linux-aarch64.so.1";
+    size_t interpreter_offset = 0, symbols_offset = 0, strings_offset = 0, strings_size = 0, hash_offset = 0, rela_offset = 0;
+    size_t libc_name = 0;
+    if (is_dynamic) {
+        interpreter_offset = buffer_write(&file, interpreter, strlen(interpreter) + 1);
+
+        Buffer strings = {0};
+        buffer_write(&strings, "", 1);
+        libc_name = buffer_write(&strings, "libc.so.6", sizeof("libc.so.6"));
+        Buffer symbols = {0};
+        buffer_write(&symbols, &(ElfSymbol){0}, sizeof(ElfSymbol));
+        for (size_t i = 0; i < imports.size; i++) {
+            Function *function = imports.items[i];
+            ElfSymbol symbol = {.name = buffer_write(&strings, function->name, strlen(function->name) + 1),
+                                .info = (ELF_SYMBOL_GLOBAL << 4) | ELF_SYMBOL_FUNC};
+            buffer_write(&symbols, &symbol, sizeof(ElfSymbol));
+        }
+        buffer_align(&file, 8);
+        symbols_offset = buffer_write(&file, symbols.data, symbols.size);
+        strings_size = strings.size;
+        strings_offset = buffer_write(&file, strings.data, strings.size);
+        arena_release(symbols.data);
+        arena_release(strings.data);
+
+        // One bucket that chains every symbol
+        uint32_t symbols_count = imports.size + 1;
+        buffer_align(&file, 8);
+        hash_offset = buffer_write(&file, &(uint32_t[3]){1, symbols_count, symbols_count - 1}, 3 * sizeof(uint32_t));
+        for (uint32_t i = 0; i < symbols_count; i++) buffer_write(&file, &(uint32_t){i > 0 ? i - 1 : 0}, sizeof(uint32_t));
+
+        buffer_align(&file, 8);
+        rela_offset = buffer_write(&file, NULL, imports.size * sizeof(ElfRela));
+    }
+    buffer_align(&file, 16);
+    size_t start_offset = buffer_write(&file, NULL, LINKER_START_SIZE);
+    size_t text_offset = buffer_write(&file, program->text_section->data, program->text_section->filled);
+    buffer_align(&file, 16);
+    size_t plt_offset = buffer_write(&file, NULL, imports.size * plt_size);
+    buffer_align(&file, 8);
+    size_t rodata_offset = buffer_write(&file, linker.sections[LINKER_SECTION_RODATA].data, linker.sections[LINKER_SECTION_RODATA].size);
+    size_t text_segment_size = file.size;
+
+    // Data segment: dynamic table, GOT, data and bss, it starts on a new page at the same page offset as in the file
+    buffer_align(&file, 16);
+    size_t data_segment_offset = file.size;
+    uint64_t data_segment_address = LINKER_BASE_ADDRESS + align(data_segment_offset, page_size) + data_segment_offset % page_size;
+    uint64_t data_delta = data_segment_address - (LINKER_BASE_ADDRESS + data_segment_offset);
+    ElfDynamic dynamics[12];
+    size_t dynamic_offset = is_dynamic ? buffer_write(&file, NULL, sizeof(dynamics)) : 0;
+    size_t got_offset = buffer_write(&file, NULL, imports.size * sizeof(uint64_t));
+    buffer_align(&file, 8);
+    size_t data_offset = buffer_write(&file, linker.sections[LINKER_SECTION_DATA].data, linker.sections[LINKER_SECTION_DATA].size);
+    buffer_align(&file, 8);
+    uint64_t bss_address = LINKER_BASE_ADDRESS + file.size + data_delta;
+    uint64_t data_segment_end = bss_address + linker.bss_size;
+
+    // Resolve the relocations of the program text
+    uint64_t text_address = LINKER_BASE_ADDRESS + text_offset;
+    uint64_t plt_address = LINKER_BASE_ADDRESS + plt_offset;
+    uint64_t got_address = LINKER_BASE_ADDRESS + got_offset + data_delta;
+    for (size_t i = 0; i < program->relocations.size; i++) {
+        Relocation *relocation = program->relocations.items[i];
+        uint64_t target;
+        if (relocation->function != NULL && relocation->function->is_extern) {
+            target = plt_address + linker_import_index(&imports, relocation->function) * plt_size;
+        } else if (relocation->function != NULL) {
+            target = text_address + (relocation->function->address - (uint8_t *)program->text_section->data);
+        } else {
+            size_t index = linker_global_index(program, relocation->global);
+            LinkerSection section = linker.global_sections[index];
+            if (section == LINKER_SECTION_RODATA) target = LINKER_BASE_ADDRESS + rodata_offset;
+            if (section == LINKER_SECTION_DATA) target = LINKER_BASE_ADDRESS + data_offset + data_delta;
+            if (section == LINKER_SECTION_BSS) target = bss_address;
+            target += linker.global_offsets[index];
+        }
+        linker_relocate(file.data + text_offset + relocation->offset, relocation->kind, text_address + relocation->offset, target + relocation->addend);
+    }
+
+    // _start calls main and exits with its result, through libc when it is loaded so stdio is flushed
+    uint8_t *start = file.data + start_offset;
+    uint64_t start_address = LINKER_BASE_ADDRESS + start_offset;
+    uint64_t main_address = text_address + (main_function->address - (uint8_t *)program->text_section->data);
+    uint64_t exit_address = is_dynamic ? plt_address + linker_import_index(&imports, exit_import) * plt_size : 0;
+    if (is_x86_64) {
+        // xor ebp, ebp; call main; mov edi, eax; mov eax, 60; syscall
+        memcpy(start, (uint8_t[]){0x31, 0xed, 0xe8, 0, 0, 0, 0, 0x89, 0xc7, 0xb8, 60, 0, 0, 0, 0x0f, 0x05}, LINKER_START_SIZE);
+        linker_relocate(start + 3, RELOCATION_X86_64_PLT32, start_address + 3, main_address - 4);
+        if (is_dynamic) {
+            start[9] = 0xe8;  // call exit
+            linker_relocate(start + 10, RELOCATION_X86_64_PLT32, start_address + 10, exit_address - 4);
+            start[14] = 0xcc;
+            start[15] = 0xcc;
+        }
+    } else {
+        uint32_t code[LINKER_START_SIZE / sizeof(uint32_t)] = {0x94000000, 0xD2800BA8, 0xD4000001, 0xD4200000};  // bl main; mov x8, 93; svc 0; brk 0
+        if (is_dynamic) code[1] = 0x94000000;                                                                      // bl exit
+        memcpy(start, code, LINKER_START_SIZE);
+        linker_relocate(start, RELOCATION_ARM64_CALL26, start_address, main_address);
+        if (is_dynamic) linker_relocate(start + 4, RELOCATION_ARM64_CALL26, start_address + 4, exit_address);
+    }
+
+    // Every PLT entry jumps to the address the dynamic linker wrote in its GOT entry
+    for (size_t i = 0; i < imports.size; i++) {
+        uint8_t *entry = file.data + plt_offset + i * plt_size;
+        uint64_t entry_address = plt_address + i * plt_size;
+        uint64_t got_entry_address = got_address + i * sizeof(uint64_t);
+        if (is_x86_64) {
+            memcpy(entry, (uint8_t[]){0xff, 0x25, 0, 0, 0, 0, 0xcc, 0xcc}, LINKER_X86_64_PLT_SIZE);  // jmp [rip + imm]
+            linker_relocate(entry + 2, RELOCATION_X86_64_PC32, entry_address + 2, got_entry_address - 4);
+        } else {
+            uint32_t code[LINKER_ARM64_PLT_SIZE / sizeof(uint32_t)] = {
+                0x90000010,                                        // adrp x16, got_entry
+                0xF9400211 | ((got_entry_address & 0xfff) >> 3) << 10,  // ldr x17, [x16, :lo12:got_entry]
+                0xD61F0220,                                        // br x17
+                0xD503201F,                                        // nop
+            };
+            memcpy(entry, code, LINKER_ARM64_PLT_SIZE);
+            linker_relocate(entry, RELOCATION_ARM64_ADR_PREL_PG_HI21, entry_address, got_entry_address);
+        }
+
+        ElfRela rela = {.offset = got_entry_address, .info = ((uint64_t)(i + 1) << 32) | (is_x86_64 ? ELF_R_X86_64_GLOB_DAT : ELF_R_AARCH64_GLOB_DAT)};
+        memcpy(file.data + rela_offset + i * sizeof(ElfRela), &rela, sizeof(ElfRela));
+    }
+
+    // Dynamic table and program headers
+    uint64_t dynamic_address = LINKER_BASE_ADDRESS + dynamic_offset + data_delta;
+    if (is_dynamic) {
+        memcpy(dynamics, (ElfDynamic[12]){
+            {ELF_DYNAMIC_NEEDED, libc_name},
+            {ELF_DYNAMIC_HASH, LINKER_BASE_ADDRESS + hash_offset},
+            {ELF_DYNAMIC_STRTAB, LINKER_BASE_ADDRESS + strings_offset},
+            {ELF_DYNAMIC_STRSZ, strings_size},
+            {ELF_DYNAMIC_SYMTAB, LINKER_BASE_ADDRESS + symbols_offset},
+            {ELF_DYNAMIC_SYMENT, sizeof(ElfSymbol)},
+            {ELF_DYNAMIC_RELA, LINKER_BASE_ADDRESS + rela_offset},
+            {ELF_DYNAMIC_RELASZ, imports.size * sizeof(ElfRela)},
+            {ELF_DYNAMIC_RELAENT, sizeof(ElfRela)},
+            {ELF_DYNAMIC_BIND_NOW, 0},
+            {ELF_DYNAMIC_DEBUG, 0},
+            {ELF_DYNAMIC_NULL, 0},
+        }, sizeof(dynamics));
+        memcpy(file.data + dynamic_offset, dynamics, sizeof(dynamics));
+    }
+
+    ElfProgramHeader segments[6];
+    size_t segment = 0;
+    if (is_dynamic) {
+        segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_PHDR,
+                                                 .flags = ELF_SEGMENT_READ,
+                                                 .offset = sizeof(ElfHeader),
+                                                 .vaddr = LINKER_BASE_ADDRESS + sizeof(ElfHeader),
+                                                 .paddr = LINKER_BASE_ADDRESS + sizeof(ElfHeader),
+                                                 .filesz = segments_size * sizeof(ElfProgramHeader),
+                                                 .memsz = segments_size * sizeof(ElfProgramHeader),
+                                                 .align = 8};
+        segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_INTERP,
+                                                 .flags = ELF_SEGMENT_READ,
+                                                 .offset = interpreter_offset,
+                                                 .vaddr = LINKER_BASE_ADDRESS + interpreter_offset,
+                                                 .paddr = LINKER_BASE_ADDRESS + interpreter_offset,
+                                                 .filesz = strlen(interpreter) + 1,
+                                                 .memsz = strlen(interpreter) + 1,
+                                                 .align = 1};
+    }
+    segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_LOAD,
+                                             .flags = ELF_SEGMENT_READ | ELF_SEGMENT_EXECUTE,
+                                             .vaddr = LINKER_BASE_ADDRESS,
+                                             .paddr = LINKER_BASE_ADDRESS,
+                                             .filesz = text_segment_size,
+                                             .memsz = text_segment_size,
+                                             .align = page_size};
+    segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_LOAD,
+                                             .flags = ELF_SEGMENT_READ | ELF_SEGMENT_WRITE,
+                                             .offset = data_segment_offset,
+                                             .vaddr = data_segment_address,
+                                             .paddr = data_segment_address,
+                                             .filesz = file.size - data_segment_offset,
+                                             .memsz = data_segment_end - data_segment_address,
+                                             .align = page_size};
+    if (is_dynamic) {
+        segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_DYNAMIC,
+                                                 .flags = ELF_SEGMENT_READ | ELF_SEGMENT_WRITE,
+                                                 .offset = dynamic_offset,
+                                                 .vaddr = dynamic_address,
+                                                 .paddr = dynamic_address,
+                                                 .filesz = sizeof(dynamics),
+                                                 .memsz = sizeof(dynamics),
+                                                 .align = 8};
+    }
+    segments[segment++] = (ElfProgramHeader){.type = ELF_SEGMENT_GNU_STACK, .flags = ELF_SEGMENT_READ | ELF_SEGMENT_WRITE, .align = 16};
+    memcpy(file.data + sizeof(ElfHeader), segments, segments_size * sizeof(ElfProgramHeader));
+
+    ElfHeader header = {
+        .ident = {0x7f, 'E', 'L', 'F', ELF_CLASS_64, ELF_DATA_LSB, ELF_VERSION_CURRENT},
+        .type = ELF_TYPE_EXEC,
+        .machine = is_x86_64 ? ELF_MACHINE_X86_64 : ELF_MACHINE_AARCH64,
+        .version = ELF_VERSION_CURRENT,
+        .entry = start_address,
+        .phoff = sizeof(ElfHeader),
+        .ehsize = sizeof(ElfHeader),
+        .phentsize = sizeof(ElfProgramHeader),
+        .phnum = segments_size,
+    };
+    memcpy(file.data, &header, sizeof(ElfHeader));
+    list_free(&imports, NULL);
+    linker_free(&linker);
+
+    bool is_written = linker_write_file(&file, path, true);
+    arena_release(file.data);
+    return is_written;
+}
@@ -4,10 +4,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "batch.h"
+#include "cache.h"
 #include "codegen/codegen.h"
+#include "disassembler.h"
 #include "lexer.h"
+#include "linker.h"
 #include "object.h"
+#include "optimizer/optimizer.h"
 #include "parser.h"
+#include "profiler.h"
+#include "resolver.h"
+#include "server.h"
+#include "timer.h"
+#include "utils/arena.h"
+#include "utils/thread.h"
 #include "utils/utils.h"
 
 typedef int64_t (*JitFunc)(void);
@@ -16,111 +27,482 @@ typedef struct File {
     char *path;
     FILE *file;
     char *text;
+    Token *tokens;
+    size_t tokens_size;
+    Thread lexer_thread;
 } File;
 
-int main(int argc, char **argv) {
-    // Print help text
-    if (argc == 1) {
-        printf("Bassie C Compiler\n");
-        return EXIT_FAILURE;
-    }
+typedef struct Options {
+    bool debug;
+    bool debug_info;
+    bool optimize;
+    bool compile_only;
+    bool use_cache;
+    bool is_server;
+    bool is_client;
+    char *socket_path;
+    char *test_batch_path;
+    char *output_path;
+    CodegenMode mode;
+    size_t unroll_factor;
+    size_t jobs;
+    Arch arch;
+    ProfilerMode profiler;
+    Timer *timer;
+    bool is_time_report_json;
+    List libraries;
+    List files;
+} Options;
 
-    // Parse arguments
-    bool debug = false;
-    Arch arch = ARCH_X86_64;
+static void options_parse(Options *options, int32_t argc, char **argv) {
+    *options = (Options){.mode = CODEGEN_EAGER, .unroll_factor = 4, .jobs = thread_cpus(), .arch = ARCH_X86_64};
 #ifdef __aarch64__
-    arch = ARCH_ARM64;
+    options->arch = ARCH_ARM64;
 #endif
-    List files = {0};
-    list_init(&files);
+    list_init(&options->libraries);
+    list_init(&options->files);
     for (int32_t i = 1; i < argc; i++) {
         if (!strcmp(argv[i], "-d") || !strcmp(argv[i], "--debug")) {
-            debug = true;
+            options->debug = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-g") || !strcmp(argv[i], "--debug-info")) {
+            options->debug_info = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-O") || !strcmp(argv[i], "--optimize")) {
+            options->optimize = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-l") || !strcmp(argv[i], "--lazy")) {
+            options->mode = CODEGEN_LAZY;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-t") || !strcmp(argv[i], "--tiered")) {
+            options->mode = CODEGEN_TIERED;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-c") || !strcmp(argv[i], "--compile")) {
+            options->compile_only = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--cache")) {
+            options->use_cache = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--server")) {
+            options->is_server = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--connect")) {
+            options->is_client = true;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--socket")) {
+            i++;
+            options->socket_path = argv[i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--test-batch")) {
+            i++;
+            options->test_batch_path = argv[i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--time-report") || !strcmp(argv[i], "--time-report=json")) {
+            options->timer = timer_new();
+            options->is_time_report_json = !strcmp(argv[i], "--time-report=json");
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--perf-map")) {
+            options->profiler = PROFILER_PERF_MAP;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--jitdump")) {
+            options->profiler = PROFILER_JITDUMP;
+            continue;
+        }
+
+        if (!strcmp(argv[i], "--library")) {
+            i++;
+            list_add(&options->libraries, argv[i]);
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-o") || !strcmp(argv[i], "--output")) {
+            i++;
+            options->output_path = argv[i];
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-u") || !strcmp(argv[i], "--unroll")) {
+            i++;
+            options->unroll_factor = strtoul(argv[i], NULL, 10);
+            continue;
+        }
+
+        if (!strcmp(argv[i], "-j") || !strcmp(argv[i], "--jobs")) {
+            i++;
+            options->jobs = strtoul(argv[i], NULL, 10);
+            if (options->jobs == 0) options->jobs = 1;
             continue;
         }
 
         if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--arch")) {
             i++;
             if (!strcmp(argv[i], "x86_64")) {
-                arch = ARCH_X86_64;
+                options->arch = ARCH_X86_64;
             }
             if (!strcmp(argv[i], "arm64")) {
-                arch = ARCH_ARM64;
+                options->arch = ARCH_ARM64;
             }
             continue;
         }
 
         if (!strcmp(argv[i], "-i") || !strcmp(argv[i], "--inline")) {
             i++;
-            File *file = calloc(1, sizeof(File));
+            File *file = arena_calloc(1, sizeof(File));
             file->path = "./inline";
             file->text = argv[i];
-            list_add(&files, file);
+            list_add(&options->files, file);
             continue;
         }
 
         if (!strcmp(argv[i], "-")) {
-            File *file = calloc(1, sizeof(File));
+            File *file = arena_calloc(1, sizeof(File));
             file->path = "./stdin";
             file->file = stdin;
-            list_add(&files, file);
+            list_add(&options->files, file);
         } else {
-            File *file = calloc(1, sizeof(File));
+            File *file = arena_calloc(1, sizeof(File));
             file->path = argv[i];
             file->file = fopen(argv[i], "rb");
-            list_add(&files, file);
+            list_add(&options->files, file);
         }
     }
+}
 
-    // Create program
-    Program program = {.arch = arch};
-    list_init(&program.globals);
-    list_init(&program.functions);
+static void program_init(Program *program, Arch arch) {
+    *program = (Program){.arch = arch};
+    list_init(&program->globals);
+    list_init(&program->functions);
+    list_init(&program->relocations);
+}
 
-    // Read input files
-    for (size_t i = 0; i < files.size; i++) {
-        File *file = files.items[i];
+static void files_read(Options *options) {
+    timer_start(options->timer);
+    for (size_t i = 0; i < options->files.size; i++) {
+        File *file = options->files.items[i];
         if (file->file != NULL) {
             file->text = file_read(file->file);
             fclose(file->file);
         }
     }
+    timer_stop(options->timer, TIMER_PHASE_READ);
+}
 
-    // Process input files
-    for (size_t i = 0; i < files.size; i++) {
-        File *file = files.items[i];
+static void file_lex(void *argument) {
+    File *file = argument;
+    file->tokens = lexer(file->path, file->text, &file->tokens_size);
+}
 
-        // Lexer
-        size_t tokens_size;
-        Token *tokens = lexer(file->path, file->text, &tokens_size);
-        if (debug) {
-            for (size_t i = 0; i < tokens_size; i++) {
-                Token *token = &tokens[i];
+// Files are lexed on more threads ahead of the parser, the parser takes them in order because a file sees the
+// declarations of the files before it, the lexer time is the time the parser waits for a file
+static bool files_parse(Options *options, Program *program, size_t first_file) {
+    size_t lexed_files = first_file;
+    bool is_parsed = true;
+    for (size_t i = first_file; i < options->files.size; i++) {
+        while (is_parsed && lexed_files < options->files.size && lexed_files < i + options->jobs) {
+            File *file = options->files.items[lexed_files++];
+            thread_start(&file->lexer_thread, file_lex, file);
+        }
+        if (i >= lexed_files) break;
+
+        // Lexer, the errors of files after a failed file aren't reported
+        File *file = options->files.items[i];
+        timer_start(options->timer);
+        thread_join(&file->lexer_thread, is_parsed);
+        timer_stop(options->timer, TIMER_PHASE_LEXER);
+        if (!is_parsed) continue;
+        if (file->tokens == NULL) {
+            is_parsed = false;
+            continue;
+        }
+        if (options->timer != NULL) options->timer->tokens_size += file->tokens_size;
+        if (options->debug) {
+            for (size_t i = 0; i < file->tokens_size; i++) {
+                Token *token = &file->tokens[i];
                 printf("%s ", token_kind_to_string(token->kind));
             }
             printf("\n");
         }
 
         // Parser
-        parser(&program, tokens, tokens_size);
+        size_t first_node = nodes_size();
+        timer_start(options->timer);
+        is_parsed = parser(program, file->tokens, file->tokens_size);
+        timer_stop(options->timer, TIMER_PHASE_PARSER);
+        if (options->timer != NULL) options->timer->nodes_size += nodes_size() - first_node;
     }
-    if (debug) {
+    return is_parsed;
+}
+
+// The time report goes to stderr because the program itself can write to stdout
+static void time_report(Options *options) {
+    if (options->timer != NULL) timer_print(options->timer, stderr, options->is_time_report_json);
+}
+
+// Lazy and tiered code makes the pages it patches writable only while it writes them, the time report comes after the run
+static int64_t execute(Options *options, Program *program) {
+    if (!section_make_executable(program->text_section)) {
+        fprintf(stderr, "Can't make the text section executable\n");
+        return EXIT_FAILURE;
+    }
+    timer_start(options->timer);
+    int64_t result = ((JitFunc)program->main_func)();
+    timer_stop(options->timer, TIMER_PHASE_RUN);
+    time_report(options);
+    return result;
+}
+
+// Compiles the read input files into program, which already holds the first parsed files, and runs or writes it
+static int32_t run(Options *options, Program *program, size_t parsed_files) {
+    // Extern functions are also searched in the extra libraries
+    for (size_t i = 0; i < options->libraries.size; i++) {
+        char *path = options->libraries.items[i];
+        if (!resolver_add_library(resolver_host(), path)) {
+            fprintf(stderr, "Can't load library: %s\n", path);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Object files and executables are compiled ahead of time with relocations for the linker
+    bool is_relocatable = options->compile_only || options->output_path != NULL;
+    CodegenMode mode = is_relocatable ? CODEGEN_EAGER : options->mode;
+    program->is_relocatable = is_relocatable;
+    program->is_portable = is_relocatable;
+
+    // Profiled and debugged programs describe their functions while they are emitted, so they skip the code cache, the
+    // dump also shows the source lines of the code
+    if (!is_relocatable && !profiler_start(options->profiler, options->arch)) {
+        fprintf(stderr, "Can't write profiler file\n");
+        return EXIT_FAILURE;
+    }
+    program->has_debug_info = options->debug || (!is_relocatable && (options->debug_info || options->profiler == PROFILER_JITDUMP));
+
+    // Eager programs can come from the code cache, cached code is relocatable and linked in memory
+    char *cache_file = NULL;
+    if (options->use_cache && mode == CODEGEN_EAGER && !is_relocatable && !options->debug && !program->has_debug_info &&
+        options->profiler == PROFILER_NONE) {
+        uint64_t hash = cache_hash(CACHE_HASH_OFFSET, CACHE_COMPILER_VERSION, sizeof(CACHE_COMPILER_VERSION));
+        hash = cache_hash(hash, &options->arch, sizeof(Arch));
+        hash = cache_hash(hash, &(bool){codegen_has_avx2()}, sizeof(bool));
+        hash = cache_hash(hash, &options->optimize, sizeof(bool));
+        hash = cache_hash(hash, &options->unroll_factor, sizeof(size_t));
+        for (size_t i = 0; i < options->files.size; i++) {
+            File *file = options->files.items[i];
+            hash = cache_hash(hash, file->text, strlen(file->text) + 1);
+        }
+        cache_file = cache_path(hash);
+        program->is_relocatable = cache_file != NULL;
+    }
+    if (cache_file != NULL) {
+        Program cached_program;
+        program_init(&cached_program, options->arch);
+        timer_start(options->timer);
+        bool is_loaded = cache_load(&cached_program, cache_file);
+        if (is_loaded) linker_link(&cached_program);
+        timer_stop(options->timer, TIMER_PHASE_LINKER);
+        if (is_loaded) return execute(options, &cached_program);
+    }
+
+    // Optimizer, lazy functions are optimized when they are compiled and tiered functions when they are hot
+    if (!files_parse(options, program, parsed_files)) return EXIT_FAILURE;
+    if (options->optimize && mode == CODEGEN_EAGER) {
+        timer_start(options->timer);
+        optimizer(program, options->unroll_factor);
+        timer_stop(options->timer, TIMER_PHASE_OPTIMIZER);
+    }
+    if (options->debug) {
         printf("\n");
-        program_dump(stdout, &program);
+        program_dump(stdout, program);
     }
 
-    // Codegen program
-    program.text_section = section_new(4 * 1024);
-    program.data_section = section_new(4 * 1024);
-    codegen(&program);
-    if (debug) {
+    // Codegen program, lazy and tiered functions are compiled later while the program runs and aren't in the report
+    timer_start(options->timer);
+    // The text section is mapped near the host libraries and the data section right below it
+    program->text_section = section_new_near(16 * 1024 * 1024, linker_text_hint(program, 16 * 1024 * 1024));
+    size_t data_size = align(program->globals_size + program->functions.size * sizeof(int32_t), 4 * 1024) + 4 * 1024;
+    program->data_section = section_new_near(data_size, (uint8_t *)program->text_section->data - data_size);
+    bool is_generated = codegen(program, mode, options->optimize, options->unroll_factor, options->jobs);
+    timer_stop(options->timer, TIMER_PHASE_CODEGEN);
+    if (!is_generated) return EXIT_FAILURE;
+    if (options->timer != NULL) options->timer->code_size = program->text_section->filled;
+    if (options->debug) {
         printf(".text:\n");
-        section_dump(stdout, program.text_section);
+        disassembler_dump(stdout, program);
+        printf("\nLabels: %zu | Fixups: %zu | Relocations: %zu\n", program->labels_size, program->fixups_size, program->relocations_size);
         printf("\n.data:\n");
-        section_dump(stdout, program.data_section);
+        section_dump(stdout, program->data_section);
+    }
+
+    // Write object file
+    char *output_path = options->output_path;
+    if (options->compile_only) {
+        if (output_path == NULL) {
+            File *file = options->files.items[0];
+            char *extension = strrchr(file->path, '.');
+            size_t length = extension != NULL && strchr(extension, '/') == NULL ? (size_t)(extension - file->path) : strlen(file->path);
+            output_path = string_format("%.*s.o", (int)length, file->path);
+        }
+        timer_start(options->timer);
+        bool is_written = linker_write_object(program, output_path);
+        timer_stop(options->timer, TIMER_PHASE_LINKER);
+        if (!is_written) {
+            fprintf(stderr, "Can't write object file: %s\n", output_path);
+            return EXIT_FAILURE;
+        }
+        time_report(options);
+        return EXIT_SUCCESS;
+    }
+
+    // Write executable
+    if (output_path != NULL) {
+        timer_start(options->timer);
+        bool is_written = linker_write_executable(program, output_path);
+        timer_stop(options->timer, TIMER_PHASE_LINKER);
+        if (!is_written) {
+            fprintf(stderr, "Can't write executable: %s\n", output_path);
+            return EXIT_FAILURE;
+        }
+        time_report(options);
+        return EXIT_SUCCESS;
+    }
+
+    // Store the program in the code cache before it is linked
+    if (cache_file != NULL) {
+        timer_start(options->timer);
+        cache_store(program, cache_file);
+        linker_link(program);
+        timer_stop(options->timer, TIMER_PHASE_LINKER);
     }
 
     // Execute program
-    section_make_executable(program.text_section);
-    return ((JitFunc)program.main_func)();
+    return execute(options, program);
+}
+
+// The server and the test batch parse their own input files once, requests that start with the same files continue
+// from that program
+typedef struct Prelude {
+    Options options;
+    Program program;
+} Prelude;
+
+static Prelude *prelude_new(Options *options) {
+    Prelude *prelude = arena_calloc(1, sizeof(Prelude));
+    prelude->options = *options;
+    files_read(&prelude->options);
+    program_init(&prelude->program, options->arch);
+    if (!files_parse(&prelude->options, &prelude->program, 0)) return NULL;
+    for (size_t i = 0; i < prelude->program.functions.size; i++) {
+        Function *function = prelude->program.functions.items[i];
+        if (function->is_extern) linker_find_host_symbol(function->name);
+    }
+    return prelude;
+}
+
+static int32_t server_request(void *context, int32_t argc, char **argv) {
+    Prelude *prelude = context;
+    Options options;
+    options_parse(&options, argc, argv);
+    files_read(&options);
+
+    bool is_warm = options.arch == prelude->options.arch && options.files.size >= prelude->options.files.size;
+    for (size_t i = 0; i < prelude->options.files.size && is_warm; i++) {
+        File *file = options.files.items[i];
+        File *prelude_file = prelude->options.files.items[i];
+        is_warm = !strcmp(file->text, prelude_file->text);
+    }
+    if (is_warm) return run(&options, &prelude->program, prelude->options.files.size);
+
+    Program program;
+    program_init(&program, options.arch);
+    return run(&options, &program, 0);
+}
+
+// A batch case is compiled with the flags of the batch after its headers, the dump is only made for failing cases
+static int32_t batch_request(void *context, char *source, bool is_debug) {
+    Prelude *prelude = context;
+    Options options = prelude->options;
+    options.debug = is_debug;
+    options.files = (List){0};
+    list_init(&options.files);
+    for (size_t i = 0; i < prelude->options.files.size; i++) list_add(&options.files, prelude->options.files.items[i]);
+    File *file = arena_calloc(1, sizeof(File));
+    file->path = "./test";
+    file->text = source;
+    list_add(&options.files, file);
+    return run(&options, &prelude->program, prelude->options.files.size);
+}
+
+int main(int argc, char **argv) {
+    // Print help text
+    if (argc == 1) {
+        printf("Bassie C Compiler\n");
+        return EXIT_FAILURE;
+    }
+
+    Options options;
+    options_parse(&options, argc, argv);
+    char *socket_path = options.socket_path;
+    if ((options.is_client || options.is_server) && socket_path == NULL) {
+        socket_path = server_default_path();
+        if (socket_path == NULL) return EXIT_FAILURE;
+    }
+
+    // Forward everything except the client arguments to the compile server
+    if (options.is_client) {
+        List arguments = {0};
+        list_init(&arguments);
+        for (int32_t i = 1; i < argc; i++) {
+            if (!strcmp(argv[i], "--connect")) continue;
+            if (!strcmp(argv[i], "--socket")) {
+                i++;
+                continue;
+            }
+            list_add(&arguments, argv[i]);
+        }
+        return server_connect(socket_path, arguments.size, (char **)arguments.items);
+    }
+
+    // The server keeps its parsed files, the resolved clib functions and its heap warm for every forked request
+    if (options.is_server) {
+        Prelude *prelude = prelude_new(&options);
+        if (prelude == NULL) return EXIT_FAILURE;
+        return server_listen(socket_path, server_request, prelude);
+    }
+
+    // The test batch runs every case in a child of the process that parsed the headers
+    if (options.test_batch_path != NULL) {
+        Prelude *prelude = prelude_new(&options);
+        if (prelude == NULL) return EXIT_FAILURE;
+        return batch_run(options.test_batch_path, batch_request, prelude);
+    }
+
+    Program program;
+    program_init(&program, options.arch);
+    files_read(&options);
+    return run(&options, &program, 0);
 }
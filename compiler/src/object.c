@@ -2,26 +2,46 @@
 
 #include <stdlib.h>
 
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "utils/arena.h"
 #include "utils/utils.h"
 
 // Section
-Section *section_new(size_t size) {
-    Section *section = calloc(1, sizeof(Section));
+Section *section_new(size_t size) { return section_new_near(size, NULL); }
+
+// The address is only a hint, the section is placed somewhere else when it is taken
+Section *section_new_near(size_t size, void *address) {
+    Section *section = arena_calloc(1, sizeof(Section));
     section->size = size;
 #ifdef _WIN32
-    section->data = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, SECTION_READWRITE);
+    section->data = VirtualAlloc(address, size, MEM_COMMIT | MEM_RESERVE, SECTION_READWRITE);
+    if (section->data == NULL) section->data = VirtualAlloc(NULL, size, MEM_COMMIT | MEM_RESERVE, SECTION_READWRITE);
 #else
-    section->data = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    section->data = mmap(address, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 #endif
     return section;
 }
 
-bool section_make_executable(Section *section) {
+bool section_make_executable(Section *section) { return section_protect(section, section->data, section->size, false); }
+
+// Pages are either writable or executable, never both, so the protection also holds where writable code is refused
+bool section_protect(Section *section, void *address, size_t size, bool is_writable) {
+#ifdef _WIN32
+    size_t page_size = 4 * 1024;
+#else
+    size_t page_size = sysconf(_SC_PAGESIZE);
+#endif
+    uint8_t *begin = (uint8_t *)section->data + ((uint8_t *)address - (uint8_t *)section->data) / page_size * page_size;
+    uint8_t *end = (uint8_t *)section->data + align((uint8_t *)address + size - (uint8_t *)section->data, page_size);
+    if (end > (uint8_t *)section->data + section->size) end = (uint8_t *)section->data + section->size;
 #ifdef _WIN32
     uint32_t oldProtect;
-    return VirtualProtect(section->data, section->size, SECTION_EXECUTE_READ, &oldProtect) != 0;
+    return VirtualProtect(begin, end - begin, is_writable ? SECTION_READWRITE : SECTION_EXECUTE_READ, &oldProtect) != 0;
 #else
-    return mprotect(section->data, section->size, PROT_READ | PROT_EXEC) != -1;
+    return mprotect(begin, end - begin, is_writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != -1;
 #endif
 }
 
@@ -44,5 +64,5 @@ void section_free(Section *section) {
 #else
     munmap(section->data, section->size);
 #endif
-    free(section);
+    arena_release(section);
 }
@@ -0,0 +1,320 @@
+#include <stdlib.h>
+
+#include "optimizer/optimizer.h"
+#include "utils/arena.h"
+
+// Common subexpression elimination
+typedef struct Cse {
+    Optimizer *optimizer;
+    List nodes;
+    List locals;
+    List temps;
+    List values;
+} Cse;
+
+// Temps are looked through so expressions that are partly replaced still match
+static Node *cse_value(Cse *cse, Node *node) {
+    if (node->kind != NODE_LOCAL) return node;
+    for (size_t i = 0; i < cse->temps.size; i++) {
+        if (cse->temps.items[i] == node->local) return cse->values.items[i];
+    }
+    return node;
+}
+
+static bool cse_equals(Cse *cse, Node *lhs, Node *rhs) {
+    lhs = cse_value(cse, lhs);
+    rhs = cse_value(cse, rhs);
+    if (lhs == rhs) return true;
+    if (lhs->kind != rhs->kind) return false;
+    if (lhs->kind > NODE_UNARY_BEGIN && lhs->kind < NODE_UNARY_END) {
+        return lhs->type->kind == rhs->type->kind && lhs->type->size == rhs->type->size && cse_equals(cse, lhs->unary, rhs->unary);
+    }
+    if (lhs->kind > NODE_OPERATION_BEGIN && lhs->kind < NODE_OPERATION_END && lhs->kind != NODE_ASSIGN) {
+        return cse_equals(cse, lhs->lhs, rhs->lhs) && cse_equals(cse, lhs->rhs, rhs->rhs);
+    }
+    return optimizer_equals(lhs, rhs);
+}
+
+static bool cse_is_pure(Node *node) {
+    if (node->kind == NODE_INTEGER || node->kind == NODE_LOCAL || node->kind == NODE_GLOBAL) return true;
+    if (node->kind == NODE_ADDR) {
+        if (node->unary->kind == NODE_LOCAL || node->unary->kind == NODE_GLOBAL) return true;
+        return node->unary->kind == NODE_DEREF && cse_is_pure(node->unary->unary);
+    }
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) return cse_is_pure(node->unary);
+
+    // Division can trap so it is never moved in front of other side effects
+    if (node->kind == NODE_ASSIGN || node->kind == NODE_DIV || node->kind == NODE_MOD) return false;
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) return cse_is_pure(node->lhs) && cse_is_pure(node->rhs);
+    return false;
+}
+
+static bool cse_is_candidate(Node *node) { return node->type != NULL && !optimizer_is_trivial(node) && cse_is_pure(node); }
+
+static size_t cse_size(Node *node) {
+    if (node->kind == NODE_ADDR) return 1 + (node->unary->kind == NODE_DEREF ? cse_size(node->unary->unary) : 1);
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) return 1 + cse_size(node->unary);
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) return 1 + cse_size(node->lhs) + cse_size(node->rhs);
+    return 1;
+}
+
+// Checks if a pure expression reads memory that a store or call could change
+static bool cse_reads_memory(Cse *cse, Node *node) {
+    node = cse_value(cse, node);
+    if (node->kind == NODE_LOCAL) return node->type->kind != TYPE_ARRAY && cse->optimizer->has_escaped_locals;
+    if (node->kind == NODE_GLOBAL) return node->type->kind != TYPE_ARRAY;
+    if (node->kind == NODE_ADDR) return node->unary->kind == NODE_DEREF && cse_reads_memory(cse, node->unary->unary);
+    if (node->kind == NODE_DEREF) return node->type->kind != TYPE_ARRAY || cse_reads_memory(cse, node->unary);
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) return cse_reads_memory(cse, node->unary);
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) return cse_reads_memory(cse, node->lhs) || cse_reads_memory(cse, node->rhs);
+    return false;
+}
+
+static bool cse_uses_local(Cse *cse, Node *node, Local *local) {
+    node = cse_value(cse, node);
+    if (node->kind == NODE_LOCAL) return node->local == local;
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) return cse_uses_local(cse, node->unary, local);
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        return cse_uses_local(cse, node->lhs, local) || cse_uses_local(cse, node->rhs, local);
+    }
+    return false;
+}
+
+// Checks if executing region can change the value of expression
+static bool cse_is_killed(Cse *cse, Node *expression, Node *region) {
+    if (region == NULL) return false;
+    if (region->kind == NODE_CALL && cse_reads_memory(cse, expression)) return true;
+    if (region->kind == NODE_VECTOR) {
+        Vector *vector = region->vector;
+        return cse_uses_local(cse, expression, vector->induction) || (vector->accumulator != NULL && cse_uses_local(cse, expression, vector->accumulator)) ||
+               (vector->destination != NULL && cse_reads_memory(cse, expression));
+    }
+    // A store to a local whose address was taken can change what a pointer reads
+    if (region->kind == NODE_ASSIGN) {
+        bool is_local = region->lhs->kind == NODE_LOCAL;
+        if (is_local && cse_uses_local(cse, expression, region->lhs->local)) return true;
+        if ((!is_local || cse->optimizer->has_escaped_locals) && cse_reads_memory(cse, expression)) return true;
+    }
+
+    if (region->kind == NODE_NODES || region->kind == NODE_CALL) {
+        for (size_t i = 0; i < region->nodes.size; i++) {
+            if (cse_is_killed(cse, expression, region->nodes.items[i])) return true;
+        }
+        return false;
+    }
+    if (region->kind == NODE_TENARY || region->kind == NODE_IF || region->kind == NODE_WHILE || region->kind == NODE_DOWHILE) {
+        return cse_is_killed(cse, expression, region->condition) || cse_is_killed(cse, expression, region->then_block) ||
+               cse_is_killed(cse, expression, region->else_block);
+    }
+    if (region->kind == NODE_RETURN || (region->kind > NODE_UNARY_BEGIN && region->kind < NODE_UNARY_END)) {
+        return cse_is_killed(cse, expression, region->unary);
+    }
+    if (region->kind > NODE_OPERATION_BEGIN && region->kind < NODE_OPERATION_END) {
+        return cse_is_killed(cse, expression, region->lhs) || cse_is_killed(cse, expression, region->rhs);
+    }
+    return false;
+}
+
+// Same as cse_is_killed but ignores the final store of an assign statement, which happens after all its reads
+static bool cse_is_killed_inside(Cse *cse, Node *expression, Node *statement) {
+    if (statement->kind != NODE_ASSIGN) return cse_is_killed(cse, expression, statement);
+    if (statement->lhs->kind == NODE_DEREF && cse_is_killed(cse, expression, statement->lhs->unary)) return true;
+    return cse_is_killed(cse, expression, statement->rhs);
+}
+
+static void cse_kill(Cse *cse, Node *region) {
+    for (size_t i = 0; i < cse->nodes.size; i++) {
+        if (cse->nodes.items[i] != NULL && cse_is_killed(cse, cse->nodes.items[i], region)) cse->nodes.items[i] = NULL;
+    }
+}
+
+static bool cse_contains(Cse *cse, Node *node, Node *expression, bool is_lvalue) {
+    if (node == NULL) return false;
+    if (is_lvalue) return node->kind == NODE_DEREF && cse_contains(cse, node->unary, expression, false);
+    if (cse_equals(cse, node, expression)) return true;
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            if (cse_contains(cse, node->nodes.items[i], expression, false)) return true;
+        }
+        return false;
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        return cse_contains(cse, node->condition, expression, false) || cse_contains(cse, node->then_block, expression, false) ||
+               cse_contains(cse, node->else_block, expression, false);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        return cse_contains(cse, node->unary, expression, node->kind == NODE_ADDR);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        return cse_contains(cse, node->lhs, expression, node->kind == NODE_ASSIGN) || cse_contains(cse, node->rhs, expression, false);
+    }
+    return false;
+}
+
+// Replace expressions that are already stored in a local, also in conditionally executed parts
+static void cse_replace(Cse *cse, Node **slot, bool is_lvalue, Node *statement) {
+    Node *node = *slot;
+    if (node == NULL) return;
+    if (is_lvalue) {
+        if (node->kind == NODE_DEREF) cse_replace(cse, &node->unary, false, statement);
+        return;
+    }
+
+    if (cse_is_candidate(node)) {
+        for (size_t i = 0; i < cse->nodes.size; i++) {
+            if (cse->nodes.items[i] != NULL && cse_equals(cse, cse->nodes.items[i], node) && !cse_is_killed_inside(cse, node, statement)) {
+                *slot = optimizer_local_node(node->token, cse->locals.items[i]);
+                return;
+            }
+        }
+    }
+
+    if (node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) cse_replace(cse, (Node **)&node->nodes.items[i], false, statement);
+    }
+    if (node->kind == NODE_TENARY) {
+        cse_replace(cse, &node->condition, false, statement);
+        cse_replace(cse, &node->then_block, false, statement);
+        cse_replace(cse, &node->else_block, false, statement);
+    }
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) {
+        cse_replace(cse, &node->unary, node->kind == NODE_ADDR, statement);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        cse_replace(cse, &node->lhs, node->kind == NODE_ASSIGN, statement);
+        cse_replace(cse, &node->rhs, false, statement);
+    }
+}
+
+// Collect the slots of candidates that are always evaluated, the branches of a tenary are skipped
+static void cse_collect(Node **slot, bool is_lvalue, List *slots) {
+    Node *node = *slot;
+    if (node == NULL) return;
+    if (is_lvalue) {
+        if (node->kind == NODE_DEREF) cse_collect(&node->unary, false, slots);
+        return;
+    }
+    if (cse_is_candidate(node)) list_add(slots, slot);
+
+    if (node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) cse_collect((Node **)&node->nodes.items[i], false, slots);
+    }
+    if (node->kind == NODE_TENARY) cse_collect(&node->condition, false, slots);
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) cse_collect(&node->unary, node->kind == NODE_ADDR, slots);
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        cse_collect(&node->lhs, node->kind == NODE_ASSIGN, slots);
+        cse_collect(&node->rhs, false, slots);
+    }
+}
+
+// Checks if one of the following statements can reuse expression before it is changed
+static bool cse_is_used_later(Cse *cse, Node *expression, List *block, size_t index) {
+    for (size_t i = index + 1; i < block->size; i++) {
+        Node *statement = block->items[i];
+        if (statement->kind != NODE_NODES && statement->kind != NODE_IF && statement->kind != NODE_WHILE && statement->kind != NODE_DOWHILE) {
+            if (cse_contains(cse, statement, expression, false)) return !cse_is_killed_inside(cse, expression, statement);
+        } else if (cse_contains(cse, statement, expression, false)) {
+            return !cse_is_killed(cse, expression, statement);
+        }
+        if (cse_is_killed(cse, expression, statement)) return false;
+    }
+    return false;
+}
+
+// Computes repeated expressions of a statement once in front of it
+static void cse_expression(Cse *cse, Node **slot, Node *statement, List *block, size_t index, List *result) {
+    cse_replace(cse, slot, false, statement);
+
+    for (;;) {
+        List slots = {0};
+        list_init(&slots);
+        cse_collect(slot, false, &slots);
+
+        Node *best = NULL;
+        size_t best_size = 0;
+        for (size_t i = 0; i < slots.size; i++) {
+            Node *node = *(Node **)slots.items[i];
+            size_t size = cse_size(node);
+            if (size <= best_size || cse_is_killed_inside(cse, node, statement)) continue;
+
+            size_t count = 0;
+            for (size_t j = 0; j < slots.size; j++) {
+                if (cse_equals(cse, *(Node **)slots.items[j], node)) count++;
+            }
+            if (count >= 2 || (!cse_is_killed(cse, node, statement) && cse_is_used_later(cse, node, block, index))) {
+                best = node;
+                best_size = size;
+            }
+        }
+
+        if (best != NULL) {
+            Local *local = optimizer_new_local(cse->optimizer, best->type);
+            list_add(result, node_new_operation(NODE_ASSIGN, best->token, optimizer_local_node(best->token, local), optimizer_clone(best)));
+            list_add(&cse->nodes, best);
+            list_add(&cse->locals, local);
+            list_add(&cse->temps, local);
+            list_add(&cse->values, best);
+            for (size_t i = 0; i < slots.size; i++) {
+                Node **other = slots.items[i];
+                if (cse_equals(cse, *other, best)) *other = optimizer_local_node(best->token, local);
+            }
+        }
+        list_free(&slots, NULL);
+        if (best == NULL) break;
+    }
+}
+
+static void cse_block(Cse *cse, List *block);
+
+// Expressions computed inside a branch or loop body are forgotten when it ends
+static void cse_nested_block(Cse *cse, Node *node) {
+    if (node == NULL) return;
+    size_t size = cse->nodes.size;
+    cse_block(cse, &node->nodes);
+    cse->nodes.size = size;
+    cse->locals.size = size;
+    cse_kill(cse, node);
+}
+
+static void cse_block(Cse *cse, List *block) {
+    List result = {0};
+    list_init(&result);
+    for (size_t i = 0; i < block->size; i++) {
+        Node *node = block->items[i];
+        if (node->kind == NODE_NODES) {
+            cse_block(cse, &node->nodes);
+        } else if (node->kind == NODE_IF) {
+            cse_expression(cse, &node->condition, node->condition, block, i, &result);
+            cse_kill(cse, node->condition);
+            cse_nested_block(cse, node->then_block);
+            cse_nested_block(cse, node->else_block);
+        } else if (node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+            // Only expressions that the loop doesn't change stay available inside it
+            cse_kill(cse, node);
+            if (node->condition != NULL) cse_replace(cse, &node->condition, false, node->condition);
+            cse_nested_block(cse, node->then_block);
+        } else if (node->kind == NODE_RETURN) {
+            cse_expression(cse, &node->unary, node->unary, block, i, &result);
+        } else {
+            cse_expression(cse, (Node **)&block->items[i], node, block, i, &result);
+            cse_kill(cse, block->items[i]);
+        }
+        list_add(&result, block->items[i]);
+    }
+    arena_release(block->items);
+    *block = result;
+}
+
+void optimizer_cse(Optimizer *optimizer, List *nodes) {
+    Cse cse = {.optimizer = optimizer};
+    list_init(&cse.nodes);
+    list_init(&cse.locals);
+    list_init(&cse.temps);
+    list_init(&cse.values);
+    cse_block(&cse, nodes);
+    list_free(&cse.nodes, NULL);
+    list_free(&cse.locals, NULL);
+    list_free(&cse.temps, NULL);
+    list_free(&cse.values, NULL);
+}
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+
+#include "optimizer/optimizer.h"
+
+// Loop
+typedef struct Loop {
+    Optimizer *optimizer;
+    Node *node;
+    Node *preheader;
+    List hoisted_nodes;
+    List hoisted_locals;
+} Loop;
+
+typedef bool (*LoopReplaceFunc)(Loop *loop, Node **slot, void *data);
+
+// Walk over every value slot in the loop, lvalues are only entered through their address expression
+static void loop_walk(Loop *loop, Node **slot, bool is_lvalue, LoopReplaceFunc func, void *data) {
+    Node *node = *slot;
+    if (node == NULL) return;
+    if (is_lvalue) {
+        if (node->kind == NODE_DEREF) loop_walk(loop, &node->unary, false, func, data);
+        return;
+    }
+    if (func(loop, slot, data)) return;
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            loop_walk(loop, (Node **)&node->nodes.items[i], false, func, data);
+        }
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        loop_walk(loop, &node->condition, false, func, data);
+        loop_walk(loop, &node->then_block, false, func, data);
+        loop_walk(loop, &node->else_block, false, func, data);
+    }
+    if (node->kind == NODE_RETURN) {
+        loop_walk(loop, &node->unary, false, func, data);
+    }
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) {
+        loop_walk(loop, &node->unary, node->kind == NODE_ADDR, func, data);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        loop_walk(loop, &node->lhs, node->kind == NODE_ASSIGN, func, data);
+        loop_walk(loop, &node->rhs, false, func, data);
+    }
+}
+
+// Returns a local that holds the value of node, computed once in the preheader
+static Local *loop_preheader_local(Loop *loop, Node *node) {
+    for (size_t i = 0; i < loop->hoisted_nodes.size; i++) {
+        if (optimizer_equals(loop->hoisted_nodes.items[i], node)) {
+            return loop->hoisted_locals.items[i];
+        }
+    }
+
+    Local *local = optimizer_new_local(loop->optimizer, node->type);
+    list_add(&loop->preheader->nodes, node_new_operation(NODE_ASSIGN, node->token, optimizer_local_node(node->token, local), node));
+    list_add(&loop->hoisted_nodes, node);
+    list_add(&loop->hoisted_locals, local);
+    return local;
+}
+
+static bool loop_is_invariant(Loop *loop, Node *node) {
+    if (node->kind == NODE_INTEGER) return true;
+    if (node->kind == NODE_LOCAL) {
+        if (node->type->kind == TYPE_ARRAY) return true;
+        return !loop->optimizer->has_escaped_locals && !optimizer_is_assigned(loop->node, node->local);
+    }
+    if (node->kind == NODE_GLOBAL) return node->type->kind == TYPE_ARRAY;
+
+    if (node->kind == NODE_ADDR) {
+        if (node->unary->kind == NODE_LOCAL || node->unary->kind == NODE_GLOBAL) return true;
+        if (node->unary->kind == NODE_DEREF) return loop_is_invariant(loop, node->unary->unary);
+        return false;
+    }
+    // Only derefs that don't load are free of side effects
+    if (node->kind == NODE_DEREF) return node->type->kind == TYPE_ARRAY && loop_is_invariant(loop, node->unary);
+    if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) return loop_is_invariant(loop, node->unary);
+
+    // Division can trap so it is never executed speculatively
+    if (node->kind == NODE_ASSIGN || node->kind == NODE_DIV || node->kind == NODE_MOD) return false;
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        return loop_is_invariant(loop, node->lhs) && loop_is_invariant(loop, node->rhs);
+    }
+    return false;
+}
+
+// Induction variables
+static bool loop_is_increment(Node *node, Local *local, int64_t *step) {
+    if (node->kind != NODE_ASSIGN || node->lhs->kind != NODE_LOCAL || node->lhs->local != local) return false;
+    Node *value = node->rhs;
+    if ((value->kind != NODE_ADD && value->kind != NODE_SUB) || value->lhs->kind != NODE_LOCAL || value->lhs->local != local ||
+        value->rhs->kind != NODE_INTEGER) {
+        return false;
+    }
+    *step = value->kind == NODE_ADD ? value->rhs->integer : -value->rhs->integer;
+    return true;
+}
+
+static size_t loop_count_assigns(Node *node, Local *local) {
+    if (node == NULL) return 0;
+    size_t count = 0;
+    if (node->kind == NODE_ASSIGN && node->lhs->kind == NODE_LOCAL && node->lhs->local == local) count++;
+    if (node->kind == NODE_VECTOR && optimizer_is_assigned(node, local)) count++;
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) count += loop_count_assigns(node->nodes.items[i], local);
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        count += loop_count_assigns(node->condition, local) + loop_count_assigns(node->then_block, local) + loop_count_assigns(node->else_block, local);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        count += loop_count_assigns(node->unary, local);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        count += loop_count_assigns(node->lhs, local) + loop_count_assigns(node->rhs, local);
+    }
+    return count;
+}
+
+// Counts the increments that are complete statements, only those can be followed by a pointer bump
+static size_t loop_count_increments(Node *node, Local *local) {
+    if (node == NULL) return 0;
+    size_t count = 0;
+    int64_t step;
+    if (node->kind == NODE_NODES) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            Node *child = node->nodes.items[i];
+            if (loop_is_increment(child, local, &step)) {
+                count++;
+            } else {
+                count += loop_count_increments(child, local);
+            }
+        }
+    }
+    if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        count += loop_count_increments(node->then_block, local) + loop_count_increments(node->else_block, local);
+    }
+    return count;
+}
+
+static void loop_find_locals(Node *node, List *locals) {
+    if (node == NULL) return;
+    if (node->kind == NODE_ASSIGN && node->lhs->kind == NODE_LOCAL) {
+        bool found = false;
+        for (size_t i = 0; i < locals->size; i++) {
+            if (locals->items[i] == node->lhs->local) found = true;
+        }
+        if (!found) list_add(locals, node->lhs->local);
+    }
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) loop_find_locals(node->nodes.items[i], locals);
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        loop_find_locals(node->condition, locals);
+        loop_find_locals(node->then_block, locals);
+        loop_find_locals(node->else_block, locals);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        loop_find_locals(node->unary, locals);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        loop_find_locals(node->lhs, locals);
+        loop_find_locals(node->rhs, locals);
+    }
+}
+
+// Checks if node is invariant plus a constant multiple of the induction variable
+static bool loop_is_affine(Loop *loop, Node *node, Local *induction, int64_t *stride) {
+    if (node->kind == NODE_LOCAL && node->local == induction) {
+        *stride = 1;
+        return true;
+    }
+    if (loop_is_invariant(loop, node)) {
+        *stride = 0;
+        return true;
+    }
+
+    int64_t lhs_stride, rhs_stride;
+    if (node->kind == NODE_ADD || node->kind == NODE_SUB) {
+        if (!loop_is_affine(loop, node->lhs, induction, &lhs_stride) || !loop_is_affine(loop, node->rhs, induction, &rhs_stride)) return false;
+        *stride = node->kind == NODE_ADD ? lhs_stride + rhs_stride : lhs_stride - rhs_stride;
+        return true;
+    }
+    if (node->kind == NODE_SHL && node->rhs->kind == NODE_INTEGER) {
+        if (!loop_is_affine(loop, node->lhs, induction, &lhs_stride)) return false;
+        *stride = lhs_stride << node->rhs->integer;
+        return true;
+    }
+    if (node->kind == NODE_MUL && node->rhs->kind == NODE_INTEGER) {
+        if (!loop_is_affine(loop, node->lhs, induction, &lhs_stride)) return false;
+        *stride = lhs_stride * node->rhs->integer;
+        return true;
+    }
+    if (node->kind == NODE_MUL && node->lhs->kind == NODE_INTEGER) {
+        if (!loop_is_affine(loop, node->rhs, induction, &rhs_stride)) return false;
+        *stride = rhs_stride * node->lhs->integer;
+        return true;
+    }
+    if (node->kind == NODE_NEG) {
+        if (!loop_is_affine(loop, node->unary, induction, &lhs_stride)) return false;
+        *stride = -lhs_stride;
+        return true;
+    }
+    if (node->kind == NODE_DEREF && node->type->kind == TYPE_ARRAY) {
+        return loop_is_affine(loop, node->unary, induction, stride);
+    }
+    if (node->kind == NODE_ADDR && node->unary->kind == NODE_DEREF) {
+        return loop_is_affine(loop, node->unary->unary, induction, stride);
+    }
+    return false;
+}
+
+typedef struct LoopReduction {
+    Local *induction;
+    List nodes;
+    List locals;
+    List strides;
+} LoopReduction;
+
+static bool loop_reduce_func(Loop *loop, Node **slot, void *data) {
+    LoopReduction *reduction = data;
+    Node *node = *slot;
+
+    int64_t stride;
+    if (node->kind == NODE_LOCAL || node->type == NULL || (node->type->kind != TYPE_POINTER && node->type->kind != TYPE_ARRAY) ||
+        !loop_is_affine(loop, node, reduction->induction, &stride) || stride == 0) {
+        return false;
+    }
+
+    // Share one pointer between all equal address expressions
+    Local *local = NULL;
+    for (size_t i = 0; i < reduction->nodes.size; i++) {
+        if (optimizer_equals(reduction->nodes.items[i], node)) local = reduction->locals.items[i];
+    }
+    if (local == NULL) {
+        local = optimizer_new_local(loop->optimizer, node->type);
+        Node *init = optimizer_clone(node);
+        list_add(&loop->preheader->nodes, node_new_operation(NODE_ASSIGN, node->token, optimizer_local_node(node->token, local), init));
+        list_add(&reduction->nodes, node);
+        list_add(&reduction->locals, local);
+        list_add(&reduction->strides, (void *)(intptr_t)stride);
+    }
+    *slot = optimizer_local_node(node->token, local);
+    return true;
+}
+
+// Place pointer bumps directly after every increment of the induction variable
+static void loop_bump(Node *node, LoopReduction *reduction) {
+    if (node == NULL) return;
+    int64_t step;
+    if (node->kind == NODE_NODES) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            Node *child = node->nodes.items[i];
+            if (loop_is_increment(child, reduction->induction, &step)) {
+                Node *group = node_new_nodes(NODE_NODES, child->token);
+                list_add(&group->nodes, child);
+                for (size_t j = 0; j < reduction->locals.size; j++) {
+                    Local *local = reduction->locals.items[j];
+                    int64_t stride = (intptr_t)reduction->strides.items[j];
+                    Node *pointer = optimizer_local_node(child->token, local);
+                    list_add(&group->nodes, node_new_operation(NODE_ASSIGN, child->token, pointer,
+                                                               node_new_operation(NODE_ADD, child->token, pointer,
+                                                                                  node_new_integer(child->token, 8, true, stride * step))));
+                }
+                node->nodes.items[i] = group;
+            } else {
+                loop_bump(child, reduction);
+            }
+        }
+    }
+    if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        loop_bump(node->then_block, reduction);
+        loop_bump(node->else_block, reduction);
+    }
+}
+
+static void loop_strength_reduce(Loop *loop) {
+    List locals = {0};
+    list_init(&locals);
+    loop_find_locals(loop->node, &locals);
+
+    for (size_t i = 0; i < locals.size; i++) {
+        Local *local = locals.items[i];
+        size_t increments = loop_count_increments(loop->node->then_block, local);
+        if (local->type->kind == TYPE_ARRAY || increments == 0 || increments != loop_count_assigns(loop->node, local)) continue;
+
+        LoopReduction reduction = {.induction = local};
+        list_init(&reduction.nodes);
+        list_init(&reduction.locals);
+        list_init(&reduction.strides);
+        loop_walk(loop, &loop->node->condition, false, loop_reduce_func, &reduction);
+        loop_walk(loop, &loop->node->then_block, false, loop_reduce_func, &reduction);
+        if (reduction.locals.size > 0) loop_bump(loop->node->then_block, &reduction);
+        list_free(&reduction.nodes, NULL);
+        list_free(&reduction.locals, NULL);
+        list_free(&reduction.strides, NULL);
+    }
+    list_free(&locals, NULL);
+}
+
+// Loop invariant code motion
+static bool loop_hoist_func(Loop *loop, Node **slot, void *data) {
+    (void)data;
+    Node *node = *slot;
+    if (optimizer_is_trivial(node) || !loop_is_invariant(loop, node)) return false;
+    *slot = optimizer_local_node(node->token, loop_preheader_local(loop, node));
+    return true;
+}
+
+void optimizer_loops(Optimizer *optimizer, Node **slot) {
+    Node *node = *slot;
+    if (node == NULL) return;
+
+    // Optimize inner loops first
+    if (node->kind == NODE_NODES) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            optimizer_loops(optimizer, (Node **)&node->nodes.items[i]);
+        }
+    }
+    if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        optimizer_loops(optimizer, &node->then_block);
+        optimizer_loops(optimizer, &node->else_block);
+    }
+    if (node->kind != NODE_WHILE) return;
+
+    Loop loop = {.optimizer = optimizer, .node = node, .preheader = node_new_nodes(NODE_NODES, node->token)};
+    list_init(&loop.hoisted_nodes);
+    list_init(&loop.hoisted_locals);
+
+    if (!optimizer->has_escaped_locals) loop_strength_reduce(&loop);
+    loop_walk(&loop, &node->condition, false, loop_hoist_func, NULL);
+    loop_walk(&loop, &node->then_block, false, loop_hoist_func, NULL);
+
+    // Replace the loop with the preheader followed by the loop
+    if (loop.preheader->nodes.size > 0) {
+        list_add(&loop.preheader->nodes, node);
+        *slot = loop.preheader;
+    }
+    list_free(&loop.hoisted_nodes, NULL);
+    list_free(&loop.hoisted_locals, NULL);
+}
@@ -0,0 +1,159 @@
+#include "optimizer/optimizer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/arena.h"
+
+// Optimizer
+static bool optimizer_is_escaped(Node *node) {
+    if (node == NULL) return false;
+    if (node->kind == NODE_ADDR && node->unary->kind == NODE_LOCAL && node->unary->type->kind != TYPE_ARRAY) {
+        return true;
+    }
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            if (optimizer_is_escaped(node->nodes.items[i])) return true;
+        }
+        return false;
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        return optimizer_is_escaped(node->condition) || optimizer_is_escaped(node->then_block) || optimizer_is_escaped(node->else_block);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        return optimizer_is_escaped(node->unary);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        return optimizer_is_escaped(node->lhs) || optimizer_is_escaped(node->rhs);
+    }
+    return false;
+}
+
+bool optimizer_has_escaped_locals(List *nodes) {
+    for (size_t i = 0; i < nodes->size; i++) {
+        if (optimizer_is_escaped(nodes->items[i])) return true;
+    }
+    return false;
+}
+
+void optimizer(Program *program, size_t unroll_factor) {
+    for (size_t i = 0; i < program->functions.size; i++) {
+        Function *function = program->functions.items[i];
+        if (!function->is_extern && function->is_implemented) {
+            optimizer_function(program, function, unroll_factor, optimizer_has_escaped_locals(&function->nodes));
+        }
+    }
+}
+
+void optimizer_function(Program *program, Function *function, size_t unroll_factor, bool has_escaped_locals) {
+    Optimizer optimizer = {.program = program, .function = function, .unroll_factor = unroll_factor, .has_escaped_locals = has_escaped_locals};
+
+    for (size_t i = 0; i < function->nodes.size; i++) {
+        optimizer_vectorize(&optimizer, (Node **)&function->nodes.items[i]);
+    }
+    optimizer_unroll(&optimizer, &function->nodes);
+    for (size_t i = 0; i < function->nodes.size; i++) {
+        optimizer_loops(&optimizer, (Node **)&function->nodes.items[i]);
+    }
+    optimizer_cse(&optimizer, &function->nodes);
+}
+
+// Helpers
+Local *optimizer_new_local(Optimizer *optimizer, Type *type) {
+    Function *function = optimizer->function;
+
+    // Arrays decay to pointers and integers are kept full width so no bits are lost
+    if (type->kind == TYPE_ARRAY) type = type_new_pointer(type->base);
+    if (type->kind == TYPE_INTEGER && type->size != 8) type = type_new_integer(8, type->is_signed);
+
+    // New locals are placed below the existing locals so their offsets stay valid
+    Local *local = arena_calloc(1, sizeof(Local));
+    local->name = string_format("$t%zu", function->locals.size);
+    local->type = type;
+    function->locals_size = align(function->locals_size, type->size) + type->size;
+    local->offset = function->locals_size;
+    list_add(&function->locals, local);
+    return local;
+}
+
+Node *optimizer_local_node(Token *token, Local *local) {
+    Node *node = node_new(NODE_LOCAL, token);
+    node->local = local;
+    node->type = local->type;
+    return node;
+}
+
+Node *optimizer_clone(Node *node) {
+    if (node == NULL) return NULL;
+    Node *clone = node_new(node->kind, node->token);
+    *clone = *node;
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        clone->nodes.capacity = node->nodes.capacity;
+        clone->nodes.size = 0;
+        list_init(&clone->nodes);
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            list_add(&clone->nodes, optimizer_clone(node->nodes.items[i]));
+        }
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        clone->condition = optimizer_clone(node->condition);
+        clone->then_block = optimizer_clone(node->then_block);
+        clone->else_block = optimizer_clone(node->else_block);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        clone->unary = optimizer_clone(node->unary);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        clone->lhs = optimizer_clone(node->lhs);
+        clone->rhs = optimizer_clone(node->rhs);
+    }
+    return clone;
+}
+
+bool optimizer_equals(Node *lhs, Node *rhs) {
+    if (lhs == rhs) return true;
+    if (lhs == NULL || rhs == NULL || lhs->kind != rhs->kind) return false;
+
+    if (lhs->kind == NODE_INTEGER) return lhs->integer == rhs->integer && lhs->type->size == rhs->type->size;
+    if (lhs->kind == NODE_LOCAL) return lhs->local == rhs->local;
+    if (lhs->kind == NODE_GLOBAL) return lhs->global == rhs->global;
+    if (lhs->kind > NODE_UNARY_BEGIN && lhs->kind < NODE_UNARY_END) {
+        return lhs->type->kind == rhs->type->kind && lhs->type->size == rhs->type->size && optimizer_equals(lhs->unary, rhs->unary);
+    }
+    if (lhs->kind > NODE_OPERATION_BEGIN && lhs->kind < NODE_OPERATION_END && lhs->kind != NODE_ASSIGN) {
+        return optimizer_equals(lhs->lhs, rhs->lhs) && optimizer_equals(lhs->rhs, rhs->rhs);
+    }
+    return false;
+}
+
+bool optimizer_is_trivial(Node *node) {
+    if (node->kind == NODE_INTEGER || node->kind == NODE_LOCAL || node->kind == NODE_GLOBAL) return true;
+    if (node->kind == NODE_ADDR) return node->unary->kind == NODE_LOCAL || node->unary->kind == NODE_GLOBAL;
+    return false;
+}
+
+bool optimizer_is_assigned(Node *node, Local *local) {
+    if (node == NULL) return false;
+    if (node->kind == NODE_ASSIGN && node->lhs->kind == NODE_LOCAL && node->lhs->local == local) return true;
+    if (node->kind == NODE_VECTOR) return node->vector->induction == local || node->vector->accumulator == local;
+
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            if (optimizer_is_assigned(node->nodes.items[i], local)) return true;
+        }
+        return false;
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        return optimizer_is_assigned(node->condition, local) || optimizer_is_assigned(node->then_block, local) ||
+               optimizer_is_assigned(node->else_block, local);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) {
+        return optimizer_is_assigned(node->unary, local);
+    }
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) {
+        return optimizer_is_assigned(node->lhs, local) || optimizer_is_assigned(node->rhs, local);
+    }
+    return false;
+}
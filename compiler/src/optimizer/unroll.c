@@ -0,0 +1,145 @@
+#include "optimizer/optimizer.h"
+
+// Loop unrolling
+#define UNROLL_MAX_BODY_SIZE 64
+#define UNROLL_MAX_FULL_SIZE 256
+
+static size_t unroll_size(Node *node) {
+    if (node == NULL) return 0;
+    size_t size = 1;
+    if (node->kind == NODE_NODES || node->kind == NODE_CALL) {
+        for (size_t i = 0; i < node->nodes.size; i++) size += unroll_size(node->nodes.items[i]);
+    }
+    if (node->kind == NODE_TENARY || node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        size += unroll_size(node->condition) + unroll_size(node->then_block) + unroll_size(node->else_block);
+    }
+    if (node->kind == NODE_RETURN || (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END)) size += unroll_size(node->unary);
+    if (node->kind > NODE_OPERATION_BEGIN && node->kind < NODE_OPERATION_END) size += unroll_size(node->lhs) + unroll_size(node->rhs);
+    return size;
+}
+
+typedef struct Unroll {
+    Local *induction;
+    Node *bound;
+    NodeKind compare;
+    int64_t step;
+} Unroll;
+
+// Recognizes while (i < n) { ...; i = i + step; } where n doesn't change and i is only changed by the last statement
+static bool unroll_match(Optimizer *optimizer, Node *node, Unroll *unroll) {
+    Node *condition = node->condition;
+    if (node->kind != NODE_WHILE || condition == NULL || optimizer->has_escaped_locals) return false;
+    if (condition->kind != NODE_LT && condition->kind != NODE_LTEQ && condition->kind != NODE_GT && condition->kind != NODE_GTEQ) return false;
+    if (condition->lhs->kind != NODE_LOCAL || condition->lhs->type->kind != TYPE_INTEGER) return false;
+    unroll->induction = condition->lhs->local;
+    unroll->bound = condition->rhs;
+    unroll->compare = condition->kind;
+
+    if (unroll->bound->kind == NODE_LOCAL) {
+        if (unroll->bound->type->kind != TYPE_INTEGER || optimizer_is_assigned(node->then_block, unroll->bound->local)) return false;
+    } else if (unroll->bound->kind != NODE_INTEGER) {
+        return false;
+    }
+
+    Node *body = node->then_block;
+    if (body->nodes.size == 0) return false;
+    Node *increment = body->nodes.items[body->nodes.size - 1];
+    if (increment->kind != NODE_ASSIGN || increment->lhs->kind != NODE_LOCAL || increment->lhs->local != unroll->induction) return false;
+    Node *value = increment->rhs;
+    if ((value->kind != NODE_ADD && value->kind != NODE_SUB) || value->lhs->kind != NODE_LOCAL || value->lhs->local != unroll->induction ||
+        value->rhs->kind != NODE_INTEGER) {
+        return false;
+    }
+    unroll->step = value->kind == NODE_ADD ? value->rhs->integer : -value->rhs->integer;
+    if (unroll->step == 0 || ((unroll->compare == NODE_LT || unroll->compare == NODE_LTEQ) != (unroll->step > 0))) return false;
+
+    for (size_t i = 0; i < body->nodes.size - 1; i++) {
+        if (optimizer_is_assigned(body->nodes.items[i], unroll->induction)) return false;
+    }
+    return true;
+}
+
+// Returns the number of iterations when both the start and bound are known, the statement in front of a for loop is its init
+static int64_t unroll_trip_count(Unroll *unroll, Node *init) {
+    if (init != NULL && init->kind == NODE_NODES) {
+        Node *group = init;
+        init = NULL;
+        for (size_t i = group->nodes.size; i > 0 && init == NULL; i--) {
+            Node *child = group->nodes.items[i - 1];
+            if (optimizer_is_assigned(child, unroll->induction)) init = child;
+        }
+    }
+    if (init == NULL || init->kind != NODE_ASSIGN || init->lhs->kind != NODE_LOCAL || init->lhs->local != unroll->induction ||
+        init->rhs->kind != NODE_INTEGER || unroll->bound->kind != NODE_INTEGER) {
+        return -1;
+    }
+    int64_t distance = unroll->bound->integer - init->rhs->integer;
+    if (unroll->step < 0) distance = -distance;
+    if (unroll->compare == NODE_LTEQ || unroll->compare == NODE_GTEQ) distance++;
+    if (distance <= 0) return 0;
+    int64_t step = unroll->step < 0 ? -unroll->step : unroll->step;
+    return (distance + step - 1) / step;
+}
+
+static void unroll_add_body(Node *target, Node *body) {
+    Node *copy = optimizer_clone(body);
+    for (size_t i = 0; i < copy->nodes.size; i++) list_add(&target->nodes, copy->nodes.items[i]);
+}
+
+static Node *unroll_loop(Optimizer *optimizer, Node *node, Node *init) {
+    Unroll unroll;
+    if (!unroll_match(optimizer, node, &unroll)) return NULL;
+    size_t body_size = unroll_size(node->then_block);
+
+    // Small loops with a constant trip count are replaced by straight line code
+    int64_t trip_count = unroll_trip_count(&unroll, init);
+    if (trip_count >= 0 && (size_t)trip_count * body_size <= UNROLL_MAX_FULL_SIZE) {
+        Node *nodes = node_new_nodes(NODE_NODES, node->token);
+        for (int64_t i = 0; i < trip_count; i++) unroll_add_body(nodes, node->then_block);
+        return nodes;
+    }
+
+    size_t factor = optimizer->unroll_factor;
+    if (factor < 2 || body_size > UNROLL_MAX_BODY_SIZE || (trip_count >= 0 && (size_t)trip_count < factor)) return NULL;
+
+    // The unrolled loop only runs while all its iterations pass the original condition
+    Token *token = node->token;
+    Node *unrolled = node_new(NODE_WHILE, token);
+    unrolled->type = NULL;
+    unrolled->else_block = NULL;
+    Node *last = node_new_operation(NODE_ADD, token, optimizer_local_node(token, unroll.induction),
+                                    node_new_integer(token, 8, true, unroll.step * (int64_t)(factor - 1)));
+    unrolled->condition = node_new_operation(unroll.compare, token, last, unroll.bound);
+    unrolled->condition->type = node->condition->type;
+    unrolled->then_block = node_new_nodes(NODE_NODES, token);
+    for (size_t i = 0; i < factor; i++) unroll_add_body(unrolled->then_block, node->then_block);
+
+    // The original loop runs the remaining iterations
+    Node *nodes = node_new_nodes(NODE_NODES, token);
+    list_add(&nodes->nodes, unrolled);
+    list_add(&nodes->nodes, node);
+    return nodes;
+}
+
+static void unroll_block(Optimizer *optimizer, List *block);
+
+static void unroll_node(Optimizer *optimizer, Node *node) {
+    if (node->kind == NODE_NODES) unroll_block(optimizer, &node->nodes);
+    if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        if (node->then_block != NULL) unroll_node(optimizer, node->then_block);
+        if (node->else_block != NULL) unroll_node(optimizer, node->else_block);
+    }
+}
+
+static void unroll_block(Optimizer *optimizer, List *block) {
+    for (size_t i = 0; i < block->size; i++) {
+        Node *node = block->items[i];
+        unroll_node(optimizer, node);
+        if (node->kind != NODE_WHILE) continue;
+
+        Node *unrolled = unroll_loop(optimizer, node, i > 0 ? block->items[i - 1] : NULL);
+        if (unrolled != NULL) block->items[i] = unrolled;
+    }
+}
+
+void optimizer_unroll(Optimizer *optimizer, List *nodes) { unroll_block(optimizer, nodes); }
@@ -0,0 +1,168 @@
+#include <stdlib.h>
+
+#include "optimizer/optimizer.h"
+#include "utils/arena.h"
+
+// Vectorizer
+typedef struct Vectorize {
+    Local *induction;
+    Local *accumulator;
+    size_t element_size;
+} Vectorize;
+
+// Checks if node has the same value in every iteration, the loop only changes the induction variable,
+// the accumulator and memory through the destination so nothing may be loaded from memory
+static bool vectorize_is_invariant(Vectorize *vectorize, Node *node) {
+    if (node->kind == NODE_INTEGER) return true;
+    if (node->kind == NODE_LOCAL) return node->local != vectorize->induction && node->local != vectorize->accumulator;
+    if (node->kind == NODE_GLOBAL) return node->type->kind == TYPE_ARRAY;
+    if (node->kind == NODE_DEREF) return node->type->kind == TYPE_ARRAY && vectorize_is_invariant(vectorize, node->unary);
+    if (node->kind == NODE_ADD || node->kind == NODE_SUB || node->kind == NODE_MUL || node->kind == NODE_SHL) {
+        return vectorize_is_invariant(vectorize, node->lhs) && vectorize_is_invariant(vectorize, node->rhs);
+    }
+    return false;
+}
+
+// Matches base[i] and returns base
+static Node *vectorize_access(Vectorize *vectorize, Node *node) {
+    if (node->kind != NODE_DEREF || node->type->kind != TYPE_INTEGER || node->type->size != vectorize->element_size) return NULL;
+    Node *address = node->unary;
+    if (address->kind != NODE_ADD || (address->type->kind != TYPE_POINTER && address->type->kind != TYPE_ARRAY) ||
+        address->type->base->size != vectorize->element_size) {
+        return NULL;
+    }
+
+    Node *index = address->rhs;
+    if (index->kind == NODE_SHL) {
+        if (index->rhs->kind != NODE_INTEGER || ((size_t)1 << index->rhs->integer) != vectorize->element_size) return NULL;
+        index = index->lhs;
+    } else if (vectorize->element_size != 1) {
+        return NULL;
+    }
+    if (index->kind != NODE_LOCAL || index->local != vectorize->induction) return NULL;
+    if (!vectorize_is_invariant(vectorize, address->lhs)) return NULL;
+    return address->lhs;
+}
+
+static bool vectorize_is_scalar(Vectorize *vectorize, Node *node) {
+    return node->type->kind == TYPE_INTEGER && vectorize_is_invariant(vectorize, node);
+}
+
+static void vectorize_flatten(Node *node, List *statements) {
+    if (node->kind == NODE_NODES) {
+        for (size_t i = 0; i < node->nodes.size; i++) vectorize_flatten(node->nodes.items[i], statements);
+    } else {
+        list_add(statements, node);
+    }
+}
+
+static bool vectorize_loop(Optimizer *optimizer, Node *node, Vector *vector) {
+    Node *condition = node->condition;
+    if (optimizer->has_escaped_locals || condition == NULL || condition->kind != NODE_LT || condition->lhs->kind != NODE_LOCAL ||
+        condition->lhs->type->kind != TYPE_INTEGER) {
+        return false;
+    }
+
+    // Body must be one statement followed by i = i + 1
+    List statements = {0};
+    list_init(&statements);
+    vectorize_flatten(node->then_block, &statements);
+    Node *statement = statements.size == 2 ? statements.items[0] : NULL;
+    Node *increment = statements.size == 2 ? statements.items[1] : NULL;
+    list_free(&statements, NULL);
+    if (statement == NULL || statement->kind != NODE_ASSIGN) return false;
+
+    Local *induction = condition->lhs->local;
+    if (increment->kind != NODE_ASSIGN || increment->lhs->kind != NODE_LOCAL || increment->lhs->local != induction ||
+        increment->rhs->kind != NODE_ADD || increment->rhs->lhs->kind != NODE_LOCAL || increment->rhs->lhs->local != induction ||
+        increment->rhs->rhs->kind != NODE_INTEGER || increment->rhs->rhs->integer != 1) {
+        return false;
+    }
+
+    vector->induction = induction;
+    vector->bound = condition->rhs;
+    Vectorize vectorize = {.induction = induction};
+
+    // Reductions: sum = sum + base[i]
+    if (statement->lhs->kind == NODE_LOCAL) {
+        Local *accumulator = statement->lhs->local;
+        Node *value = statement->rhs;
+        if (accumulator == induction || accumulator->type->kind != TYPE_INTEGER || value->kind != NODE_ADD) return false;
+        Node *element = value->lhs->kind == NODE_LOCAL && value->lhs->local == accumulator ? value->rhs : value->lhs;
+        Node *other = element == value->rhs ? value->lhs : value->rhs;
+        if (other->kind != NODE_LOCAL || other->local != accumulator || element->kind != NODE_DEREF || element->type->kind != TYPE_INTEGER) return false;
+
+        // Lanes are only widened from bytes and ints, narrower lanes would wrap before the accumulator does
+        vectorize.accumulator = accumulator;
+        vectorize.element_size = element->type->size;
+        if (accumulator->type->size > vectorize.element_size && vectorize.element_size != 1 && vectorize.element_size != 4) return false;
+        vector->operation = NODE_ADD;
+        vector->accumulator = accumulator;
+        vector->rhs = vectorize_access(&vectorize, element);
+        if (vector->rhs == NULL) return false;
+    }
+
+    // Maps: destination[i] = lhs[i] operation rhs[i]
+    else {
+        if (statement->lhs->kind != NODE_DEREF || statement->lhs->type->kind != TYPE_INTEGER) return false;
+        vectorize.element_size = statement->lhs->type->size;
+        vector->destination = vectorize_access(&vectorize, statement->lhs);
+        if (vector->destination == NULL) return false;
+
+        Node *value = statement->rhs;
+        if (value->kind == NODE_ADD || value->kind == NODE_SUB || value->kind == NODE_AND || value->kind == NODE_OR || value->kind == NODE_XOR) {
+            Node *lhs = value->lhs;
+            Node *rhs = value->rhs;
+            if (value->kind != NODE_SUB && vectorize_access(&vectorize, lhs) == NULL) {
+                lhs = value->rhs;
+                rhs = value->lhs;
+            }
+            vector->operation = value->kind;
+            vector->lhs = vectorize_access(&vectorize, lhs);
+            if (vector->lhs == NULL) return false;
+            vector->rhs = vectorize_access(&vectorize, rhs);
+            if (vector->rhs == NULL) {
+                if (!vectorize_is_scalar(&vectorize, rhs)) return false;
+                vector->rhs = rhs;
+                vector->is_rhs_scalar = true;
+            }
+        } else {
+            vector->operation = NODE_ASSIGN;
+            vector->rhs = vectorize_access(&vectorize, value);
+            if (vector->rhs == NULL) {
+                if (!vectorize_is_scalar(&vectorize, value)) return false;
+                vector->rhs = value;
+                vector->is_rhs_scalar = true;
+            }
+        }
+    }
+
+    vector->element_size = vectorize.element_size;
+    return vectorize_is_scalar(&vectorize, vector->bound);
+}
+
+void optimizer_vectorize(Optimizer *optimizer, Node **slot) {
+    Node *node = *slot;
+    if (node == NULL) return;
+    if (node->kind == NODE_NODES) {
+        for (size_t i = 0; i < node->nodes.size; i++) {
+            optimizer_vectorize(optimizer, (Node **)&node->nodes.items[i]);
+        }
+    }
+    if (node->kind == NODE_IF || node->kind == NODE_WHILE || node->kind == NODE_DOWHILE) {
+        optimizer_vectorize(optimizer, &node->then_block);
+        optimizer_vectorize(optimizer, &node->else_block);
+    }
+    if (node->kind != NODE_WHILE) return;
+
+    // The vector loop runs first, the original loop handles the remaining elements
+    Vector vector = {0};
+    if (!vectorize_loop(optimizer, node, &vector)) return;
+    Node *vector_node = node_new(NODE_VECTOR, node->token);
+    vector_node->vector = arena_malloc(sizeof(Vector));
+    *vector_node->vector = vector;
+    Node *nodes = node_new_nodes(NODE_NODES, node->token);
+    list_add(&nodes->nodes, vector_node);
+    list_add(&nodes->nodes, node);
+    *slot = nodes;
+}
@@ -5,11 +5,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils/arena.h"
 #include "utils/utils.h"
 
 // Type
 Type *type_new(TypeKind kind, size_t size) {
-    Type *type = calloc(1, sizeof(Type));
+    Type *type = arena_calloc(1, sizeof(Type));
     type->kind = kind;
     type->size = size;
     return type;
@@ -199,8 +200,13 @@ void function_dump(FILE *f, Function *function) {
 }
 
 // Node
+static _Thread_local size_t nodes_made = 0;
+
+size_t nodes_size(void) { return nodes_made; }
+
 Node *node_new(NodeKind kind, Token *token) {
-    Node *node = calloc(1, sizeof(Node));
+    nodes_made++;
+    Node *node = arena_calloc(1, sizeof(Node));
     node->kind = kind;
     node->token = token;
     return node;
@@ -306,6 +312,28 @@ void node_dump(FILE *f, Node *node, int32_t indent) {
         fprintf(f, "return ");
         node_dump(f, node->unary, indent);
     }
+    if (node->kind == NODE_VECTOR) {
+        Vector *vector = node->vector;
+        fprintf(f, "vector %zu (%s < ", vector->element_size, vector->induction->name);
+        node_dump(f, vector->bound, indent);
+        fprintf(f, ") ");
+        if (vector->accumulator != NULL) {
+            fprintf(f, "%s += ", vector->accumulator->name);
+        } else {
+            node_dump(f, vector->destination, indent);
+            fprintf(f, "[] = ");
+        }
+        if (vector->lhs != NULL) {
+            node_dump(f, vector->lhs, indent);
+            if (vector->operation == NODE_ADD) fprintf(f, "[] + ");
+            if (vector->operation == NODE_SUB) fprintf(f, "[] - ");
+            if (vector->operation == NODE_AND) fprintf(f, "[] & ");
+            if (vector->operation == NODE_OR) fprintf(f, "[] | ");
+            if (vector->operation == NODE_XOR) fprintf(f, "[] ^ ");
+        }
+        node_dump(f, vector->rhs, indent);
+        if (!vector->is_rhs_scalar) fprintf(f, "[]");
+    }
 
     if (node->kind > NODE_UNARY_BEGIN && node->kind < NODE_UNARY_END) {
         fprintf(f, "( ");
@@ -359,7 +387,7 @@ void node_dump(FILE *f, Node *node, int32_t indent) {
 }
 
 // Parser
-void parser(Program *program, Token *tokens, size_t tokens_size) {
+bool parser(Program *program, Token *tokens, size_t tokens_size) {
     Parser parser = {
         .program = program,
         .tokens = tokens,
@@ -367,18 +395,19 @@ void parser(Program *program, Token *tokens, size_t tokens_size) {
         .position = 0,
     };
     parser_program(&parser);
-
-    if (parser.has_errors) {
-        exit(EXIT_FAILURE);
-    }
+    return !parser.has_errors;
 }
 
 #define current() (&parser->tokens[parser->position])
 
+// Expressions with errors continue as a zero so the rest of the program is still checked
+static Node *parser_error_node(Token *token) { return node_new_integer(token, 4, true, 0); }
+
+// The position never moves past the EOF token, so errors at the end of the input still point at a token
 void parser_eat(Parser *parser, TokenKind token_kind) {
     Token *token = current();
     if (token->kind == token_kind) {
-        parser->position++;
+        if (token->kind != TOKEN_EOF) parser->position++;
     } else {
         parser->has_errors = true;
         print_error(token, "Unexpected token: '%s' wanted '%s'", token_kind_to_string(token->kind), token_kind_to_string(token_kind));
@@ -465,7 +494,7 @@ Node *parser_add_node(Parser *parser, Token *token, Node *lhs, Node *rhs) {
 
     parser->has_errors = true;
     print_error(token, "Invalid add types");
-    return node_new_nodes(NODE_NODES, token);
+    return parser_error_node(token);
 }
 
 Node *parser_sub_node(Parser *parser, Token *token, Node *lhs, Node *rhs) {
@@ -489,7 +518,7 @@ Node *parser_sub_node(Parser *parser, Token *token, Node *lhs, Node *rhs) {
 
     parser->has_errors = true;
     print_error(token, "Invalid subtract types");
-    return node_new_nodes(NODE_NODES, token);
+    return parser_error_node(token);
 }
 
 Node *parser_mul_node(Parser *parser, Token *token, Node *lhs, Node *rhs) {
@@ -524,7 +553,7 @@ Node *parser_deref_node(Parser *parser, Token *token, Node *unary) {
     if (node->type->kind != TYPE_POINTER && node->type->kind != TYPE_ARRAY) {
         parser->has_errors = true;
         print_error(token, "Type is not a pointer");
-        return node_new_nodes(NODE_NODES, token);
+        return parser_error_node(token);
     }
     node->type = node->type->base;
     return node;
@@ -532,7 +561,10 @@ Node *parser_deref_node(Parser *parser, Token *token, Node *unary) {
 
 void parser_program(Parser *parser) {
     while (current()->kind != TOKEN_EOF) {
+        // Tokens that start no function or global are skipped after their error
+        size_t position = parser->position;
         parser_function(parser);
+        if (parser->position == position) parser->position++;
     }
 }
 
@@ -547,13 +579,14 @@ void parser_function(Parser *parser) {
     Token *token = current();
     char *name = current()->string;
     parser_eat(parser, TOKEN_VARIABLE);
+    if (token->kind != TOKEN_VARIABLE) return;
 
     // Function
     if (current()->kind == TOKEN_LPAREN) {
         // Create function when it don't exists
         Function *function = program_find_function(parser->program, name);
         if (function == NULL) {
-            function = calloc(1, sizeof(Function));
+            function = arena_calloc(1, sizeof(Function));
             list_add(&parser->program->functions, function);
 
             function->name = name;
@@ -574,10 +607,14 @@ void parser_function(Parser *parser) {
             for (;;) {
                 Type *argument_type = parser_type(parser);
                 list_add(&function_type->arguments_types, argument_type);
+                if (current()->kind != TOKEN_VARIABLE) {
+                    parser_eat(parser, TOKEN_VARIABLE);
+                    break;
+                }
                 char *argument_name = current()->string;
                 list_add(&arguments_names, argument_name);
                 parser_eat(parser, TOKEN_VARIABLE);
-                if (current()->kind == TOKEN_RPAREN) {
+                if (current()->kind != TOKEN_COMMA) {
                     break;
                 }
                 parser_eat(parser, TOKEN_COMMA);
@@ -614,7 +651,7 @@ void parser_function(Parser *parser) {
 
             // Create locals for arguments
             for (size_t i = 0; i < function->arguments_names.size; i++) {
-                Local *local = malloc(sizeof(Local));
+                Local *local = arena_malloc(sizeof(Local));
                 local->name = function->arguments_names.items[i];
                 local->type = function->type->arguments_types.items[i];
                 list_add(&function->locals, local);
@@ -623,9 +660,11 @@ void parser_function(Parser *parser) {
 
             // Parse nodes
             parser_eat(parser, TOKEN_LCURLY);
-            while (current()->kind != TOKEN_RCURLY) {
+            while (current()->kind != TOKEN_RCURLY && current()->kind != TOKEN_EOF) {
+                size_t position = parser->position;
                 Node *child = parser_statement(parser);
                 if (child != NULL) list_add(&function->nodes, child);
+                if (parser->position == position) parser->position++;
             }
             parser_eat(parser, TOKEN_RCURLY);
 
@@ -647,12 +686,12 @@ void parser_function(Parser *parser) {
         // Create global when it doesn't exists
         Global *global = program_find_global(parser->program, name);
         if (global == NULL) {
-            global = calloc(1, sizeof(Global));
+            global = arena_calloc(1, sizeof(Global));
             global->type = global_type;
             global->name = name;
             global->init_data = NULL;
             list_add(&parser->program->globals, global);
-            parser->program->globals_size += global->type->size;
+            parser->program->globals_size += align(global->type->size, 4);
         } else {
             parser->has_errors = true;
             print_error(token, "[TMP] Can't redefine variable: '%s'", name);
@@ -664,6 +703,7 @@ void parser_function(Parser *parser) {
             token = current();
             name = current()->string;
             parser_eat(parser, TOKEN_VARIABLE);
+            if (token->kind != TOKEN_VARIABLE) return;
         } else {
             break;
         }
@@ -676,9 +716,11 @@ Node *parser_block(Parser *parser) {
     Node *node = node_new_nodes(NODE_NODES, token);
     if (token->kind == TOKEN_LCURLY) {
         parser_eat(parser, TOKEN_LCURLY);
-        while (current()->kind != TOKEN_RCURLY) {
+        while (current()->kind != TOKEN_RCURLY && current()->kind != TOKEN_EOF) {
+            size_t position = parser->position;
             Node *child = parser_statement(parser);
             if (child != NULL) list_add(&node->nodes, child);
+            if (parser->position == position) parser->position++;
         }
         parser_eat(parser, TOKEN_RCURLY);
     } else {
@@ -804,6 +846,10 @@ Node *parser_declarations(Parser *parser) {
         Type *base_type = parser_type(parser);
         List *nodes = list_new();
         for (;;) {
+            if (current()->kind != TOKEN_VARIABLE) {
+                parser_eat(parser, TOKEN_VARIABLE);
+                break;
+            }
             char *name = current()->string;
             parser_eat(parser, TOKEN_VARIABLE);
             Type *local_type = parser_type_suffix(parser, base_type);
@@ -811,7 +857,7 @@ Node *parser_declarations(Parser *parser) {
             // Create local when it doesn't exists
             Local *local = function_find_local(parser->current_function, name);
             if (local == NULL) {
-                local = calloc(1, sizeof(Local));
+                local = arena_calloc(1, sizeof(Local));
                 local->name = name;
                 local->type = local_type;
                 list_add(&parser->current_function->locals, local);
@@ -1169,10 +1215,11 @@ Node *parser_primary(Parser *parser) {
 
     if (token->kind == TOKEN_STRING) {
         // Create new string global
-        Global *global = calloc(1, sizeof(Global));
+        Global *global = arena_calloc(1, sizeof(Global));
         global->type = type_new_array(type_new_integer(1, true), strlen(token->string) + 1);
         global->name = string_format("STR%zu", parser->program->strings_count++);
         global->init_data = token->string;
+        global->is_readonly = true;
         list_add(&parser->program->globals, global);
         parser->program->globals_size += align(global->type->size, 4);
 
@@ -1196,7 +1243,7 @@ Node *parser_primary(Parser *parser) {
             if (node->function == NULL) {
                 parser->has_errors = true;
                 print_error(token, "Undefined function: '%s'", name);
-                return node_new_nodes(NODE_NODES, token);
+                return parser_error_node(token);
             }
             node->type = node->function->type->return_type;
             parser->current_function->is_leaf = false;
@@ -1229,7 +1276,7 @@ Node *parser_primary(Parser *parser) {
         if (local == NULL) {
             parser->has_errors = true;
             print_error(token, "Undefined variable: '%s'", name);
-            return node_new_nodes(NODE_NODES, token);
+            return parser_error_node(token);
         }
         Node *node = node_new(NODE_LOCAL, token);
         node->local = local;
@@ -1239,5 +1286,5 @@ Node *parser_primary(Parser *parser) {
 
     parser->has_errors = true;
     print_error(token, "Unexpected token: '%s'", token_kind_to_string(token->kind));
-    return node_new_nodes(NODE_NODES, token);
+    return parser_error_node(token);
 }
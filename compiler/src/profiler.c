@@ -0,0 +1,155 @@
+#include "profiler.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "debugger.h"
+#include "linker.h"
+#include "utils/arena.h"
+#include "utils/buffer.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+// Functions can be compiled from more threads while the program runs
+static ProfilerMode profiler_current_mode = PROFILER_NONE;
+static Arch profiler_arch;
+static int32_t profiler_file = -1;
+static uint64_t profiler_code_index = 0;
+static bool profiler_lock = false;
+
+ProfilerMode profiler_mode(void) { return profiler_current_mode; }
+
+#ifndef _WIN32
+
+// perf record -k mono uses the same clock
+static uint64_t profiler_timestamp(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+static uint32_t profiler_thread_id(void) {
+#ifdef __linux__
+    return syscall(SYS_gettid);
+#else
+    return getpid();
+#endif
+}
+
+bool profiler_start(ProfilerMode mode, Arch arch) {
+    if (mode == PROFILER_NONE) return true;
+    char path[4096];
+    if (mode == PROFILER_PERF_MAP) {
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+    } else {
+        char *directory = getenv("JITDUMPDIR") != NULL ? getenv("JITDUMPDIR") : "/tmp";
+        snprintf(path, sizeof(path), "%s/jit-%d.dump", directory, (int)getpid());
+    }
+    profiler_file = open(path, O_CREAT | O_TRUNC | O_RDWR, 0644);
+    if (profiler_file == -1) return false;
+
+    if (mode == PROFILER_JITDUMP) {
+        ProfilerJitdumpHeader header = {
+            .magic = PROFILER_JITDUMP_MAGIC,
+            .version = PROFILER_JITDUMP_VERSION,
+            .total_size = sizeof(ProfilerJitdumpHeader),
+            .elf_mach = arch == ARCH_X86_64 ? ELF_MACHINE_X86_64 : ELF_MACHINE_AARCH64,
+            .pid = getpid(),
+            .timestamp = profiler_timestamp(),
+        };
+        bool is_written = write(profiler_file, &header, sizeof(header)) == sizeof(header);
+
+        // perf record sees this executable mapping of the file and perf inject finds the jitdump through it
+        if (!is_written || mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, profiler_file, 0) == MAP_FAILED) {
+            close(profiler_file);
+            profiler_file = -1;
+            return false;
+        }
+    }
+    profiler_current_mode = mode;
+    profiler_arch = arch;
+    return true;
+}
+
+void profiler_add_function(Function *function, char *name) {
+    if (profiler_current_mode == PROFILER_NONE) return;
+    while (__atomic_test_and_set(&profiler_lock, __ATOMIC_ACQUIRE)) {
+    }
+
+    Buffer record = {0};
+    if (profiler_current_mode == PROFILER_PERF_MAP) {
+        char line[512];
+        snprintf(line, sizeof(line), "%" PRIxPTR " %zx %s\n", (uintptr_t)function->address, function->size, name);
+        buffer_write(&record, line, strlen(line));
+    } else {
+        // The lines and unwinding information of a function come before its code
+        uint64_t timestamp = profiler_timestamp();
+        if (function->lines.size > 0) {
+            size_t start = buffer_write(&record, NULL, sizeof(ProfilerJitdumpRecord));
+            buffer_write(&record, &(uint64_t){(uintptr_t)function->address}, sizeof(uint64_t));
+            buffer_write(&record, &(uint64_t){function->lines.size}, sizeof(uint64_t));
+            for (size_t i = 0; i < function->lines.size; i++) {
+                FunctionLine *line = function->lines.items[i];
+                ProfilerJitdumpDebugEntry entry = {.code_address = (uintptr_t)line->address, .line = line->token->line};
+                buffer_write(&record, &entry, sizeof(ProfilerJitdumpDebugEntry));
+                buffer_write(&record, line->token->source->path, strlen(line->token->source->path) + 1);
+            }
+            ProfilerJitdumpRecord header = {.id = PROFILER_JITDUMP_CODE_DEBUG_INFO, .total_size = record.size - start, .timestamp = timestamp};
+            memcpy(record.data + start, &header, sizeof(ProfilerJitdumpRecord));
+        }
+
+        // The unwinding information isn't mapped after the code, perf only puts it in the object it writes for the code
+        if (function->frames.size > 0) {
+            size_t start = buffer_write(&record, NULL, sizeof(ProfilerJitdumpRecord) + sizeof(ProfilerJitdumpUnwindingInfo));
+            ProfilerJitdumpUnwindingInfo unwinding_info = {0};
+            unwinding_info.eh_frame_hdr_size = debugger_write_eh_frame(&record, profiler_arch, function, true);
+            unwinding_info.unwinding_size = record.size - start - sizeof(ProfilerJitdumpRecord) - sizeof(ProfilerJitdumpUnwindingInfo);
+            while ((record.size - start) % 8 != 0) buffer_write(&record, NULL, 1);
+            ProfilerJitdumpRecord header = {.id = PROFILER_JITDUMP_CODE_UNWINDING_INFO, .total_size = record.size - start, .timestamp = timestamp};
+            memcpy(record.data + start, &header, sizeof(ProfilerJitdumpRecord));
+            memcpy(record.data + start + sizeof(ProfilerJitdumpRecord), &unwinding_info, sizeof(ProfilerJitdumpUnwindingInfo));
+        }
+
+        size_t start = buffer_write(&record, NULL, sizeof(ProfilerJitdumpRecord));
+        ProfilerJitdumpCodeLoad code_load = {
+            .pid = getpid(),
+            .tid = profiler_thread_id(),
+            .vma = (uintptr_t)function->address,
+            .code_address = (uintptr_t)function->address,
+            .code_size = function->size,
+            .code_index = profiler_code_index++,
+        };
+        buffer_write(&record, &code_load, sizeof(ProfilerJitdumpCodeLoad));
+        buffer_write(&record, name, strlen(name) + 1);
+        buffer_write(&record, function->address, function->size);
+        ProfilerJitdumpRecord header = {.id = PROFILER_JITDUMP_CODE_LOAD, .total_size = record.size - start, .timestamp = timestamp};
+        memcpy(record.data + start, &header, sizeof(ProfilerJitdumpRecord));
+    }
+    if (write(profiler_file, record.data, record.size) != (ssize_t)record.size) profiler_current_mode = PROFILER_NONE;
+    arena_release(record.data);
+    __atomic_clear(&profiler_lock, __ATOMIC_RELEASE);
+}
+
+#else
+
+bool profiler_start(ProfilerMode mode, Arch arch) {
+    (void)arch;
+    return mode == PROFILER_NONE;
+}
+
+void profiler_add_function(Function *function, char *name) {
+    (void)function;
+    (void)name;
+}
+
+#endif
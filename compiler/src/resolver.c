@@ -0,0 +1,114 @@
+#include "resolver.h"
+
+#include <stdlib.h>
+
+// Library handles
+static void *resolver_open(char *path) {
+#ifdef _WIN32
+    return path != NULL ? LoadLibraryA(path) : NULL;
+#else
+    return dlopen(path, RTLD_LAZY);
+#endif
+}
+
+static void *resolver_symbol(void *handle, char *name) {
+#ifdef _WIN32
+    return GetProcAddress(handle, name);
+#else
+    return dlsym(handle, name);
+#endif
+}
+
+static void resolver_close(void *handle) {
+#ifdef _WIN32
+    FreeLibrary(handle);
+#else
+    dlclose(handle);
+#endif
+}
+
+// Resolvers are shared by compiles on different threads
+static void resolver_lock(Resolver *resolver) {
+    while (__atomic_test_and_set(&resolver->lock, __ATOMIC_ACQUIRE)) {
+    }
+}
+
+static void resolver_unlock(Resolver *resolver) { __atomic_clear(&resolver->lock, __ATOMIC_RELEASE); }
+
+// Resolver
+void resolver_init(Resolver *resolver, Arena *arena, Resolver *parent) {
+    *resolver = (Resolver){.arena = arena, .parent = parent};
+    Arena *previous_arena = arena_swap(arena);
+    map_init(&resolver->symbols);
+    list_init(&resolver->libraries);
+    arena_swap(previous_arena);
+}
+
+void resolver_add_symbols(Resolver *resolver, ResolverSymbol *symbols, size_t symbols_size) {
+    resolver_lock(resolver);
+    Arena *previous_arena = arena_swap(resolver->arena);
+    for (size_t i = 0; i < symbols_size; i++) map_set(&resolver->symbols, symbols[i].name, symbols[i].address);
+    arena_swap(previous_arena);
+    resolver_unlock(resolver);
+}
+
+bool resolver_add_library(Resolver *resolver, char *path) {
+    void *handle = resolver_open(path);
+    if (handle == NULL) return false;
+    resolver_lock(resolver);
+    Arena *previous_arena = arena_swap(resolver->arena);
+    list_add(&resolver->libraries, handle);
+    arena_swap(previous_arena);
+    resolver_unlock(resolver);
+    return true;
+}
+
+void *resolver_find(Resolver *resolver, char *name) {
+    resolver_lock(resolver);
+    void *address = map_get(&resolver->symbols, name);
+    if (address == NULL) {
+        for (size_t i = 0; i < resolver->libraries.size && address == NULL; i++) {
+            address = resolver_symbol(resolver->libraries.items[i], name);
+        }
+        if (address == NULL && resolver->parent != NULL) address = resolver_find(resolver->parent, name);
+        if (address != NULL) {
+            Arena *previous_arena = arena_swap(resolver->arena);
+            map_set(&resolver->symbols, name, address);
+            arena_swap(previous_arena);
+        }
+    }
+    resolver_unlock(resolver);
+    return address;
+}
+
+void resolver_free(Resolver *resolver) {
+    Arena *previous_arena = arena_swap(resolver->arena);
+    for (size_t i = 0; i < resolver->libraries.size; i++) resolver_close(resolver->libraries.items[i]);
+    list_free(&resolver->libraries, NULL);
+    map_free(&resolver->symbols, NULL);
+    arena_swap(previous_arena);
+}
+
+Resolver *resolver_host(void) {
+    static Resolver resolver;
+    static bool is_initialized = false;
+    static bool lock = false;
+    while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE)) {
+    }
+    if (!is_initialized) {
+        resolver_init(&resolver, NULL, NULL);
+#ifdef _WIN32
+        resolver_add_library(&resolver, "msvcrt.dll");
+#else
+        resolver_add_library(&resolver, NULL);
+#ifdef __APPLE__
+        resolver_add_library(&resolver, "libSystem.B.dylib");
+#else
+        resolver_add_library(&resolver, "libc.so.6");
+#endif
+#endif
+        is_initialized = true;
+    }
+    __atomic_clear(&lock, __ATOMIC_RELEASE);
+    return &resolver;
+}
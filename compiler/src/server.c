@@ -0,0 +1,221 @@
+// SO_PEERCRED and struct ucred are GNU extensions
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include "server.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/arena.h"
+#include "utils/buffer.h"
+#include "utils/list.h"
+#include "utils/utils.h"
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define SERVER_STREAMS_SIZE 3
+
+// Without a runtime directory the socket goes in a directory in /tmp that only this user can open, so another user
+// can't bind the path first
+char *server_default_path(void) {
+#ifdef _WIN32
+    fprintf(stderr, "The compile server needs Unix sockets\n");
+    return NULL;
+#else
+    if (getenv("XDG_RUNTIME_DIR") != NULL && getenv("XDG_RUNTIME_DIR")[0] != '\0') return string_format("%s/bcc.sock", getenv("XDG_RUNTIME_DIR"));
+    char *directory = string_format("/tmp/bcc-%d", (int)getuid());
+    mkdir(directory, 0700);
+    struct stat info;
+    if (lstat(directory, &info) == -1 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0) {
+        fprintf(stderr, "Compile server directory isn't private: %s\n", directory);
+        arena_release(directory);
+        return NULL;
+    }
+    char *path = string_format("%s/bcc.sock", directory);
+    arena_release(directory);
+    return path;
+#endif
+}
+
+#ifndef _WIN32
+
+// Both ends check that the other end of the socket runs as the same user, the streams and arguments only go to it
+static bool server_is_same_user(int fd) {
+#ifdef __linux__
+    struct ucred credentials;
+    socklen_t size = sizeof(struct ucred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &size) == 0 && credentials.uid == getuid();
+#else
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+static bool server_address(struct sockaddr_un *address, char *path) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address->sun_path)) return false;
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+static bool server_read(int fd, void *data, size_t size) {
+    uint8_t *bytes = data;
+    while (size > 0) {
+        ssize_t bytes_read = read(fd, bytes, size);
+        if (bytes_read <= 0) return false;
+        bytes += bytes_read;
+        size -= bytes_read;
+    }
+    return true;
+}
+
+static bool server_write(int fd, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    while (size > 0) {
+        ssize_t bytes_written = write(fd, bytes, size);
+        if (bytes_written <= 0) return false;
+        bytes += bytes_written;
+        size -= bytes_written;
+    }
+    return true;
+}
+
+// A request is the message size with the client streams attached followed by the working directory and arguments
+static void server_session(int client, ServerHandler handler, void *context) {
+    if (!server_is_same_user(client)) return;
+    uint32_t size;
+    int32_t streams[SERVER_STREAMS_SIZE];
+    struct iovec vector = {.iov_base = &size, .iov_len = sizeof(uint32_t)};
+    union {
+        struct cmsghdr header;
+        uint8_t data[CMSG_SPACE(sizeof(streams))];
+    } control;
+    struct msghdr message = {.msg_iov = &vector, .msg_iovlen = 1, .msg_control = control.data, .msg_controllen = sizeof(control.data)};
+    if (recvmsg(client, &message, MSG_WAITALL) != sizeof(uint32_t)) return;
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == NULL || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(streams))) return;
+    memcpy(streams, CMSG_DATA(header), sizeof(streams));
+
+    char *payload = arena_malloc(size + 1);
+    if (!server_read(client, payload, size)) return;
+    payload[size] = '\0';
+    List arguments = {0};
+    list_init(&arguments);
+    list_add(&arguments, "bcc");
+    char *working_directory = payload;
+    for (char *c = payload + strlen(payload) + 1; c < payload + size; c += strlen(c) + 1) list_add(&arguments, c);
+    if (chdir(working_directory) == -1) return;
+
+    // The program runs in its own child so a crashing program still gets its status back to the client
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(client);
+        for (int32_t i = 0; i < SERVER_STREAMS_SIZE; i++) dup2(streams[i], i);
+        exit(handler(context, arguments.size, (char **)arguments.items));
+    }
+    int32_t status = EXIT_FAILURE;
+    int wait_status;
+    if (pid > 0 && waitpid(pid, &wait_status, 0) == pid) {
+        status = WIFEXITED(wait_status) ? WEXITSTATUS(wait_status) : 128 + WTERMSIG(wait_status);
+    }
+    server_write(client, &status, sizeof(int32_t));
+}
+
+int32_t server_listen(char *path, ServerHandler handler, void *context) {
+    struct sockaddr_un address;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server == -1 || !server_address(&address, path)) return EXIT_FAILURE;
+    unlink(path);
+    if (bind(server, (struct sockaddr *)&address, sizeof(struct sockaddr_un)) == -1 || listen(server, 64) == -1) return EXIT_FAILURE;
+
+    // Every session is a fork of the warm server, sessions are reaped by the kernel
+    signal(SIGCHLD, SIG_IGN);
+    for (;;) {
+        int client = accept(server, NULL, NULL);
+        if (client == -1) continue;
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(server);
+            signal(SIGCHLD, SIG_DFL);
+            server_session(client, handler, context);
+            exit(EXIT_SUCCESS);
+        }
+        close(client);
+    }
+}
+
+int32_t server_connect(char *path, int32_t argc, char **argv) {
+    struct sockaddr_un address;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server == -1 || !server_address(&address, path) || connect(server, (struct sockaddr *)&address, sizeof(struct sockaddr_un)) == -1) {
+        fprintf(stderr, "Can't connect to compile server: %s\n", path);
+        return EXIT_FAILURE;
+    }
+    if (!server_is_same_user(server)) {
+        fprintf(stderr, "Compile server runs as another user: %s\n", path);
+        close(server);
+        return EXIT_FAILURE;
+    }
+
+    char working_directory[4096];
+    if (getcwd(working_directory, sizeof(working_directory)) == NULL) return EXIT_FAILURE;
+    Buffer payload = {0};
+    buffer_write(&payload, working_directory, strlen(working_directory) + 1);
+    for (int32_t i = 0; i < argc; i++) buffer_write(&payload, argv[i], strlen(argv[i]) + 1);
+
+    uint32_t size = payload.size;
+    int32_t streams[SERVER_STREAMS_SIZE] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    struct iovec vector = {.iov_base = &size, .iov_len = sizeof(uint32_t)};
+    union {
+        struct cmsghdr header;
+        uint8_t data[CMSG_SPACE(sizeof(streams))];
+    } control;
+    memset(&control, 0, sizeof(control));
+    struct msghdr message = {.msg_iov = &vector, .msg_iovlen = 1, .msg_control = control.data, .msg_controllen = sizeof(control.data)};
+    struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(streams));
+    memcpy(CMSG_DATA(header), streams, sizeof(streams));
+
+    int32_t status = EXIT_FAILURE;
+    if (sendmsg(server, &message, 0) != sizeof(uint32_t) || !server_write(server, payload.data, payload.size) ||
+        !server_read(server, &status, sizeof(int32_t))) {
+        fprintf(stderr, "Compile server closed the connection: %s\n", path);
+    }
+    arena_release(payload.data);
+    close(server);
+    return status;
+}
+
+#else
+
+int32_t server_listen(char *path, ServerHandler handler, void *context) {
+    (void)path;
+    (void)handler;
+    (void)context;
+    fprintf(stderr, "The compile server needs Unix sockets\n");
+    return EXIT_FAILURE;
+}
+
+int32_t server_connect(char *path, int32_t argc, char **argv) {
+    (void)path;
+    (void)argc;
+    (void)argv;
+    fprintf(stderr, "The compile server needs Unix sockets\n");
+    return EXIT_FAILURE;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "timer.h"
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "utils/arena.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+static char *timer_phase_names[TIMER_PHASES_SIZE] = {"read", "lexer", "parser", "optimizer", "codegen", "linker", "run"};
+
+Timer *timer_new(void) {
+    Timer *timer = arena_calloc(1, sizeof(Timer));
+    timer->counter = -1;
+#ifdef __linux__
+    // Only user space is counted so no perf privileges are needed, threads started later are counted too
+    struct perf_event_attr attr = {
+        .type = PERF_TYPE_HARDWARE,
+        .size = sizeof(struct perf_event_attr),
+        .config = PERF_COUNT_HW_INSTRUCTIONS,
+        .inherit = 1,
+        .exclude_kernel = 1,
+        .exclude_hv = 1,
+    };
+    timer->counter = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    return timer;
+}
+
+static TimerSample timer_sample(Timer *timer) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    ArenaStats stats = arena_stats();
+    uint64_t instructions = 0;
+#ifdef __linux__
+    if (timer->counter != -1 && read(timer->counter, &instructions, sizeof(uint64_t)) != sizeof(uint64_t)) instructions = 0;
+#endif
+
+    // Linux reports the peak in kilobytes and macOS in bytes
+    size_t peak_rss = 0;
+#ifndef _WIN32
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) peak_rss = usage.ru_maxrss;
+#ifndef __APPLE__
+    peak_rss *= 1024;
+#endif
+#endif
+    return (TimerSample){
+        .wall_time = time.tv_sec + time.tv_nsec / 1e9,
+        .cpu_time = (double)clock() / CLOCKS_PER_SEC,
+        .instructions = instructions,
+        .allocations = stats.allocations,
+        .allocated_bytes = stats.allocated_bytes,
+        .peak_rss = peak_rss,
+    };
+}
+
+void timer_start(Timer *timer) {
+    if (timer == NULL) return;
+    timer->start = timer_sample(timer);
+}
+
+void timer_stop(Timer *timer, TimerPhase phase) {
+    if (timer == NULL) return;
+    TimerSample sample = timer_sample(timer);
+    TimerSample *total = &timer->phases[phase];
+    total->wall_time += sample.wall_time - timer->start.wall_time;
+    total->cpu_time += sample.cpu_time - timer->start.cpu_time;
+    total->instructions += sample.instructions - timer->start.instructions;
+    total->allocations += sample.allocations - timer->start.allocations;
+    total->allocated_bytes += sample.allocated_bytes - timer->start.allocated_bytes;
+    total->peak_rss = sample.peak_rss;
+}
+
+static double timer_rate(size_t count, double time) { return time > 0 ? count / time : 0; }
+
+void timer_print(Timer *timer, FILE *file, bool is_json) {
+    TimerSample total = {0};
+    for (TimerPhase phase = 0; phase < TIMER_PHASES_SIZE; phase++) {
+        total.wall_time += timer->phases[phase].wall_time;
+        total.cpu_time += timer->phases[phase].cpu_time;
+        total.instructions += timer->phases[phase].instructions;
+        total.allocations += timer->phases[phase].allocations;
+        total.allocated_bytes += timer->phases[phase].allocated_bytes;
+        if (timer->phases[phase].peak_rss > total.peak_rss) total.peak_rss = timer->phases[phase].peak_rss;
+    }
+
+    // Throughput is measured over the phase that makes the tokens, nodes and code
+    double tokens_rate = timer_rate(timer->tokens_size, timer->phases[TIMER_PHASE_LEXER].wall_time);
+    double nodes_rate = timer_rate(timer->nodes_size, timer->phases[TIMER_PHASE_PARSER].wall_time);
+    double code_rate = timer_rate(timer->code_size, timer->phases[TIMER_PHASE_CODEGEN].wall_time);
+
+    if (is_json) {
+        fprintf(file, "{\"phases\": [");
+        for (TimerPhase phase = 0; phase <= TIMER_PHASES_SIZE; phase++) {
+            TimerSample *sample = phase < TIMER_PHASES_SIZE ? &timer->phases[phase] : &total;
+            char instructions[32] = "null";
+            if (timer->counter != -1) snprintf(instructions, sizeof(instructions), "%" PRIu64, sample->instructions);
+            fprintf(file,
+                    "%s{\"name\": \"%s\", \"wall_ms\": %.3f, \"cpu_ms\": %.3f, \"instructions\": %s, \"allocations\": %zu, \"allocated_bytes\": %zu, "
+                    "\"peak_rss_bytes\": %zu}",
+                    phase > 0 ? ", " : "", phase < TIMER_PHASES_SIZE ? timer_phase_names[phase] : "total", sample->wall_time * 1000,
+                    sample->cpu_time * 1000, instructions, sample->allocations, sample->allocated_bytes, sample->peak_rss);
+        }
+        fprintf(file,
+                "], \"tokens\": %zu, \"nodes\": %zu, \"code_bytes\": %zu, \"tokens_per_second\": %.0f, \"nodes_per_second\": %.0f, "
+                "\"code_bytes_per_second\": %.0f}\n",
+                timer->tokens_size, timer->nodes_size, timer->code_size, tokens_rate, nodes_rate, code_rate);
+        return;
+    }
+
+    fprintf(file, "%-10s %12s %12s %14s %12s %14s %14s\n", "Phase", "Wall (ms)", "CPU (ms)", "Instructions", "Allocations", "Bytes", "Peak RSS");
+    for (TimerPhase phase = 0; phase <= TIMER_PHASES_SIZE; phase++) {
+        TimerSample *sample = phase < TIMER_PHASES_SIZE ? &timer->phases[phase] : &total;
+        char instructions[32] = "-";
+        if (timer->counter != -1) snprintf(instructions, sizeof(instructions), "%" PRIu64, sample->instructions);
+        fprintf(file, "%-10s %12.3f %12.3f %14s %12zu %14zu %14zu\n", phase < TIMER_PHASES_SIZE ? timer_phase_names[phase] : "total",
+                sample->wall_time * 1000, sample->cpu_time * 1000, instructions, sample->allocations, sample->allocated_bytes, sample->peak_rss);
+    }
+    fprintf(file, "Tokens: %zu (%.0f/s) | Nodes: %zu (%.0f/s) | Code: %zu bytes (%.0f/s)\n", timer->tokens_size, tokens_rate, timer->nodes_size,
+            nodes_rate, timer->code_size, code_rate);
+}
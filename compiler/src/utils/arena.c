@@ -0,0 +1,105 @@
+#include "utils/arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every block starts with a header that links it into its arena, the header keeps the malloc alignment
+struct ArenaBlock {
+    Arena *arena;
+    ArenaBlock *prev;
+    ArenaBlock *next;
+    size_t padding;
+};
+
+static _Thread_local Arena *arena_current = NULL;
+static _Thread_local ArenaStats arena_current_stats = {0};
+
+Arena *arena_swap(Arena *arena) {
+    Arena *previous = arena_current;
+    arena_current = arena;
+    return previous;
+}
+
+ArenaStats arena_stats(void) { return arena_current_stats; }
+
+static void arena_link(ArenaBlock *block) {
+    block->prev = NULL;
+    block->next = NULL;
+    if (block->arena == NULL) return;
+    block->next = block->arena->blocks;
+    if (block->next != NULL) block->next->prev = block;
+    block->arena->blocks = block;
+}
+
+static void arena_unlink(ArenaBlock *block) {
+    if (block->arena == NULL) return;
+    if (block->prev != NULL) {
+        block->prev->next = block->next;
+    } else {
+        block->arena->blocks = block->next;
+    }
+    if (block->next != NULL) block->next->prev = block->prev;
+}
+
+void *arena_malloc(size_t size) {
+    ArenaBlock *block = malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL) return NULL;
+    arena_current_stats.allocations++;
+    arena_current_stats.allocated_bytes += size;
+    block->arena = arena_current;
+    arena_link(block);
+    return block + 1;
+}
+
+void *arena_calloc(size_t count, size_t size) {
+    void *ptr = arena_malloc(count * size);
+    if (ptr != NULL) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// A block stays in the arena it was allocated in
+void *arena_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) return arena_malloc(size);
+    ArenaBlock *block = (ArenaBlock *)ptr - 1;
+    arena_unlink(block);
+    ArenaBlock *new_block = realloc(block, sizeof(ArenaBlock) + size);
+    if (new_block == NULL) {
+        arena_link(block);
+        return NULL;
+    }
+    arena_link(new_block);
+    arena_current_stats.allocations++;
+    arena_current_stats.allocated_bytes += size;
+    return new_block + 1;
+}
+
+void arena_release(void *ptr) {
+    if (ptr == NULL) return;
+    ArenaBlock *block = (ArenaBlock *)ptr - 1;
+    arena_unlink(block);
+    free(block);
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+}
+
+void arena_join(Arena *arena, ArenaStats stats) {
+    ArenaBlock *block = arena->blocks;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        block->arena = arena_current;
+        arena_link(block);
+        block = next;
+    }
+    arena->blocks = NULL;
+    arena_current_stats.allocations += stats.allocations;
+    arena_current_stats.allocated_bytes += stats.allocated_bytes;
+}
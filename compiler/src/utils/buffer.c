@@ -0,0 +1,25 @@
+#include "utils/buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils/arena.h"
+#include "utils/utils.h"
+
+// Appends data or zeros when data is NULL and returns the offset it was written at
+size_t buffer_write(Buffer *buffer, const void *data, size_t size) {
+    if (buffer->size + size > buffer->capacity) {
+        buffer->capacity = buffer->capacity * 2 > buffer->size + size ? buffer->capacity * 2 : buffer->size + size + 256;
+        buffer->data = arena_realloc(buffer->data, buffer->capacity);
+    }
+    size_t offset = buffer->size;
+    if (data != NULL) {
+        memcpy(buffer->data + offset, data, size);
+    } else {
+        memset(buffer->data + offset, 0, size);
+    }
+    buffer->size += size;
+    return offset;
+}
+
+void buffer_align(Buffer *buffer, size_t alignment) { buffer_write(buffer, NULL, align(buffer->size, alignment) - buffer->size); }
@@ -2,10 +2,12 @@
 
 #include <stdlib.h>
 
+#include "utils/arena.h"
+
 List *list_new(void) { return list_new_with_capacity(0); }
 
 List *list_new_with_capacity(size_t capacity) {
-    List *list = calloc(1, sizeof(List));
+    List *list = arena_calloc(1, sizeof(List));
     list->allocated = true;
     list->capacity = capacity;
     list_init(list);
@@ -14,7 +16,7 @@ List *list_new_with_capacity(size_t capacity) {
 
 void list_init(List *list) {
     if (list->capacity == 0) list->capacity = 8;
-    list->items = malloc(list->capacity * sizeof(void *));
+    list->items = arena_malloc(list->capacity * sizeof(void *));
 }
 
 void *list_get(List *list, size_t index) {
@@ -25,7 +27,7 @@ void *list_get(List *list, size_t index) {
 void list_set(List *list, size_t index, void *item) {
     if (index > list->capacity) {
         while (index > list->capacity) list->capacity <<= 1;
-        list->items = realloc(list->items, list->capacity * sizeof(void *));
+        list->items = arena_realloc(list->items, list->capacity * sizeof(void *));
     }
     if (index > list->size) {
         for (size_t i = list->size; i < index - 1; i++) {
@@ -39,7 +41,7 @@ void list_set(List *list, size_t index, void *item) {
 void list_add(List *list, void *item) {
     if (list->size == list->capacity) {
         list->capacity <<= 1;
-        list->items = realloc(list->items, list->capacity * sizeof(void *));
+        list->items = arena_realloc(list->items, list->capacity * sizeof(void *));
     }
     list->items[list->size++] = item;
 }
@@ -50,6 +52,6 @@ void list_free(List *list, ListFreeFunc free_func) {
             if (list->items[i]) free_func(list->items[i]);
         }
     }
-    free(list->items);
-    if (list->allocated) free(list);
+    arena_release(list->items);
+    if (list->allocated) arena_release(list);
 }
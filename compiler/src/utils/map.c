@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils/arena.h"
 #include "utils/utils.h"
 
 static uint32_t map_hash(char *key) {
@@ -18,7 +19,7 @@ static uint32_t map_hash(char *key) {
 Map *map_new(void) { return map_new_with_capacity(0); }
 
 Map *map_new_with_capacity(size_t capacity) {
-    Map *map = calloc(1, sizeof(Map));
+    Map *map = arena_calloc(1, sizeof(Map));
     map->allocated = true;
     map->capacity = capacity;
     map_init(map);
@@ -27,8 +28,8 @@ Map *map_new_with_capacity(size_t capacity) {
 
 void map_init(Map *map) {
     if (map->capacity == 0) map->capacity = 8;
-    map->keys = calloc(map->capacity, sizeof(char *));
-    map->values = malloc(map->capacity * sizeof(void *));
+    map->keys = arena_calloc(map->capacity, sizeof(char *));
+    map->values = arena_malloc(map->capacity * sizeof(void *));
 }
 
 void *map_get(Map *map, char *key) {
@@ -45,8 +46,8 @@ void *map_get(Map *map, char *key) {
 void map_set(Map *map, char *key, void *value) {
     if (map->filled >= map->capacity * 3 / 4) {
         map->capacity <<= 1;
-        char **newKeys = calloc(map->capacity, sizeof(char *));
-        void **newValues = malloc(map->capacity * sizeof(void *));
+        char **newKeys = arena_calloc(map->capacity, sizeof(char *));
+        void **newValues = arena_malloc(map->capacity * sizeof(void *));
         for (size_t i = 0; i < map->capacity >> 1; i++) {
             if (map->keys[i]) {
                 size_t index = map_hash(map->keys[i]) & (map->capacity - 1);
@@ -57,8 +58,8 @@ void map_set(Map *map, char *key, void *value) {
                 newValues[index] = map->values[i];
             }
         }
-        free(map->keys);
-        free(map->values);
+        arena_release(map->keys);
+        arena_release(map->values);
         map->keys = newKeys;
         map->values = newValues;
     }
@@ -72,18 +73,18 @@ void map_set(Map *map, char *key, void *value) {
         index = (index + 1) & (map->capacity - 1);
     }
 
-    map->keys[index] = strdup(key);
+    map->keys[index] = string_dup(key);
     map->values[index] = value;
     map->filled++;
 }
 
 void map_free(Map *map, MapFreeFunc free_func) {
     for (size_t i = 0; i < map->capacity; i++) {
-        if (map->keys[i]) free(map->keys[i]);
+        if (map->keys[i]) arena_release(map->keys[i]);
         if (free_func && map->values[i]) free_func(map->values[i]);
     }
 
-    free(map->keys);
-    free(map->values);
-    if (map->allocated) free(map);
+    arena_release(map->keys);
+    arena_release(map->values);
+    if (map->allocated) arena_release(map);
 }
@@ -0,0 +1,101 @@
+#include "utils/pool.h"
+
+#include <stdbool.h>
+
+#include "utils/arena.h"
+#include "utils/thread.h"
+
+typedef struct PoolRange {
+    pthread_mutex_t lock;
+    size_t begin;
+    size_t end;
+} PoolRange;
+
+typedef struct Pool {
+    PoolRange *ranges;
+    size_t threads;
+    PoolFunc func;
+    void *context;
+} Pool;
+
+typedef struct PoolWorker {
+    Pool *pool;
+    size_t index;
+    Thread thread;
+} PoolWorker;
+
+static bool pool_take(PoolRange *range, size_t *task) {
+    pthread_mutex_lock(&range->lock);
+    bool is_taken = range->begin < range->end;
+    if (is_taken) *task = range->begin++;
+    pthread_mutex_unlock(&range->lock);
+    return is_taken;
+}
+
+// Runs the first stolen task right away and keeps the others as the range of the worker
+static bool pool_steal(Pool *pool, size_t worker, size_t *task) {
+    for (;;) {
+        PoolRange *victim = NULL;
+        size_t victim_size = 0;
+        for (size_t i = 0; i < pool->threads; i++) {
+            PoolRange *range = &pool->ranges[i];
+            pthread_mutex_lock(&range->lock);
+            size_t size = range->end - range->begin;
+            pthread_mutex_unlock(&range->lock);
+            if (i != worker && size > victim_size) {
+                victim = range;
+                victim_size = size;
+            }
+        }
+        if (victim == NULL) return false;
+
+        // The range can be taken empty between looking and stealing, then look again
+        pthread_mutex_lock(&victim->lock);
+        size_t begin = victim->begin + (victim->end - victim->begin) / 2;
+        size_t end = victim->end;
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+        if (begin == end) continue;
+
+        PoolRange *range = &pool->ranges[worker];
+        pthread_mutex_lock(&range->lock);
+        range->begin = begin + 1;
+        range->end = end;
+        pthread_mutex_unlock(&range->lock);
+        *task = begin;
+        return true;
+    }
+}
+
+static void pool_work(Pool *pool, size_t worker) {
+    size_t task;
+    while (pool_take(&pool->ranges[worker], &task) || pool_steal(pool, worker, &task)) pool->func(pool->context, worker, task);
+}
+
+static void pool_thread(void *argument) {
+    PoolWorker *worker = argument;
+    pool_work(worker->pool, worker->index);
+}
+
+void pool_run(size_t threads, size_t tasks, PoolFunc func, void *context) {
+    if (threads == 0) threads = 1;
+    Pool pool = {.ranges = arena_calloc(threads, sizeof(PoolRange)), .threads = threads, .func = func, .context = context};
+    for (size_t i = 0; i < threads; i++) {
+        PoolRange *range = &pool.ranges[i];
+        pthread_mutex_init(&range->lock, NULL);
+        range->begin = tasks * i / threads;
+        range->end = tasks * (i + 1) / threads;
+    }
+
+    PoolWorker *workers = arena_calloc(threads, sizeof(PoolWorker));
+    for (size_t i = 1; i < threads; i++) {
+        workers[i] = (PoolWorker){.pool = &pool, .index = i};
+        thread_start(&workers[i].thread, pool_thread, &workers[i]);
+    }
+    pool_work(&pool, 0);
+    for (size_t i = 1; i < threads; i++) thread_join(&workers[i].thread, true);
+
+    for (size_t i = 0; i < threads; i++) pthread_mutex_destroy(&pool.ranges[i].lock);
+    arena_release(workers);
+    arena_release(pool.ranges);
+}
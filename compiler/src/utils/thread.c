@@ -0,0 +1,45 @@
+#include "utils/thread.h"
+
+#include "utils/utils.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+static void *thread_main(void *argument) {
+    Thread *thread = argument;
+    arena_swap(&thread->arena);
+    print_error_redirect(&thread->errors);
+    thread->func(thread->argument);
+    thread->stats = arena_stats();
+    return NULL;
+}
+
+// A thread that can't be created runs its work on the current thread
+void thread_start(Thread *thread, ThreadFunc func, void *argument) {
+    *thread = (Thread){.func = func, .argument = argument};
+    if (pthread_create(&thread->thread, NULL, thread_main, thread) != 0) {
+        Arena *previous_arena = arena_swap(&thread->arena);
+        Buffer *previous_errors = print_error_redirect(&thread->errors);
+        func(argument);
+        print_error_redirect(previous_errors);
+        arena_swap(previous_arena);
+        thread->func = NULL;
+    }
+}
+
+void thread_join(Thread *thread, bool is_reporting) {
+    if (thread->func != NULL) pthread_join(thread->thread, NULL);
+    arena_join(&thread->arena, thread->stats);
+    if (is_reporting) print_error_buffer(&thread->errors);
+    arena_release(thread->errors.data);
+}
+
+size_t thread_cpus(void) {
+#ifdef _WIN32
+    return 1;
+#else
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (size_t)cpus : 1;
+#endif
+}
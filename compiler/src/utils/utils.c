@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "utils/arena.h"
+#include "utils/buffer.h"
+
 // Math
 size_t align(size_t size, size_t align) { return (size + align - 1) / align * align; }
 
@@ -18,11 +21,11 @@ uint64_t log_two(uint64_t x) {
     return result;
 }
 
-// Strdup pollyfills
-char *strdup(const char *str) { return strndup(str, strlen(str)); }
+// Strings
+char *string_dup(const char *str) { return string_ndup(str, strlen(str)); }
 
-char *strndup(const char *str, size_t size) {
-    char *copy = malloc(size + 1);
+char *string_ndup(const char *str, size_t size) {
+    char *copy = arena_malloc(size + 1);
     if (copy == NULL) return NULL;
     memcpy(copy, str, size);
     copy[size] = '\0';
@@ -35,19 +38,18 @@ char *strndup(const char *str, size_t size) {
 char *file_read(FILE *file) {
     // Read stdin in chunks because fseek SEEK_END won't work
     if (file == stdin) {
-        // Buggy: not well tested
-        size_t capacity = FILE_READ_BUFFER_SIZE;
-        char *buffer = malloc(capacity);
-        char *c = buffer;
+        size_t capacity = FILE_READ_BUFFER_SIZE + 1;
+        char *buffer = arena_malloc(capacity);
+        size_t size = 0;
         size_t bytes_read;
-        while ((bytes_read = fread(c, 1, FILE_READ_BUFFER_SIZE, file)) > 0) {
-            c += bytes_read;
-            if ((size_t)(c - buffer) + FILE_READ_BUFFER_SIZE > capacity) {
+        while ((bytes_read = fread(buffer + size, 1, FILE_READ_BUFFER_SIZE, file)) > 0) {
+            size += bytes_read;
+            if (size + FILE_READ_BUFFER_SIZE + 1 > capacity) {
                 capacity *= 2;
-                buffer = realloc(buffer, capacity);
+                buffer = arena_realloc(buffer, capacity);
             }
         }
-        *c = '\0';
+        buffer[size] = '\0';
         return buffer;
     }
 
@@ -55,7 +57,7 @@ char *file_read(FILE *file) {
     fseek(file, 0, SEEK_END);
     size_t file_size = ftell(file);
     fseek(file, 0, SEEK_SET);
-    char *buffer = malloc(file_size + 1);
+    char *buffer = arena_malloc(file_size + 1);
     file_size = fread(buffer, 1, file_size, file);
     buffer[file_size] = '\0';
     return buffer;
@@ -68,14 +70,24 @@ char *string_format(char *fmt, ...) {
     va_start(args, fmt);
     vsprintf(buffer, fmt, args);
     va_end(args);
-    return strdup(buffer);
+    return string_dup(buffer);
+}
+
+// Errors go to stderr unless they are redirected to a buffer of the current thread
+static _Thread_local Buffer *error_buffer = NULL;
+
+Buffer *print_error_redirect(Buffer *buffer) {
+    Buffer *previous = error_buffer;
+    error_buffer = buffer;
+    return previous;
 }
 
 void print_error(Token *token, char *fmt, ...) {
-    fprintf(stderr, "%s:%d:%d ERROR: ", token->source->basename, token->line, token->column);
+    char message[512];
+    int32_t message_size = snprintf(message, sizeof(message), "%s:%d:%d ERROR: ", token->source->basename, token->line, token->column);
     va_list args;
     va_start(args, fmt);
-    vfprintf(stderr, fmt, args);
+    vsnprintf(message + message_size, sizeof(message) - message_size, fmt, args);
     va_end(args);
 
     // Seek to the right line in text
@@ -89,9 +101,23 @@ void print_error(Token *token, char *fmt, ...) {
     while (*c != '\n' && *c != '\r' && *c != '\0') c++;
     int32_t line_length = c - line_start;
 
-    fprintf(stderr, "\n%4d | ", token->line);
-    fwrite(line_start, 1, line_length, stderr);
-    fprintf(stderr, "\n     | ");
-    for (int32_t i = 0; i < token->column - 1; i++) fprintf(stderr, " ");
-    fprintf(stderr, "^\n");
+    Buffer error = {0};
+    buffer_write(&error, message, strlen(message));
+    snprintf(message, sizeof(message), "\n%4d | ", token->line);
+    buffer_write(&error, message, strlen(message));
+    buffer_write(&error, line_start, line_length);
+    buffer_write(&error, "\n     | ", 8);
+    for (int32_t i = 0; i < token->column - 1; i++) buffer_write(&error, " ", 1);
+    buffer_write(&error, "^\n", 2);
+    print_error_buffer(&error);
+    arena_release(error.data);
+}
+
+void print_error_buffer(Buffer *errors) {
+    if (errors->size == 0) return;
+    if (error_buffer != NULL) {
+        buffer_write(error_buffer, errors->data, errors->size);
+    } else {
+        fwrite(errors->data, 1, errors->size, stderr);
+    }
 }